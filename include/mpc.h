@@ -354,7 +354,8 @@ mpc_parser_t *mpca_and(int n, ...);
 enum {
   MPCA_LANG_DEFAULT              = 0,
   MPCA_LANG_PREDICTIVE           = 1,
-  MPCA_LANG_WHITESPACE_SENSITIVE = 2
+  MPCA_LANG_WHITESPACE_SENSITIVE = 2,
+  MPCA_LANG_PACKRAT              = 4
 };
 
 mpc_parser_t *mpca_grammar(int flags, const char *grammar, ...);
@@ -364,6 +365,39 @@ mpc_err_t *mpca_lang_file(int flags, FILE *f, ...);
 mpc_err_t *mpca_lang_pipe(int flags, FILE *f, ...);
 mpc_err_t *mpca_lang_contents(int flags, const char *filename, ...);
 
+/*
+** Views
+**
+** A view is the AST of a grammar built with the functions above, read
+** without copying the input. The contents of a node are `len` bytes of
+** the input, not terminated, and its tag is the index of the innermost
+** rule it was parsed by among the `n` rules passed to the parse, or
+** MPC_VIEW_ROOT or MPC_VIEW_TOKEN. Nodes come from one block of memory
+** freed by `mpc_view_delete` on the root.
+**
+** `mpc_parse_view` borrows `string`, which must outlive the view, and
+** `mpc_parse_view_contents` reads the file into memory owned by it.
+*/
+
+enum {
+  MPC_VIEW_ROOT  = -1,
+  MPC_VIEW_TOKEN = -2
+};
+
+typedef struct mpc_view_t {
+  int tag;
+  int children_num;
+  const char *contents;
+  size_t len;
+  mpc_state_t state;
+  struct mpc_view_t **children;
+} mpc_view_t;
+
+int mpc_parse_view(const char *filename, const char *string, mpc_parser_t *p, mpc_result_t *r, int n, ...);
+int mpc_parse_view_contents(const char *filename, mpc_parser_t *p, mpc_result_t *r, int n, ...);
+
+void mpc_view_delete(mpc_view_t *v);
+
 /*
 ** Misc
 */
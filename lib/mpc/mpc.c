@@ -67,13 +67,53 @@ enum {
   MPC_INPUT_MARKS_MIN = 32
 };
 
+/*
+** Memory for values during a parse comes from pages of the input, each
+** page holding blocks of one size class from 16 to 512 bytes. Freed
+** blocks go on the free list of their class. Pages are cut from chunks
+** doubling in size, which are all freed with the input.
+*/
+
+enum {
+  MPC_MEM_CLASSES = 6,
+  MPC_MEM_CLASS_MIN = 16,
+  MPC_MEM_PAGE = 4096,
+  MPC_MEM_CHUNK_MIN = 4,
+  MPC_MEM_CHUNKS_MAX = 24
+};
+
+typedef struct {
+  char *base;
+  char *end;
+  unsigned char *classes;
+} mpc_mem_chunk_t;
+
+typedef struct mpc_memo_t mpc_memo_t;
+typedef struct mpc_memo_block_t mpc_memo_block_t;
+typedef struct mpc_live_t mpc_live_t;
+
+/*
+** The nodes of a view are cut from blocks of the input doubling in
+** size. The root of the finished view moves to the head of the first
+** block, so deleting the root finds the blocks again.
+*/
+
 enum {
-  MPC_INPUT_MEM_NUM = 512
+  MPC_VIEW_BLOCK_MIN = 4096
 };
 
+typedef struct mpc_view_block_t mpc_view_block_t;
+
+struct mpc_view_block_t {
+  mpc_view_t root;
+  mpc_view_block_t *next;
+};
+
+/* Text matched while parsing a view, `len` bytes of the input */
 typedef struct {
-  char mem[64];
-} mpc_mem_t;
+  const char *s;
+  size_t len;
+} mpc_span_t;
 
 typedef struct {
 
@@ -81,7 +121,7 @@ typedef struct {
   char *filename;
   mpc_state_t state;
 
-  char *string;
+  const char *string;
   char *buffer;
   FILE *file;
 
@@ -94,9 +134,30 @@ typedef struct {
   char *lasts;
   char last;
 
-  size_t mem_index;
-  char mem_full[MPC_INPUT_MEM_NUM];
-  mpc_mem_t mem[MPC_INPUT_MEM_NUM];
+  int fast;
+
+  mpc_memo_t **memo;
+  size_t memo_slots;
+  size_t memo_num;
+  mpc_memo_block_t *memo_blocks;
+  mpc_live_t *live;
+  size_t live_slots;
+  size_t live_num;
+
+  int view;
+  int rules_num;
+  mpc_parser_t **rules;
+  mpc_view_block_t *view_blocks;
+  mpc_view_block_t *view_last;
+  char *view_next;
+  char *view_end;
+
+  int mem_chunks_num;
+  size_t mem_pages;
+  mpc_mem_chunk_t mem_chunks[MPC_MEM_CHUNKS_MAX];
+  char *mem_next[MPC_MEM_CLASSES];
+  char *mem_end[MPC_MEM_CLASSES];
+  void *mem_free[MPC_MEM_CLASSES];
 
 } mpc_input_t;
 
@@ -110,8 +171,7 @@ static mpc_input_t *mpc_input_new_string(const char *filename, const char *strin
 
   i->state = mpc_state_new();
 
-  i->string = malloc(strlen(string) + 1);
-  strcpy(i->string, string);
+  i->string = string;
   i->buffer = NULL;
   i->file = NULL;
 
@@ -123,8 +183,29 @@ static mpc_input_t *mpc_input_new_string(const char *filename, const char *strin
   i->lasts = malloc(sizeof(char) * i->marks_slots);
   i->last = '\0';
 
-  i->mem_index = 0;
-  memset(i->mem_full, 0, sizeof(char) * MPC_INPUT_MEM_NUM);
+  i->fast = 1;
+
+  i->memo = NULL;
+  i->memo_slots = 0;
+  i->memo_num = 0;
+  i->memo_blocks = NULL;
+  i->live = NULL;
+  i->live_slots = 0;
+  i->live_num = 0;
+
+  i->view = 0;
+  i->rules_num = 0;
+  i->rules = NULL;
+  i->view_blocks = NULL;
+  i->view_last = NULL;
+  i->view_next = NULL;
+  i->view_end = NULL;
+
+  i->mem_chunks_num = 0;
+  i->mem_pages = 0;
+  memset(i->mem_next, 0, sizeof(char*) * MPC_MEM_CLASSES);
+  memset(i->mem_end, 0, sizeof(char*) * MPC_MEM_CLASSES);
+  memset(i->mem_free, 0, sizeof(void*) * MPC_MEM_CLASSES);
 
   return i;
 }
@@ -139,10 +220,10 @@ static mpc_input_t *mpc_input_new_nstring(const char *filename, const char *stri
 
   i->state = mpc_state_new();
 
-  i->string = malloc(length + 1);
-  strncpy(i->string, string, length);
-  i->string[length] = '\0';
-  i->buffer = NULL;
+  i->buffer = malloc(length + 1);
+  strncpy(i->buffer, string, length);
+  i->buffer[length] = '\0';
+  i->string = i->buffer;
   i->file = NULL;
 
   i->suppress = 0;
@@ -153,8 +234,29 @@ static mpc_input_t *mpc_input_new_nstring(const char *filename, const char *stri
   i->lasts = malloc(sizeof(char) * i->marks_slots);
   i->last = '\0';
 
-  i->mem_index = 0;
-  memset(i->mem_full, 0, sizeof(char) * MPC_INPUT_MEM_NUM);
+  i->fast = 1;
+
+  i->memo = NULL;
+  i->memo_slots = 0;
+  i->memo_num = 0;
+  i->memo_blocks = NULL;
+  i->live = NULL;
+  i->live_slots = 0;
+  i->live_num = 0;
+
+  i->view = 0;
+  i->rules_num = 0;
+  i->rules = NULL;
+  i->view_blocks = NULL;
+  i->view_last = NULL;
+  i->view_next = NULL;
+  i->view_end = NULL;
+
+  i->mem_chunks_num = 0;
+  i->mem_pages = 0;
+  memset(i->mem_next, 0, sizeof(char*) * MPC_MEM_CLASSES);
+  memset(i->mem_end, 0, sizeof(char*) * MPC_MEM_CLASSES);
+  memset(i->mem_free, 0, sizeof(void*) * MPC_MEM_CLASSES);
 
   return i;
 
@@ -182,8 +284,29 @@ static mpc_input_t *mpc_input_new_pipe(const char *filename, FILE *pipe) {
   i->lasts = malloc(sizeof(char) * i->marks_slots);
   i->last = '\0';
 
-  i->mem_index = 0;
-  memset(i->mem_full, 0, sizeof(char) * MPC_INPUT_MEM_NUM);
+  i->fast = 0;
+
+  i->memo = NULL;
+  i->memo_slots = 0;
+  i->memo_num = 0;
+  i->memo_blocks = NULL;
+  i->live = NULL;
+  i->live_slots = 0;
+  i->live_num = 0;
+
+  i->view = 0;
+  i->rules_num = 0;
+  i->rules = NULL;
+  i->view_blocks = NULL;
+  i->view_last = NULL;
+  i->view_next = NULL;
+  i->view_end = NULL;
+
+  i->mem_chunks_num = 0;
+  i->mem_pages = 0;
+  memset(i->mem_next, 0, sizeof(char*) * MPC_MEM_CLASSES);
+  memset(i->mem_end, 0, sizeof(char*) * MPC_MEM_CLASSES);
+  memset(i->mem_free, 0, sizeof(void*) * MPC_MEM_CLASSES);
 
   return i;
 
@@ -210,48 +333,111 @@ static mpc_input_t *mpc_input_new_file(const char *filename, FILE *file) {
   i->lasts = malloc(sizeof(char) * i->marks_slots);
   i->last = '\0';
 
-  i->mem_index = 0;
-  memset(i->mem_full, 0, sizeof(char) * MPC_INPUT_MEM_NUM);
+  i->fast = 1;
+
+  i->memo = NULL;
+  i->memo_slots = 0;
+  i->memo_num = 0;
+  i->memo_blocks = NULL;
+  i->live = NULL;
+  i->live_slots = 0;
+  i->live_num = 0;
+
+  i->view = 0;
+  i->rules_num = 0;
+  i->rules = NULL;
+  i->view_blocks = NULL;
+  i->view_last = NULL;
+  i->view_next = NULL;
+  i->view_end = NULL;
+
+  i->mem_chunks_num = 0;
+  i->mem_pages = 0;
+  memset(i->mem_next, 0, sizeof(char*) * MPC_MEM_CLASSES);
+  memset(i->mem_end, 0, sizeof(char*) * MPC_MEM_CLASSES);
+  memset(i->mem_free, 0, sizeof(void*) * MPC_MEM_CLASSES);
 
   return i;
 }
 
+static void mpc_view_blocks_free(mpc_view_block_t *b) {
+  mpc_view_block_t *n;
+  while (b) { n = b->next; free(b); b = n; }
+}
+
 static void mpc_input_delete(mpc_input_t *i) {
 
   free(i->filename);
 
-  if (i->type == MPC_INPUT_STRING) { free(i->string); }
-  if (i->type == MPC_INPUT_PIPE) { free(i->buffer); }
+  free(i->buffer);
+  free(i->rules);
+  mpc_view_blocks_free(i->view_blocks);
 
   free(i->marks);
   free(i->lasts);
+
+  while (i->mem_chunks_num) { free(i->mem_chunks[--i->mem_chunks_num].base); }
+
   free(i);
 }
 
-static int mpc_mem_ptr(mpc_input_t *i, void *p) {
-  return
-    (char*)p >= (char*)(i->mem) &&
-    (char*)p <  (char*)(i->mem) + (MPC_INPUT_MEM_NUM * sizeof(mpc_mem_t));
+/* Chunk holding `p`, NULL if it was not allocated from the input */
+static mpc_mem_chunk_t *mpc_mem_chunk(mpc_input_t *i, void *p) {
+  int j;
+  for (j = i->mem_chunks_num - 1; j >= 0; j--) {
+    if ((char*)p >= i->mem_chunks[j].base && (char*)p < i->mem_chunks[j].end) {
+      return &i->mem_chunks[j];
+    }
+  }
+  return NULL;
+}
+
+static size_t mpc_mem_size(mpc_mem_chunk_t *c, void *p) {
+  return (size_t)MPC_MEM_CLASS_MIN << c->classes[((char*)p - c->base) / MPC_MEM_PAGE];
+}
+
+/* Starts a new page of blocks of class `k`, 0 if the chunks are used up */
+static int mpc_mem_page(mpc_input_t *i, int k) {
+
+  mpc_mem_chunk_t *c = i->mem_chunks_num ? &i->mem_chunks[i->mem_chunks_num-1] : NULL;
+  size_t pages;
+
+  if (!c || c->base + i->mem_pages * MPC_MEM_PAGE == c->end) {
+    if (i->mem_chunks_num == MPC_MEM_CHUNKS_MAX) { return 0; }
+    pages = (size_t)MPC_MEM_CHUNK_MIN << i->mem_chunks_num;
+    c = &i->mem_chunks[i->mem_chunks_num++];
+    c->base = malloc(pages * MPC_MEM_PAGE + pages);
+    c->end = c->base + pages * MPC_MEM_PAGE;
+    c->classes = (unsigned char*)c->end;
+    i->mem_pages = 0;
+  }
+
+  c->classes[i->mem_pages] = (unsigned char)k;
+  i->mem_next[k] = c->base + i->mem_pages * MPC_MEM_PAGE;
+  i->mem_end[k] = i->mem_next[k] + MPC_MEM_PAGE;
+  i->mem_pages++;
+  return 1;
 }
 
 static void *mpc_malloc(mpc_input_t *i, size_t n) {
-  size_t j;
-  char *p;
 
-  if (n > sizeof(mpc_mem_t)) { return malloc(n); }
+  int k = 0;
+  void *p;
 
-  j = i->mem_index;
-  do {
-    if (!i->mem_full[i->mem_index]) {
-      p = (void*)(i->mem + i->mem_index);
-      i->mem_full[i->mem_index] = 1;
-      i->mem_index = (i->mem_index+1) % MPC_INPUT_MEM_NUM;
-      return p;
-    }
-    i->mem_index = (i->mem_index+1) % MPC_INPUT_MEM_NUM;
-  } while (j != i->mem_index);
+  while (k < MPC_MEM_CLASSES && ((size_t)MPC_MEM_CLASS_MIN << k) < n) { k++; }
+  if (k == MPC_MEM_CLASSES) { return malloc(n); }
+
+  if (i->mem_free[k]) {
+    p = i->mem_free[k];
+    i->mem_free[k] = *(void**)p;
+    return p;
+  }
+
+  if (i->mem_next[k] == i->mem_end[k] && !mpc_mem_page(i, k)) { return malloc(n); }
 
-  return malloc(n);
+  p = i->mem_next[k];
+  i->mem_next[k] += (size_t)MPC_MEM_CLASS_MIN << k;
+  return p;
 }
 
 static void *mpc_calloc(mpc_input_t *i, size_t n, size_t m) {
@@ -261,21 +447,26 @@ static void *mpc_calloc(mpc_input_t *i, size_t n, size_t m) {
 }
 
 static void mpc_free(mpc_input_t *i, void *p) {
-  size_t j;
-  if (!mpc_mem_ptr(i, p)) { free(p); return; }
-  j = ((size_t)(((char*)p) - ((char*)i->mem))) / sizeof(mpc_mem_t);
-  i->mem_full[j] = 0;
+  int k;
+  mpc_mem_chunk_t *c = mpc_mem_chunk(i, p);
+  if (!c) { free(p); return; }
+  k = c->classes[((char*)p - c->base) / MPC_MEM_PAGE];
+  *(void**)p = i->mem_free[k];
+  i->mem_free[k] = p;
 }
 
 static void *mpc_realloc(mpc_input_t *i, void *p, size_t n) {
 
   char *q = NULL;
+  size_t m;
+  mpc_mem_chunk_t *c = mpc_mem_chunk(i, p);
 
-  if (!mpc_mem_ptr(i, p)) { return realloc(p, n); }
+  if (!c) { return realloc(p, n); }
 
-  if (n > sizeof(mpc_mem_t)) {
-    q = malloc(n);
-    memcpy(q, p, sizeof(mpc_mem_t));
+  m = mpc_mem_size(c, p);
+  if (n > m) {
+    q = mpc_malloc(i, n);
+    memcpy(q, p, m);
     mpc_free(i, p);
     return q;
   }
@@ -283,15 +474,50 @@ static void *mpc_realloc(mpc_input_t *i, void *p, size_t n) {
   return p;
 }
 
+/* Copies `p` out of the input, for values that outlive the parse */
 static void *mpc_export(mpc_input_t *i, void *p) {
   char *q = NULL;
-  if (!mpc_mem_ptr(i, p)) { return p; }
-  q = malloc(sizeof(mpc_mem_t));
-  memcpy(q, p, sizeof(mpc_mem_t));
+  size_t m;
+  mpc_mem_chunk_t *c = mpc_mem_chunk(i, p);
+  if (!c) { return p; }
+  m = mpc_mem_size(c, p);
+  q = malloc(m);
+  memcpy(q, p, m);
   mpc_free(i, p);
   return q;
 }
 
+static void *mpc_view_alloc(mpc_input_t *i, size_t n) {
+
+  size_t size;
+  char *p;
+  mpc_view_block_t *b;
+
+  n = (n + sizeof(void*) - 1) & ~(sizeof(void*) - 1);
+
+  if ((size_t)(i->view_end - i->view_next) < n) {
+    size = i->view_last ? (size_t)(i->view_end - (char*)(i->view_last + 1)) * 2 : MPC_VIEW_BLOCK_MIN;
+    while (size < n) { size *= 2; }
+    b = malloc(sizeof(mpc_view_block_t) + size);
+    b->next = NULL;
+    if (i->view_last) { i->view_last->next = b; } else { i->view_blocks = b; }
+    i->view_last = b;
+    i->view_next = (char*)(b + 1);
+    i->view_end = i->view_next + size;
+  }
+
+  p = i->view_next;
+  i->view_next += n;
+  return p;
+}
+
+static mpc_span_t *mpc_span_new(mpc_input_t *i, const char *s, size_t len) {
+  mpc_span_t *x = mpc_malloc(i, sizeof(mpc_span_t));
+  x->s = s;
+  x->len = len;
+  return x;
+}
+
 static void mpc_input_backtrack_disable(mpc_input_t *i) { i->backtrack--; }
 static void mpc_input_backtrack_enable(mpc_input_t *i) { i->backtrack++; }
 
@@ -470,7 +696,9 @@ static int mpc_input_success(mpc_input_t *i, char c, char **o) {
     i->state.row++;
   }
 
-  if (o) {
+  if (o && i->view) {
+    (*o) = (char*)mpc_span_new(i, i->string + i->state.pos - 1, 1);
+  } else if (o) {
     (*o) = mpc_malloc(i, 2);
     (*o)[0] = c;
     (*o)[1] = '\0';
@@ -535,6 +763,11 @@ static int mpc_input_string(mpc_input_t *i, const char *c, char **o) {
   }
   mpc_input_unmark(i);
 
+  if (i->view) {
+    *o = (char*)mpc_span_new(i, i->string + i->state.pos - (x - c), x - c);
+    return 1;
+  }
+
   *o = mpc_malloc(i, strlen(c) + 1);
   strcpy(*o, c);
   return 1;
@@ -562,6 +795,75 @@ static int mpc_input_eoi(mpc_input_t* i, char **o) {
   }
 }
 
+/*
+** Runs a regex compiled to a DFA: `t` holds 256 transitions per
+** state, each the next state plus one or zero when there is none, and
+** `acc` marks the accepting states. Consumes the longest match.
+*/
+
+static int mpc_input_dfa(mpc_input_t *i, const unsigned char *t, const char *acc, char **o) {
+
+  long j, n = 0, m = acc[0] ? 0 : -1;
+  size_t slots = 64;
+  int c, s = 0;
+  const unsigned char *x;
+  const char *y;
+  char *b = NULL;
+
+  if (i->type == MPC_INPUT_STRING) {
+
+    x = (const unsigned char*)i->string + i->state.pos;
+    while ((c = x[n]) && t[s * 256 + c]) {
+      s = t[s * 256 + c] - 1;
+      n++;
+      if (acc[s]) { m = n; }
+    }
+
+    if (m < 0) { return 0; }
+    y = (const char*)x;
+    if (!i->view) {
+      b = mpc_malloc(i, m + 1);
+      memcpy(b, x, m);
+    }
+
+  } else {
+
+    /* Read ahead and seek back to the end of the match */
+    b = mpc_malloc(i, slots);
+    while ((c = fgetc(i->file)) != EOF && c && t[s * 256 + c]) {
+      if ((size_t)n + 1 >= slots) {
+        slots *= 2;
+        b = mpc_realloc(i, b, slots);
+      }
+      b[n++] = c;
+      s = t[s * 256 + c] - 1;
+      if (acc[s]) { m = n; }
+    }
+
+    fseek(i->file, i->state.pos + (m > 0 ? m : 0), SEEK_SET);
+    if (m < 0) { mpc_free(i, b); return 0; }
+    y = b;
+  }
+
+  for (j = 0; j < m; j++) {
+    i->state.pos++;
+    i->state.col++;
+    if (y[j] == '\n') {
+      i->state.col = 0;
+      i->state.row++;
+    }
+  }
+  if (m > 0) { i->last = y[m-1]; }
+
+  if (b) {
+    b[m] = '\0';
+    *o = b;
+  } else {
+    *o = (char*)mpc_span_new(i, y, m);
+  }
+  return 1;
+}
+
 static mpc_state_t *mpc_input_state_copy(mpc_input_t *i) {
   mpc_state_t *r = mpc_malloc(i, sizeof(mpc_state_t));
   memcpy(r, &i->state, sizeof(mpc_state_t));
@@ -917,7 +1219,10 @@ enum {
   MPC_TYPE_CHECK_WITH = 26,
 
   MPC_TYPE_SOI        = 27,
-  MPC_TYPE_EOI        = 28
+  MPC_TYPE_EOI        = 28,
+
+  MPC_TYPE_DFA        = 29,
+  MPC_TYPE_MEMO       = 30
 };
 
 typedef struct { char *m; } mpc_pdata_fail_t;
@@ -937,6 +1242,8 @@ typedef struct { mpc_parser_t *x; mpc_dtor_t dx; mpc_ctor_t lf; } mpc_pdata_not_
 typedef struct { int n; mpc_fold_t f; mpc_parser_t *x; mpc_dtor_t dx; } mpc_pdata_repeat_t;
 typedef struct { int n; mpc_parser_t **xs; } mpc_pdata_or_t;
 typedef struct { int n; mpc_fold_t f; mpc_parser_t **xs; mpc_dtor_t *dxs;  } mpc_pdata_and_t;
+typedef struct { mpc_parser_t *x; int n; unsigned char *t; char *acc; } mpc_pdata_dfa_t;
+typedef struct { mpc_parser_t *x; mpc_parser_t *k; int id; mpc_dtor_t dx; } mpc_pdata_memo_t;
 
 typedef union {
   mpc_pdata_fail_t fail;
@@ -956,6 +1263,8 @@ typedef union {
   mpc_pdata_repeat_t repeat;
   mpc_pdata_and_t and;
   mpc_pdata_or_t or;
+  mpc_pdata_dfa_t dfa;
+  mpc_pdata_memo_t memo;
 } mpc_pdata_t;
 
 struct mpc_parser_t {
@@ -965,6 +1274,219 @@ struct mpc_parser_t {
   char retained;
 };
 
+/*
+** Packrat Memo
+**
+** A memo parser remembers its result at each position, so parsers
+** backtracking over it do not run it again. Its output belongs to the
+** parent, which may fold it into its own, so it can only be kept when
+** the parent would destroy it instead. Until then the output is live
+** and the parent's destructor hands it back to the memo.
+**
+** Each position has MPC_MEMO_WAYS slots, one per memo key. The table
+** lasts one parse and grows to MPC_MEMO_MAX slots, after which
+** positions share slots and the older result is dropped.
+*/
+
+enum {
+  MPC_MEMO_WAYS = 16,
+  MPC_MEMO_MAX = 1 << 20,
+  MPC_MEMO_BLOCK = 256
+};
+
+struct mpc_memo_t {
+  mpc_parser_t *k;
+  long pos;
+  size_t slot;
+  char ok;
+  char sup;
+  char live;
+  char last;
+  mpc_state_t end;
+  mpc_val_t *val;
+  mpc_dtor_t dx;
+  mpc_err_t *err;
+  mpc_err_t *errs;
+};
+
+struct mpc_memo_block_t {
+  mpc_memo_block_t *next;
+  int n;
+  mpc_memo_t ms[MPC_MEMO_BLOCK];
+};
+
+struct mpc_live_t {
+  mpc_val_t *v;
+  mpc_memo_t *m;
+};
+
+static size_t mpc_live_hash(mpc_val_t *v) {
+  return ((size_t)v >> 4) * 2654435761u;
+}
+
+static void mpc_parse_dtor(mpc_input_t *i, mpc_dtor_t d, mpc_val_t *x);
+
+static void mpc_memo_release(mpc_input_t *i, mpc_memo_t *m) {
+  if (m->val) { mpc_parse_dtor(i, m->dx, m->val); }
+  mpc_err_delete_internal(i, m->err);
+  mpc_err_delete_internal(i, m->errs);
+  m->val = NULL;
+  m->err = NULL;
+  m->errs = NULL;
+}
+
+/* Entry of the memo `p` at the current position, NULL if its slot is in use or pending */
+static mpc_memo_t *mpc_memo_find(mpc_input_t *i, mpc_parser_t *p) {
+
+  size_t j, slots, slot = (size_t)i->state.pos * MPC_MEMO_WAYS + p->data.memo.id % MPC_MEMO_WAYS;
+  mpc_memo_t *m, **memo;
+  mpc_memo_block_t *b;
+
+  if (slot >= i->memo_slots && i->memo_slots < MPC_MEMO_MAX) {
+    slots = i->memo_slots ? i->memo_slots : 1024;
+    while (slot >= slots && slots < MPC_MEMO_MAX) { slots *= 2; }
+    memo = calloc(slots, sizeof(mpc_memo_t*));
+    for (j = 0; j < i->memo_slots; j++) {
+      if (i->memo[j]) { memo[i->memo[j]->slot & (slots - 1)] = i->memo[j]; }
+    }
+    free(i->memo);
+    i->memo = memo;
+    i->memo_slots = slots;
+  }
+
+  m = i->memo[slot & (i->memo_slots - 1)];
+  if (m && m->k == p->data.memo.k && m->pos == i->state.pos) { return m; }
+  if (m && (m->live || m->ok < 0)) { return NULL; }
+
+  if (m) {
+    mpc_memo_release(i, m);
+  } else {
+    b = i->memo_blocks;
+    if (!b || b->n == MPC_MEMO_BLOCK) {
+      b = malloc(sizeof(mpc_memo_block_t));
+      b->next = i->memo_blocks;
+      b->n = 0;
+      i->memo_blocks = b;
+    }
+    m = &b->ms[b->n++];
+    m->val = NULL;
+    m->err = NULL;
+    m->errs = NULL;
+    i->memo[slot & (i->memo_slots - 1)] = m;
+    i->memo_num++;
+  }
+
+  m->k = p->data.memo.k;
+  m->pos = i->state.pos;
+  m->slot = slot;
+  m->ok = -1;
+  m->live = 0;
+  return m;
+}
+
+static void mpc_live_add(mpc_input_t *i, mpc_val_t *v, mpc_memo_t *m) {
+
+  size_t j, h, slots;
+  mpc_live_t *live;
+
+  if (!v) { return; }
+
+  if (i->live_num * 2 >= i->live_slots) {
+    slots = i->live_slots ? i->live_slots * 2 : 64;
+    live = calloc(slots, sizeof(mpc_live_t));
+    for (j = 0; j < i->live_slots; j++) {
+      if (!i->live[j].v) { continue; }
+      h = mpc_live_hash(i->live[j].v) & (slots - 1);
+      while (live[h].v) { h = (h + 1) & (slots - 1); }
+      live[h] = i->live[j];
+    }
+    free(i->live);
+    i->live = live;
+    i->live_slots = slots;
+  }
+
+  h = mpc_live_hash(v) & (i->live_slots - 1);
+  while (i->live[h].v && i->live[h].v != v) { h = (h + 1) & (i->live_slots - 1); }
+  if (!i->live[h].v) { i->live_num++; }
+  else { i->live[h].m->live = 0; }
+  i->live[h].v = v;
+  i->live[h].m = m;
+  m->live = 1;
+}
+
+/* Stops tracking `v`, returning the entry it came from if it was live */
+static mpc_memo_t *mpc_live_take(mpc_input_t *i, mpc_val_t *v) {
+
+  size_t h, j, k, mask = i->live_slots - 1;
+  mpc_memo_t *m = NULL;
+
+  if (!i->live_num || !v) { return NULL; }
+
+  h = mpc_live_hash(v) & mask;
+  while (i->live[h].v != v) {
+    if (!i->live[h].v) { return NULL; }
+    h = (h + 1) & mask;
+  }
+  m = i->live[h].m;
+
+  /* Move back the entries that probed past the hole */
+  j = h;
+  while (1) {
+    j = (j + 1) & mask;
+    if (!i->live[j].v) { break; }
+    k = mpc_live_hash(i->live[j].v) & mask;
+    if (h < j ? (h < k && k <= j) : (h < k || k <= j)) { continue; }
+    i->live[h] = i->live[j];
+    h = j;
+  }
+  i->live[h].v = NULL;
+  i->live_num--;
+  m->live = 0;
+  return m;
+}
+
+static mpc_err_t *mpc_err_copy(mpc_input_t *i, mpc_err_t *x) {
+  int j;
+  mpc_err_t *y;
+  if (x == NULL) { return NULL; }
+  y = mpc_malloc(i, sizeof(mpc_err_t));
+  memcpy(y, x, sizeof(mpc_err_t));
+  y->filename = mpc_malloc(i, strlen(x->filename) + 1);
+  strcpy(y->filename, x->filename);
+  if (x->failure) {
+    y->failure = mpc_malloc(i, strlen(x->failure) + 1);
+    strcpy(y->failure, x->failure);
+  }
+  y->expected = x->expected_num ? mpc_malloc(i, sizeof(char*) * x->expected_num) : NULL;
+  for (j = 0; j < x->expected_num; j++) {
+    y->expected[j] = mpc_malloc(i, strlen(x->expected[j]) + 1);
+    strcpy(y->expected[j], x->expected[j]);
+  }
+  return y;
+}
+
+static void mpc_memo_clear(mpc_input_t *i) {
+
+  int j;
+  mpc_memo_block_t *b;
+
+  free(i->live);
+  i->live = NULL;
+  i->live_slots = 0;
+  i->live_num = 0;
+
+  while ((b = i->memo_blocks)) {
+    for (j = 0; j < b->n; j++) { mpc_memo_release(i, &b->ms[j]); }
+    i->memo_blocks = b->next;
+    free(b);
+  }
+
+  free(i->memo);
+  i->memo = NULL;
+  i->memo_slots = 0;
+  i->memo_num = 0;
+}
+
 static mpc_val_t *mpcf_input_nth_free(mpc_input_t *i, int n, mpc_val_t **xs, int x) {
   int j;
   for (j = 0; j < n; j++) { if (j != x) { mpc_free(i, xs[j]); } }
@@ -994,8 +1516,150 @@ static mpc_val_t *mpcf_input_state_ast(mpc_input_t *i, int n, mpc_val_t **xs) {
   return a;
 }
 
+/*
+** Parsing a view, the folds and applies that build an AST build view
+** nodes instead, out of the spans the basic parsers return.
+*/
+
+static mpc_view_t *mpc_view_new(mpc_input_t *i, int tag, const char *s, size_t len, int n) {
+  mpc_view_t *v = mpc_view_alloc(i, sizeof(mpc_view_t) + sizeof(mpc_view_t*) * n);
+  v->tag = tag;
+  v->children_num = 0;
+  v->contents = s;
+  v->len = len;
+  v->state = mpc_state_new();
+  v->children = n ? (mpc_view_t**)(v + 1) : NULL;
+  return v;
+}
+
+/* Index of the rule named `t`, -1 if it was not passed to the parse */
+static int mpc_view_rule(mpc_input_t *i, const char *t) {
+  int j;
+  for (j = 0; j < i->rules_num; j++) { if (i->rules[j]->name == t) { return j; } }
+  for (j = 0; j < i->rules_num; j++) {
+    if (i->rules[j]->name && strcmp(i->rules[j]->name, t) == 0) { return j; }
+  }
+  return -1;
+}
+
+static mpc_val_t *mpcf_view_strfold(mpc_input_t *i, int n, mpc_val_t **xs) {
+
+  int j;
+  size_t l = 0;
+  const char *s = NULL;
+  char *b;
+  mpc_span_t **ss = (mpc_span_t**)xs;
+
+  /* Pieces that follow each other in the input stay a span of it */
+  for (j = 0; j < n; j++) {
+    if (!ss[j] || !ss[j]->len) { continue; }
+    if (s && s + l != ss[j]->s) { s = NULL; break; }
+    if (!s) { s = ss[j]->s; }
+    l += ss[j]->len;
+  }
+
+  if (!s && l) {
+    for (j = 0, l = 0; j < n; j++) { l += ss[j] ? ss[j]->len : 0; }
+    b = mpc_view_alloc(i, l);
+    for (j = 0, l = 0; j < n; j++) {
+      if (!ss[j]) { continue; }
+      memcpy(b + l, ss[j]->s, ss[j]->len);
+      l += ss[j]->len;
+    }
+    s = b;
+  }
+
+  for (j = 0; j < n; j++) { if (ss[j]) { mpc_free(i, ss[j]); } }
+  return l ? mpc_span_new(i, s, l) : NULL;
+}
+
+static mpc_val_t *mpcf_view_fold(mpc_input_t *i, int n, mpc_val_t **xs) {
+
+  int j, k, m = 0;
+  mpc_view_t **vs = (mpc_view_t**)xs;
+  mpc_view_t *r, *c;
+
+  if (n == 0) { return NULL; }
+  if (n == 1) { return xs[0]; }
+  if (n == 2 && xs[1] == NULL) { return xs[0]; }
+  if (n == 2 && xs[0] == NULL) { return xs[1]; }
+
+  for (j = 0; j < n; j++) {
+    if (vs[j]) { m += vs[j]->children_num >= 2 ? vs[j]->children_num : 1; }
+  }
+
+  r = mpc_view_new(i, MPC_VIEW_ROOT, "", 0, m);
+
+  for (j = 0; j < n; j++) {
+
+    if (vs[j] == NULL) { continue; }
+
+    if (vs[j]->children_num == 0) {
+      r->children[r->children_num++] = vs[j];
+    } else if (vs[j]->children_num == 1) {
+      c = vs[j]->children[0];
+      if (c->tag < 0 && vs[j]->tag >= 0) { c->tag = vs[j]->tag; }
+      r->children[r->children_num++] = c;
+    } else {
+      for (k = 0; k < vs[j]->children_num; k++) {
+        r->children[r->children_num++] = vs[j]->children[k];
+      }
+    }
+
+  }
+
+  if (r->children_num) {
+    r->state = r->children[0]->state;
+  }
+
+  return r;
+}
+
+static mpc_val_t *mpcf_view_state(mpc_input_t *i, int n, mpc_val_t **xs) {
+  mpc_state_t *s = ((mpc_state_t**)xs)[0];
+  mpc_view_t *v = ((mpc_view_t**)xs)[1];
+  if (v) { v->state = *s; }
+  mpc_free(i, s);
+  (void) n;
+  return v;
+}
+
+static mpc_val_t *mpcf_view_str(mpc_input_t *i, mpc_val_t *x) {
+  mpc_span_t *s = x;
+  mpc_view_t *v = mpc_view_new(i, MPC_VIEW_TOKEN, s ? s->s : "", s ? s->len : 0, 0);
+  if (s) { mpc_free(i, s); }
+  return v;
+}
+
+static mpc_val_t *mpc_view_add_root(mpc_input_t *i, mpc_view_t *v) {
+  mpc_view_t *r;
+  if (v == NULL || v->children_num < 2) { return v; }
+  r = mpc_view_new(i, MPC_VIEW_ROOT, "", 0, 1);
+  r->children[r->children_num++] = v;
+  return r;
+}
+
+/* Literals are tokens, whatever they were tagged */
+static mpc_val_t *mpc_view_tag(mpc_view_t *v) {
+  if (v) { v->tag = MPC_VIEW_TOKEN; }
+  return v;
+}
+
+/* The innermost rule names a node, rules outside it leave it be */
+static mpc_val_t *mpc_view_add_tag(mpc_input_t *i, mpc_view_t *v, const char *t) {
+  int k;
+  if (v == NULL || v->tag >= 0) { return v; }
+  k = mpc_view_rule(i, t);
+  if (k >= 0) { v->tag = k; }
+  return v;
+}
+
 static mpc_val_t *mpc_parse_fold(mpc_input_t *i, mpc_fold_t f, int n, mpc_val_t **xs) {
   int j;
+  for (j = 0; j < n && i->live_num; j++) { mpc_live_take(i, xs[j]); }
+  if (i->view && f == mpcf_fold_ast)  { return mpcf_view_fold(i, n, xs); }
+  if (i->view && f == mpcf_strfold)   { return mpcf_view_strfold(i, n, xs); }
+  if (i->view && f == mpcf_state_ast) { return mpcf_view_state(i, n, xs); }
   if (f == mpcf_null)      { return mpcf_null(n, xs); }
   if (f == mpcf_fst)       { return mpcf_fst(n, xs); }
   if (f == mpcf_snd)       { return mpcf_snd(n, xs); }
@@ -1021,297 +1685,490 @@ static mpc_val_t *mpcf_input_str_ast(mpc_input_t *i, mpc_val_t *c) {
 }
 
 static mpc_val_t *mpc_parse_apply(mpc_input_t *i, mpc_apply_t f, mpc_val_t *x) {
+  mpc_live_take(i, x);
   if (f == mpcf_free)     { return mpcf_input_free(i, x); }
+  if (i->view && f == mpcf_str_ast) { return mpcf_view_str(i, x); }
+  if (i->view && f == (mpc_apply_t)mpc_ast_add_root) { return mpc_view_add_root(i, x); }
   if (f == mpcf_str_ast)  { return mpcf_input_str_ast(i, x); }
   return f(mpc_export(i, x));
 }
 
 static mpc_val_t *mpc_parse_apply_to(mpc_input_t *i, mpc_apply_to_t f, mpc_val_t *x, mpc_val_t *d) {
+  mpc_live_take(i, x);
+  if (i->view && f == (mpc_apply_to_t)mpc_ast_add_tag) { return mpc_view_add_tag(i, x, d); }
+  if (i->view && f == (mpc_apply_to_t)mpc_ast_tag)     { return mpc_view_tag(x); }
   return f(mpc_export(i, x), d);
 }
 
 static void mpc_parse_dtor(mpc_input_t *i, mpc_dtor_t d, mpc_val_t *x) {
+  mpc_memo_t *m = mpc_live_take(i, x);
+  if (m) { m->val = x; return; }
   if (d == free) { mpc_free(i, x); return; }
+  if (i->view && d == (mpc_dtor_t)mpc_ast_delete) { return; }
   d(mpc_export(i, x));
 }
 
+static mpc_val_t *mpc_parse_lift(mpc_input_t *i, mpc_ctor_t lf) {
+  if (i->view && lf == mpcf_ctor_str) { return NULL; }
+  return lf();
+}
+
+/*
+** The parser keeps its own stacks rather than recursing in C, so the
+** nesting of the input is only limited by memory. A combinator waiting
+** on a child has a frame, and the results of its children so far are
+** on the results stack until it folds them.
+**
+** Frames only start further into the input than the frames below them.
+** A run of frames at the same position that enters the same parser
+** twice is left recursion, which would never return, so the runs are
+** checked as they double in length.
+*/
+
 enum {
-  MPC_PARSE_STACK_MIN = 4
+  MPC_PARSE_STACK_MIN = 64,
+  MPC_PARSE_RUN_MIN = 64
 };
 
-#define MPC_SUCCESS(x) r->output = x; return 1
-#define MPC_FAILURE(x) r->error = x; return 0
-#define MPC_PRIMITIVE(x) \
-  if (x) { MPC_SUCCESS(r->output); } \
-  else { MPC_FAILURE(NULL); }
+typedef struct {
+  mpc_parser_t *p;
+  int j;
+  int run;
+  long pos;
+  size_t base;
+  mpc_memo_t *m;
+  mpc_err_t *es;
+} mpc_frame_t;
 
-#define MPC_MAX_RECURSION_DEPTH 1000
+typedef struct {
+  mpc_frame_t *frames;
+  int frames_num;
+  int frames_slots;
+  mpc_result_t *results;
+  size_t results_num;
+  size_t results_slots;
+} mpc_stack_t;
 
-static int mpc_parse_run(mpc_input_t *i, mpc_parser_t *p, mpc_result_t *r, mpc_err_t **e, int depth) {
+static void mpc_stack_init(mpc_stack_t *s) {
+  s->frames_num = 0;
+  s->frames_slots = MPC_PARSE_STACK_MIN;
+  s->frames = malloc(sizeof(mpc_frame_t) * s->frames_slots);
+  s->results_num = 0;
+  s->results_slots = MPC_PARSE_STACK_MIN;
+  s->results = malloc(sizeof(mpc_result_t) * s->results_slots);
+}
 
-  int j = 0, k = 0;
-  mpc_result_t results_stk[MPC_PARSE_STACK_MIN];
-  mpc_result_t *results;
-  int results_slots = MPC_PARSE_STACK_MIN;
+static void mpc_stack_free(mpc_stack_t *s) {
+  free(s->frames);
+  free(s->results);
+}
 
-  if (depth == MPC_MAX_RECURSION_DEPTH)
-  {
-    MPC_FAILURE(mpc_err_fail(i, "Maximum recursion depth exceeded!"));
+/* Whether the run of frames below `f` at its position entered its parser already */
+static int mpc_stack_loops(mpc_frame_t *f) {
+  int j;
+  for (j = 1; j <= f->run; j++) {
+    if (f[-j].p == f->p) { return 1; }
   }
+  return 0;
+}
 
-  switch (p->type) {
+/* Frame for `p` at the current position, NULL if `p` is left recursive */
+static mpc_frame_t *mpc_stack_push(mpc_input_t *i, mpc_stack_t *s, mpc_parser_t *p) {
 
-    /* Basic Parsers */
-
-    case MPC_TYPE_ANY:     MPC_PRIMITIVE(mpc_input_any(i, (char**)&r->output));
-    case MPC_TYPE_SINGLE:  MPC_PRIMITIVE(mpc_input_char(i, p->data.single.x, (char**)&r->output));
-    case MPC_TYPE_RANGE:   MPC_PRIMITIVE(mpc_input_range(i, p->data.range.x, p->data.range.y, (char**)&r->output));
-    case MPC_TYPE_ONEOF:   MPC_PRIMITIVE(mpc_input_oneof(i, p->data.string.x, (char**)&r->output));
-    case MPC_TYPE_NONEOF:  MPC_PRIMITIVE(mpc_input_noneof(i, p->data.string.x, (char**)&r->output));
-    case MPC_TYPE_SATISFY: MPC_PRIMITIVE(mpc_input_satisfy(i, p->data.satisfy.f, (char**)&r->output));
-    case MPC_TYPE_STRING:  MPC_PRIMITIVE(mpc_input_string(i, p->data.string.x, (char**)&r->output));
-    case MPC_TYPE_ANCHOR:  MPC_PRIMITIVE(mpc_input_anchor(i, p->data.anchor.f, (char**)&r->output));
-    case MPC_TYPE_SOI:     MPC_PRIMITIVE(mpc_input_soi(i, (char**)&r->output));
-    case MPC_TYPE_EOI:     MPC_PRIMITIVE(mpc_input_eoi(i, (char**)&r->output));
-
-    /* Other parsers */
-
-    case MPC_TYPE_UNDEFINED: MPC_FAILURE(mpc_err_fail(i, "Parser Undefined!"));
-    case MPC_TYPE_PASS:      MPC_SUCCESS(NULL);
-    case MPC_TYPE_FAIL:      MPC_FAILURE(mpc_err_fail(i, p->data.fail.m));
-    case MPC_TYPE_LIFT:      MPC_SUCCESS(p->data.lift.lf());
-    case MPC_TYPE_LIFT_VAL:  MPC_SUCCESS(p->data.lift.x);
-    case MPC_TYPE_STATE:     MPC_SUCCESS(mpc_input_state_copy(i));
-
-    /* Application Parsers */
-
-    case MPC_TYPE_APPLY:
-      if (mpc_parse_run(i, p->data.apply.x, r, e, depth+1)) {
-        MPC_SUCCESS(mpc_parse_apply(i, p->data.apply.f, r->output));
-      } else {
-        MPC_FAILURE(r->output);
-      }
+  mpc_frame_t *f;
 
-    case MPC_TYPE_APPLY_TO:
-      if (mpc_parse_run(i, p->data.apply_to.x, r, e, depth+1)) {
-        MPC_SUCCESS(mpc_parse_apply_to(i, p->data.apply_to.f, r->output, p->data.apply_to.d));
-      } else {
-        MPC_FAILURE(r->error);
-      }
+  if (s->frames_num == s->frames_slots) {
+    s->frames_slots += s->frames_slots / 2;
+    s->frames = realloc(s->frames, sizeof(mpc_frame_t) * s->frames_slots);
+  }
 
-    case MPC_TYPE_CHECK:
-      if (mpc_parse_run(i, p->data.check.x, r, e, depth+1)) {
-        if (p->data.check.f(&r->output)) {
-          MPC_SUCCESS(r->output);
-        } else {
-          mpc_parse_dtor(i, p->data.check.dx, r->output);
-          MPC_FAILURE(mpc_err_fail(i, p->data.check.e));
-        }
-      } else {
-        MPC_FAILURE(r->error);
-      }
+  f = &s->frames[s->frames_num];
+  f->p = p;
+  f->j = 0;
+  f->pos = i->state.pos;
+  f->run = 0;
+  f->base = s->results_num;
+
+  if (s->frames_num > 0 && f[-1].pos == f->pos) {
+    f->run = f[-1].run + 1;
+    if (f->run >= MPC_PARSE_RUN_MIN && !(f->run & (f->run - 1)) && mpc_stack_loops(f)) {
+      return NULL;
+    }
+  }
 
-    case MPC_TYPE_CHECK_WITH:
-      if (mpc_parse_run(i, p->data.check_with.x, r, e, depth+1)) {
-        if (p->data.check_with.f(&r->output, p->data.check_with.d)) {
-          MPC_SUCCESS(r->output);
-        } else {
-          mpc_parse_dtor(i, p->data.check.dx, r->output);
-          MPC_FAILURE(mpc_err_fail(i, p->data.check_with.e));
-        }
-      } else {
-        MPC_FAILURE(r->error);
-      }
+  s->frames_num++;
+  return f;
+}
+
+static void mpc_stack_grow(mpc_stack_t *s) {
+  s->results_slots += s->results_slots / 2;
+  s->results = realloc(s->results, sizeof(mpc_result_t) * s->results_slots);
+}
+
+/* Replays the result kept in `m`, -1 if the parser has to run instead */
+static int mpc_memo_recall(mpc_input_t *i, mpc_memo_t *m, mpc_result_t *r, mpc_err_t **e) {
+
+  /* Errors of a parse that suppressed them are missing */
+  if (!m || m->ok < 0 || (m->sup && !i->suppress) || (m->ok && !m->val)) { return -1; }
+
+  if (m->errs) { *e = mpc_err_merge(i, *e, mpc_err_copy(i, m->errs)); }
+  i->state = m->end;
+  i->last = m->last;
+  if (i->type == MPC_INPUT_FILE) { fseek(i->file, i->state.pos, SEEK_SET); }
+
+  if (m->ok) {
+    r->output = m->val;
+    m->val = NULL;
+    mpc_live_add(i, r->output, m);
+    return 1;
+  }
+
+  r->error = mpc_err_copy(i, m->err);
+  return 0;
+}
+
+/* Keeps the result `x`, `r` of the parser, and the errors `es` merged on the way */
+static void mpc_memo_keep(mpc_input_t *i, mpc_memo_t *m, mpc_dtor_t dx, int x, mpc_result_t *r, mpc_err_t *es) {
+  mpc_memo_release(i, m);
+  m->ok = x;
+  m->sup = i->suppress > 0;
+  m->end = i->state;
+  m->last = i->last;
+  m->dx = dx;
+  m->err = x ? NULL : mpc_err_copy(i, r->error);
+  m->errs = mpc_err_copy(i, es);
+  if (x) { mpc_live_add(i, r->output, m); }
+}
+
+/* Starts the combinator `p` on a new frame, returning its first child */
+static mpc_parser_t *mpc_parse_enter(mpc_input_t *i, mpc_parser_t *p) {
+
+  switch (p->type) {
+
+    case MPC_TYPE_MEMO:       return p->data.memo.x;
+    case MPC_TYPE_APPLY:      return p->data.apply.x;
+    case MPC_TYPE_APPLY_TO:   return p->data.apply_to.x;
+    case MPC_TYPE_CHECK:      return p->data.check.x;
+    case MPC_TYPE_CHECK_WITH: return p->data.check_with.x;
 
     case MPC_TYPE_EXPECT:
       mpc_input_suppress_enable(i);
-      if (mpc_parse_run(i, p->data.expect.x, r, e, depth+1)) {
-        mpc_input_suppress_disable(i);
-        MPC_SUCCESS(r->output);
-      } else {
-        mpc_input_suppress_disable(i);
-        MPC_FAILURE(mpc_err_new(i, p->data.expect.m));
-      }
+      return p->data.expect.x;
 
     case MPC_TYPE_PREDICT:
       mpc_input_backtrack_disable(i);
-      if (mpc_parse_run(i, p->data.predict.x, r, e, depth+1)) {
-        mpc_input_backtrack_enable(i);
-        MPC_SUCCESS(r->output);
-      } else {
-        mpc_input_backtrack_enable(i);
-        MPC_FAILURE(r->error);
-      }
-
-    /* Optional Parsers */
-
-    /* TODO: Update Not Error Message */
+      return p->data.predict.x;
 
     case MPC_TYPE_NOT:
       mpc_input_mark(i);
       mpc_input_suppress_enable(i);
-      if (mpc_parse_run(i, p->data.not.x, r, e, depth+1)) {
-        mpc_input_rewind(i);
-        mpc_input_suppress_disable(i);
-        mpc_parse_dtor(i, p->data.not.dx, r->output);
-        MPC_FAILURE(mpc_err_new(i, "opposite"));
-      } else {
-        mpc_input_unmark(i);
-        mpc_input_suppress_disable(i);
-        MPC_SUCCESS(p->data.not.lf());
-      }
-
-    case MPC_TYPE_MAYBE:
-      if (mpc_parse_run(i, p->data.not.x, r, e, depth+1)) {
-        MPC_SUCCESS(r->output);
-      } else {
-        *e = mpc_err_merge(i, *e, r->error);
-        MPC_SUCCESS(p->data.not.lf());
-      }
+      return p->data.not.x;
 
-    /* Repeat Parsers */
+    case MPC_TYPE_MAYBE: return p->data.not.x;
 
     case MPC_TYPE_MANY:
+    case MPC_TYPE_MANY1:
+    case MPC_TYPE_COUNT:
+      return p->data.repeat.x;
 
-      results = results_stk;
-
-      while (mpc_parse_run(i, p->data.repeat.x, &results[j], e, depth+1)) {
-        j++;
-        if (j == MPC_PARSE_STACK_MIN) {
-          results_slots = j + j / 2;
-          results = mpc_malloc(i, sizeof(mpc_result_t) * results_slots);
-          memcpy(results, results_stk, sizeof(mpc_result_t) * MPC_PARSE_STACK_MIN);
-        } else if (j >= results_slots) {
-          results_slots = j + j / 2;
-          results = mpc_realloc(i, results, sizeof(mpc_result_t) * results_slots);
-        }
-      }
+    case MPC_TYPE_OR: return p->data.or.xs[0];
 
-      *e = mpc_err_merge(i, *e, results[j].error);
+    case MPC_TYPE_AND:
+      mpc_input_mark(i);
+      return p->data.and.xs[0];
 
-      MPC_SUCCESS(
-        mpc_parse_fold(i, p->data.repeat.f, j, (mpc_val_t**)results);
-        if (j >= MPC_PARSE_STACK_MIN) { mpc_free(i, results); });
+    default: return NULL;
+  }
+}
 
-    case MPC_TYPE_MANY1:
+#define MPC_SUCCESS(v) r.output = v; x = 1; break
+#define MPC_FAILURE(v) r.error = v; x = 0; break
+#define MPC_PRIMITIVE(v) \
+  if (v) { x = 1; } \
+  else { MPC_FAILURE(NULL); } \
+  break
+#define MPC_CALL(c) p = c; continue
 
-      results = results_stk;
-
-      while (mpc_parse_run(i, p->data.repeat.x, &results[j], e, depth+1)) {
-        j++;
-        if (j == MPC_PARSE_STACK_MIN) {
-          results_slots = j + j / 2;
-          results = mpc_malloc(i, sizeof(mpc_result_t) * results_slots);
-          memcpy(results, results_stk, sizeof(mpc_result_t) * MPC_PARSE_STACK_MIN);
-        } else if (j >= results_slots) {
-          results_slots = j + j / 2;
-          results = mpc_realloc(i, results, sizeof(mpc_result_t) * results_slots);
-        }
+static int mpc_parse_run(mpc_input_t *i, mpc_parser_t *p, mpc_result_t *out, mpc_err_t **e) {
+
+  int x = 0, k;
+  mpc_result_t r;
+  mpc_err_t *es = *e, *ms;
+  mpc_frame_t *f;
+  mpc_memo_t *m = NULL;
+  mpc_stack_t s;
+
+  mpc_stack_init(&s);
+
+  for (;;) {
+
+    /* Run `p`, or push its frame and enter its first child */
+
+    if (p) {
+
+      switch (p->type) {
+
+        /* Basic Parsers */
+
+        case MPC_TYPE_ANY:     MPC_PRIMITIVE(mpc_input_any(i, (char**)&r.output));
+        case MPC_TYPE_SINGLE:  MPC_PRIMITIVE(mpc_input_char(i, p->data.single.x, (char**)&r.output));
+        case MPC_TYPE_RANGE:   MPC_PRIMITIVE(mpc_input_range(i, p->data.range.x, p->data.range.y, (char**)&r.output));
+        case MPC_TYPE_ONEOF:   MPC_PRIMITIVE(mpc_input_oneof(i, p->data.string.x, (char**)&r.output));
+        case MPC_TYPE_NONEOF:  MPC_PRIMITIVE(mpc_input_noneof(i, p->data.string.x, (char**)&r.output));
+        case MPC_TYPE_SATISFY: MPC_PRIMITIVE(mpc_input_satisfy(i, p->data.satisfy.f, (char**)&r.output));
+        case MPC_TYPE_STRING:  MPC_PRIMITIVE(mpc_input_string(i, p->data.string.x, (char**)&r.output));
+        case MPC_TYPE_ANCHOR:  MPC_PRIMITIVE(mpc_input_anchor(i, p->data.anchor.f, (char**)&r.output));
+        case MPC_TYPE_SOI:     MPC_PRIMITIVE(mpc_input_soi(i, (char**)&r.output));
+        case MPC_TYPE_EOI:     MPC_PRIMITIVE(mpc_input_eoi(i, (char**)&r.output));
+
+        /* Compiled Regex, the combinators it came from produce the errors */
+
+        case MPC_TYPE_DFA:
+          if (!i->fast || i->backtrack < 1) { MPC_CALL(p->data.dfa.x); }
+          MPC_PRIMITIVE(mpc_input_dfa(i, p->data.dfa.t, p->data.dfa.acc, (char**)&r.output));
+
+        case MPC_TYPE_MEMO:
+          if (i->type == MPC_INPUT_PIPE || i->backtrack < 1) { MPC_CALL(p->data.memo.x); }
+          m = mpc_memo_find(i, p);
+          x = mpc_memo_recall(i, m, &r, &es);
+          break;
+
+        /* Other parsers */
+
+        case MPC_TYPE_UNDEFINED: MPC_FAILURE(mpc_err_fail(i, "Parser Undefined!"));
+        case MPC_TYPE_PASS:      MPC_SUCCESS(NULL);
+        case MPC_TYPE_FAIL:      MPC_FAILURE(mpc_err_fail(i, p->data.fail.m));
+        case MPC_TYPE_LIFT:      MPC_SUCCESS(mpc_parse_lift(i, p->data.lift.lf));
+        case MPC_TYPE_LIFT_VAL:  MPC_SUCCESS(p->data.lift.x);
+        case MPC_TYPE_STATE:     MPC_SUCCESS(mpc_input_state_copy(i));
+
+        case MPC_TYPE_OR:
+          if (p->data.or.n == 0) { MPC_SUCCESS(NULL); }
+          x = -1;
+          break;
+
+        case MPC_TYPE_AND:
+          if (p->data.and.n == 0) { MPC_SUCCESS(NULL); }
+          x = -1;
+          break;
+
+        case MPC_TYPE_APPLY:
+        case MPC_TYPE_APPLY_TO:
+        case MPC_TYPE_CHECK:
+        case MPC_TYPE_CHECK_WITH:
+        case MPC_TYPE_EXPECT:
+        case MPC_TYPE_PREDICT:
+        case MPC_TYPE_NOT:
+        case MPC_TYPE_MAYBE:
+        case MPC_TYPE_MANY:
+        case MPC_TYPE_MANY1:
+        case MPC_TYPE_COUNT:
+          x = -1;
+          break;
+
+        default: MPC_FAILURE(mpc_err_fail(i, "Unknown Parser Type Id!"));
       }
 
-      if (j == 0) {
-        MPC_FAILURE(
-          mpc_err_many1(i, results[j].error);
-          if (j >= MPC_PARSE_STACK_MIN) { mpc_free(i, results); });
-      } else {
+      /* Combinators wait on their children in a frame */
+      if (x < 0) {
+        f = mpc_stack_push(i, &s, p);
+        if (f) {
+          if (p->type == MPC_TYPE_MEMO) {
+            f->m = m;
+            f->es = es;
+            es = NULL;
+          }
+          MPC_CALL(mpc_parse_enter(i, p));
+        }
+        x = 0;
+        r.error = mpc_err_fail(i, "Left recursion!");
+      }
 
-        *e = mpc_err_merge(i, *e, results[j].error);
+      p = NULL;
+    }
 
-        MPC_SUCCESS(
-          mpc_parse_fold(i, p->data.repeat.f, j, (mpc_val_t**)results);
-          if (j >= MPC_PARSE_STACK_MIN) { mpc_free(i, results); });
-      }
+    if (s.frames_num == 0) { break; }
 
-    case MPC_TYPE_COUNT:
+    /* Return the result `x`, `r` to the top frame, which enters its next child or pops */
 
-      results = p->data.repeat.n > MPC_PARSE_STACK_MIN
-        ? mpc_malloc(i, sizeof(mpc_result_t) * p->data.repeat.n)
-        : results_stk;
+    f = &s.frames[s.frames_num - 1];
 
-      while (mpc_parse_run(i, p->data.repeat.x, &results[j], e, depth+1)) {
-        j++;
-        if (j == p->data.repeat.n) { break; }
-      }
+    switch (f->p->type) {
 
-      if (j == p->data.repeat.n) {
-        MPC_SUCCESS(
-          mpc_parse_fold(i, p->data.repeat.f, j, (mpc_val_t**)results);
-          if (p->data.repeat.n > MPC_PARSE_STACK_MIN) { mpc_free(i, results); });
-      } else {
-        for (k = 0; k < j; k++) {
-          mpc_parse_dtor(i, p->data.repeat.dx, results[k].output);
-        }
-        MPC_FAILURE(
-          mpc_err_count(i, results[j].error, p->data.repeat.n);
-          if (p->data.repeat.n > MPC_PARSE_STACK_MIN) { mpc_free(i, results); });
-      }
+      case MPC_TYPE_MEMO:
+        ms = es;
+        es = f->es;
+        if (f->m) { mpc_memo_keep(i, f->m, f->p->data.memo.dx, x, &r, ms); }
+        if (ms) { es = mpc_err_merge(i, es, ms); }
+        break;
 
-    /* Combinatory Parsers */
+      /* Application Parsers */
 
-    case MPC_TYPE_OR:
+      case MPC_TYPE_APPLY:
+        if (x) { r.output = mpc_parse_apply(i, f->p->data.apply.f, r.output); }
+        break;
 
-      if (p->data.or.n == 0) { MPC_SUCCESS(NULL); }
+      case MPC_TYPE_APPLY_TO:
+        if (x) { r.output = mpc_parse_apply_to(i, f->p->data.apply_to.f, r.output, f->p->data.apply_to.d); }
+        break;
 
-      results = p->data.or.n > MPC_PARSE_STACK_MIN
-        ? mpc_malloc(i, sizeof(mpc_result_t) * p->data.or.n)
-        : results_stk;
+      case MPC_TYPE_CHECK:
+        if (x) {
+          mpc_live_take(i, r.output);
+          if (!f->p->data.check.f(&r.output)) {
+            mpc_parse_dtor(i, f->p->data.check.dx, r.output);
+            MPC_FAILURE(mpc_err_fail(i, f->p->data.check.e));
+          }
+        }
+        break;
 
-      for (j = 0; j < p->data.or.n; j++) {
-        if (mpc_parse_run(i, p->data.or.xs[j], &results[j], e, depth+1)) {
-          MPC_SUCCESS(results[j].output;
-            if (p->data.or.n > MPC_PARSE_STACK_MIN) { mpc_free(i, results); });
-        } else {
-          *e = mpc_err_merge(i, *e, results[j].error);
+      case MPC_TYPE_CHECK_WITH:
+        if (x) {
+          mpc_live_take(i, r.output);
+          if (!f->p->data.check_with.f(&r.output, f->p->data.check_with.d)) {
+            mpc_parse_dtor(i, f->p->data.check_with.dx, r.output);
+            MPC_FAILURE(mpc_err_fail(i, f->p->data.check_with.e));
+          }
         }
-      }
+        break;
 
-      MPC_FAILURE(NULL;
-        if (p->data.or.n > MPC_PARSE_STACK_MIN) { mpc_free(i, results); });
+      case MPC_TYPE_EXPECT:
+        mpc_input_suppress_disable(i);
+        if (!x) { r.error = mpc_err_new(i, f->p->data.expect.m); }
+        break;
 
-    case MPC_TYPE_AND:
+      case MPC_TYPE_PREDICT:
+        mpc_input_backtrack_enable(i);
+        break;
 
-      if (p->data.and.n == 0) { MPC_SUCCESS(NULL); }
+      /* Optional Parsers */
 
-      results = p->data.or.n > MPC_PARSE_STACK_MIN
-        ? mpc_malloc(i, sizeof(mpc_result_t) * p->data.or.n)
-        : results_stk;
+      /* TODO: Update Not Error Message */
 
-      mpc_input_mark(i);
-      for (j = 0; j < p->data.and.n; j++) {
-        if (!mpc_parse_run(i, p->data.and.xs[j], &results[j], e, depth+1)) {
+      case MPC_TYPE_NOT:
+        if (x) {
           mpc_input_rewind(i);
-          for (k = 0; k < j; k++) {
-            mpc_parse_dtor(i, p->data.and.dxs[k], results[k].output);
-          }
-          MPC_FAILURE(results[j].error;
-            if (p->data.or.n > MPC_PARSE_STACK_MIN) { mpc_free(i, results); });
+          mpc_input_suppress_disable(i);
+          mpc_parse_dtor(i, f->p->data.not.dx, r.output);
+          MPC_FAILURE(mpc_err_new(i, "opposite"));
         }
-      }
-      mpc_input_unmark(i);
-      MPC_SUCCESS(
-        mpc_parse_fold(i, p->data.and.f, j, (mpc_val_t**)results);
-        if (p->data.or.n > MPC_PARSE_STACK_MIN) { mpc_free(i, results); });
+        mpc_input_unmark(i);
+        mpc_input_suppress_disable(i);
+        MPC_SUCCESS(mpc_parse_lift(i, f->p->data.not.lf));
 
-    /* End */
+      case MPC_TYPE_MAYBE:
+        if (!x) {
+          es = mpc_err_merge(i, es, r.error);
+          MPC_SUCCESS(mpc_parse_lift(i, f->p->data.not.lf));
+        }
+        break;
 
-    default:
+      /* Repeat Parsers */
 
-      MPC_FAILURE(mpc_err_fail(i, "Unknown Parser Type Id!"));
-  }
+      case MPC_TYPE_MANY:
+      case MPC_TYPE_MANY1:
+        if (x) {
+          if (s.results_num == s.results_slots) { mpc_stack_grow(&s); }
+          s.results[s.results_num++] = r;
+          f->j++;
+          MPC_CALL(f->p->data.repeat.x);
+        }
+        if (f->p->type == MPC_TYPE_MANY1 && f->j == 0) {
+          MPC_FAILURE(mpc_err_many1(i, r.error));
+        }
+        es = mpc_err_merge(i, es, r.error);
+        MPC_SUCCESS(mpc_parse_fold(i, f->p->data.repeat.f, f->j, (mpc_val_t**)&s.results[f->base]));
+
+      case MPC_TYPE_COUNT:
+        if (x) {
+          if (s.results_num == s.results_slots) { mpc_stack_grow(&s); }
+          s.results[s.results_num++] = r;
+          f->j++;
+          if (f->j != f->p->data.repeat.n) { MPC_CALL(f->p->data.repeat.x); }
+          MPC_SUCCESS(mpc_parse_fold(i, f->p->data.repeat.f, f->j, (mpc_val_t**)&s.results[f->base]));
+        }
+        for (k = 0; k < f->j; k++) {
+          mpc_parse_dtor(i, f->p->data.repeat.dx, s.results[f->base + k].output);
+        }
+        MPC_FAILURE(mpc_err_count(i, r.error, f->p->data.repeat.n));
+
+      /* Combinatory Parsers */
+
+      case MPC_TYPE_OR:
+        if (x) { break; }
+        es = mpc_err_merge(i, es, r.error);
+        f->j++;
+        if (f->j < f->p->data.or.n) { MPC_CALL(f->p->data.or.xs[f->j]); }
+        MPC_FAILURE(NULL);
+
+      case MPC_TYPE_AND:
+        if (x) {
+          if (s.results_num == s.results_slots) { mpc_stack_grow(&s); }
+          s.results[s.results_num++] = r;
+          f->j++;
+          if (f->j < f->p->data.and.n) { MPC_CALL(f->p->data.and.xs[f->j]); }
+          mpc_input_unmark(i);
+          MPC_SUCCESS(mpc_parse_fold(i, f->p->data.and.f, f->j, (mpc_val_t**)&s.results[f->base]));
+        }
+        mpc_input_rewind(i);
+        for (k = 0; k < f->j; k++) {
+          mpc_parse_dtor(i, f->p->data.and.dxs[k], s.results[f->base + k].output);
+        }
+        break;
 
-  return 0;
+      default: break;
+    }
+
+    s.results_num = f->base;
+    s.frames_num--;
+  }
 
+  mpc_stack_free(&s);
+  *e = es;
+  *out = r;
+  return x;
 }
 
 #undef MPC_SUCCESS
 #undef MPC_FAILURE
 #undef MPC_PRIMITIVE
+#undef MPC_CALL
 
 int mpc_parse_input(mpc_input_t *i, mpc_parser_t *p, mpc_result_t *r) {
   int x;
-  mpc_err_t *e = mpc_err_fail(i, "Unknown Error");
+  mpc_state_t s = i->state;
+  char last = i->last;
+  mpc_err_t *e = NULL;
+
+  /*
+  ** Errors only matter when the parse fails, so an input that can be
+  ** read again is first parsed without them, using compiled regexes,
+  ** and parsed again to explain a failure.
+  */
+  if (i->fast) {
+    mpc_input_suppress_enable(i);
+    x = mpc_parse_run(i, p, r, &e);
+    mpc_input_suppress_disable(i);
+    if (x) {
+      mpc_live_take(i, r->output);
+      mpc_memo_clear(i);
+      r->output = mpc_export(i, r->output);
+      return x;
+    }
+    mpc_err_delete_internal(i, e);
+    mpc_err_delete_internal(i, r->error);
+    mpc_memo_clear(i);
+    i->state = s;
+    i->last = last;
+    if (i->type == MPC_INPUT_FILE) { fseek(i->file, s.pos, SEEK_SET); }
+    i->fast = 0;
+  }
+
+  e = mpc_err_fail(i, "Unknown Error");
   e->state = mpc_state_invalid();
-  x = mpc_parse_run(i, p, r, &e, 0);
+  x = mpc_parse_run(i, p, r, &e);
+  if (x) { mpc_live_take(i, r->output); }
+  mpc_memo_clear(i);
   if (x) {
     mpc_err_delete_internal(i, e);
     r->output = mpc_export(i, r->output);
@@ -1369,6 +2226,85 @@ int mpc_parse_contents(const char *filename, mpc_parser_t *p, mpc_result_t *r) {
   return res;
 }
 
+static int mpc_parse_view_input(mpc_input_t *i, mpc_parser_t *p, mpc_result_t *r, int n, va_list va) {
+
+  int j, x;
+  mpc_view_block_t *b;
+
+  i->view = 1;
+  i->rules_num = n;
+  i->rules = malloc(sizeof(mpc_parser_t*) * (n ? n : 1));
+  for (j = 0; j < n; j++) { i->rules[j] = va_arg(va, mpc_parser_t*); }
+
+  x = mpc_parse_input(i, p, r);
+
+  /* The view takes the blocks over from the input */
+  if (x && r->output && i->view_blocks) {
+    b = i->view_blocks;
+    b->root = *(mpc_view_t*)r->output;
+    r->output = &b->root;
+    i->view_blocks = NULL;
+  }
+
+  return x;
+}
+
+int mpc_parse_view(const char *filename, const char *string, mpc_parser_t *p, mpc_result_t *r, int n, ...) {
+  int x;
+  va_list va;
+  mpc_input_t *i = mpc_input_new_string(filename, string);
+  va_start(va, n);
+  x = mpc_parse_view_input(i, p, r, n, va);
+  va_end(va);
+  mpc_input_delete(i);
+  return x;
+}
+
+int mpc_parse_view_contents(const char *filename, mpc_parser_t *p, mpc_result_t *r, int n, ...) {
+
+  FILE *f = fopen(filename, "rb");
+  long len;
+  char *text;
+  int x;
+  va_list va;
+  mpc_input_t *i;
+
+  if (f == NULL) {
+    r->output = NULL;
+    r->error = mpc_err_file(filename, "Unable to open file!");
+    return 0;
+  }
+
+  fseek(f, 0, SEEK_END);
+  len = ftell(f);
+  if (len < 0) {
+    fclose(f);
+    r->output = NULL;
+    r->error = mpc_err_file(filename, "Unable to read file!");
+    return 0;
+  }
+
+  /* The text is read once, into the first block of the view */
+  i = mpc_input_new_string(filename, "");
+  text = mpc_view_alloc(i, len + 1);
+  rewind(f);
+  len = (long)fread(text, 1, len, f);
+  text[len] = '\0';
+  fclose(f);
+  i->string = text;
+
+  va_start(va, n);
+  x = mpc_parse_view_input(i, p, r, n, va);
+  va_end(va);
+  mpc_input_delete(i);
+  return x;
+}
+
+void mpc_view_delete(mpc_view_t *v) {
+  if (v == NULL) { return; }
+  mpc_view_blocks_free((mpc_view_block_t*)v);
+}
+
 /*
 ** Building a Parser
 */
@@ -1443,6 +2379,14 @@ static void mpc_undefine_unretained(mpc_parser_t *p, int force) {
       free(p->data.check_with.e);
       break;
 
+    case MPC_TYPE_MEMO: mpc_undefine_unretained(p->data.memo.x, 0); break;
+
+    case MPC_TYPE_DFA:
+      mpc_undefine_unretained(p->data.dfa.x, 0);
+      free(p->data.dfa.t);
+      free(p->data.dfa.acc);
+      break;
+
     default: break;
   }
 
@@ -1567,6 +2511,16 @@ mpc_parser_t *mpc_copy(mpc_parser_t *a) {
       strcpy(p->data.check_with.e, a->data.check_with.e);
       break;
 
+    case MPC_TYPE_MEMO: p->data.memo.x = mpc_copy(a->data.memo.x); break;
+
+    case MPC_TYPE_DFA:
+      p->data.dfa.x   = mpc_copy(a->data.dfa.x);
+      p->data.dfa.t   = malloc(a->data.dfa.n * 256);
+      p->data.dfa.acc = malloc(a->data.dfa.n);
+      memcpy(p->data.dfa.t, a->data.dfa.t, a->data.dfa.n * 256);
+      memcpy(p->data.dfa.acc, a->data.dfa.acc, a->data.dfa.n);
+      break;
+
     default: break;
   }
 
@@ -1883,6 +2837,21 @@ mpc_parser_t *mpc_predictive(mpc_parser_t *a) {
   return p;
 }
 
+/*
+** Remembers the results of `a` by position, shared with every memo of
+** the same key `k`. Keys with different `id`s modulo MPC_MEMO_WAYS
+** never evict each other.
+*/
+static mpc_parser_t *mpc_memo(mpc_parser_t *a, mpc_parser_t *k, int id, mpc_dtor_t da) {
+  mpc_parser_t *p = mpc_undefined();
+  p->type = MPC_TYPE_MEMO;
+  p->data.memo.x = a;
+  p->data.memo.k = k;
+  p->data.memo.id = id;
+  p->data.memo.dx = da;
+  return p;
+}
+
 mpc_parser_t *mpc_not_lift(mpc_parser_t *a, mpc_dtor_t da, mpc_ctor_t lf) {
   mpc_parser_t *p = mpc_undefined();
   p->type = MPC_TYPE_NOT;
@@ -2359,6 +3328,207 @@ static mpc_val_t *mpcf_re_range(mpc_val_t *x) {
   return out;
 }
 
+/*
+** Regex DFA
+**
+** A regex made only of characters, sequences, alternatives and
+** repetition compiles to its position automaton, one state per
+** character it matches. When no state can move to two others on the
+** same character, the automaton is a DFA and its longest match is the
+** match of the backtracking combinators: every choice is decided by
+** the next character alone. Alternatives after one that can match
+** nothing are never tried by the combinators, so those are left alone.
+** Anchors and `\D` style lookaheads keep the combinators too.
+*/
+
+enum {
+  MPC_DFA_MAX = 64
+};
+
+typedef struct {
+  int nullable;
+  char first[MPC_DFA_MAX];
+  char last[MPC_DFA_MAX];
+} mpc_dfa_node_t;
+
+typedef struct {
+  int n;
+  char chars[MPC_DFA_MAX][256];
+  char follow[MPC_DFA_MAX][MPC_DFA_MAX];
+} mpc_dfa_build_t;
+
+static void mpc_dfa_union(char *x, const char *y) {
+  int j;
+  for (j = 0; j < MPC_DFA_MAX; j++) { x[j] |= y[j]; }
+}
+
+/* Everything that ends `a` can be followed by what starts `b` */
+static void mpc_dfa_follow(mpc_dfa_build_t *d, mpc_dfa_node_t *a, mpc_dfa_node_t *b) {
+  int j;
+  for (j = 0; j < d->n; j++) {
+    if (a->last[j]) { mpc_dfa_union(d->follow[j], b->first); }
+  }
+}
+
+static void mpc_dfa_seq(mpc_dfa_build_t *d, mpc_dfa_node_t *a, mpc_dfa_node_t *b) {
+  mpc_dfa_follow(d, a, b);
+  if (a->nullable) { mpc_dfa_union(a->first, b->first); }
+  if (!b->nullable) { memset(a->last, 0, MPC_DFA_MAX); }
+  mpc_dfa_union(a->last, b->last);
+  a->nullable = a->nullable && b->nullable;
+}
+
+static int mpc_dfa_char(mpc_dfa_build_t *d, mpc_parser_t *p, mpc_dfa_node_t *o) {
+
+  int c;
+  char x, *chars;
+
+  if (d->n == MPC_DFA_MAX) { return 0; }
+  chars = d->chars[d->n];
+
+  /* The same tests as the input primitives, the end of input never matches */
+  for (c = 1; c < 256; c++) {
+    x = (char)c;
+    switch (p->type) {
+      case MPC_TYPE_ANY:    chars[c] = 1; break;
+      case MPC_TYPE_SINGLE: chars[c] = x == p->data.single.x; break;
+      case MPC_TYPE_RANGE:  chars[c] = x >= p->data.range.x && x <= p->data.range.y; break;
+      case MPC_TYPE_ONEOF:  chars[c] = strchr(p->data.string.x, x) != 0; break;
+      case MPC_TYPE_NONEOF: chars[c] = strchr(p->data.string.x, x) == 0; break;
+      default: return 0;
+    }
+  }
+
+  o->first[d->n] = 1;
+  o->last[d->n] = 1;
+  d->n++;
+  return 1;
+}
+
+static int mpc_dfa_walk(mpc_dfa_build_t *d, mpc_parser_t *p, mpc_dfa_node_t *o) {
+
+  int j;
+  mpc_dfa_node_t x;
+
+  memset(o, 0, sizeof(mpc_dfa_node_t));
+  if (p->retained) { return 0; }
+
+  switch (p->type) {
+
+    case MPC_TYPE_ANY:
+    case MPC_TYPE_SINGLE:
+    case MPC_TYPE_RANGE:
+    case MPC_TYPE_ONEOF:
+    case MPC_TYPE_NONEOF:
+      return mpc_dfa_char(d, p, o);
+
+    case MPC_TYPE_EXPECT:
+      return mpc_dfa_walk(d, p->data.expect.x, o);
+
+    case MPC_TYPE_LIFT:
+      o->nullable = 1;
+      return p->data.lift.lf == mpcf_ctor_str;
+
+    case MPC_TYPE_MAYBE:
+      if (p->data.not.lf != mpcf_ctor_str) { return 0; }
+      if (!mpc_dfa_walk(d, p->data.not.x, o)) { return 0; }
+      o->nullable = 1;
+      return 1;
+
+    case MPC_TYPE_MANY:
+    case MPC_TYPE_MANY1:
+      if (p->data.repeat.f != mpcf_strfold) { return 0; }
+      if (!mpc_dfa_walk(d, p->data.repeat.x, o) || o->nullable) { return 0; }
+      mpc_dfa_follow(d, o, o);
+      o->nullable = p->type == MPC_TYPE_MANY;
+      return 1;
+
+    case MPC_TYPE_COUNT:
+      if (p->data.repeat.f != mpcf_strfold || p->data.repeat.n < 1) { return 0; }
+      if (!mpc_dfa_walk(d, p->data.repeat.x, o)) { return 0; }
+      for (j = 1; j < p->data.repeat.n; j++) {
+        if (!mpc_dfa_walk(d, p->data.repeat.x, &x)) { return 0; }
+        mpc_dfa_seq(d, o, &x);
+      }
+      return 1;
+
+    case MPC_TYPE_AND:
+      if (p->data.and.f != mpcf_strfold || p->data.and.n == 0) { return 0; }
+      o->nullable = 1;
+      for (j = 0; j < p->data.and.n; j++) {
+        if (!mpc_dfa_walk(d, p->data.and.xs[j], &x)) { return 0; }
+        mpc_dfa_seq(d, o, &x);
+      }
+      return 1;
+
+    case MPC_TYPE_OR:
+      if (p->data.or.n == 0) { return 0; }
+      for (j = 0; j < p->data.or.n; j++) {
+        if (!mpc_dfa_walk(d, p->data.or.xs[j], &x)) { return 0; }
+        if (x.nullable && j < p->data.or.n-1) { return 0; }
+        mpc_dfa_union(o->first, x.first);
+        mpc_dfa_union(o->last, x.last);
+        o->nullable = x.nullable;
+      }
+      return 1;
+
+    default: return 0;
+  }
+
+}
+
+/* Moves on each character into at most one of the positions `next` */
+static int mpc_dfa_state(mpc_dfa_build_t *d, const char *next, unsigned char *t) {
+  int j, c;
+  for (j = 0; j < d->n; j++) {
+    if (!next[j]) { continue; }
+    for (c = 1; c < 256; c++) {
+      if (!d->chars[j][c]) { continue; }
+      if (t[c]) { return 0; }
+      t[c] = j + 2;
+    }
+  }
+  return 1;
+}
+
+static mpc_parser_t *mpc_dfa(mpc_parser_t *a) {
+
+  int j;
+  mpc_dfa_node_t root;
+  mpc_dfa_build_t *d = calloc(1, sizeof(mpc_dfa_build_t));
+  mpc_parser_t *p;
+  unsigned char *t;
+  char *acc;
+
+  if (!mpc_dfa_walk(d, a, &root)) { free(d); return a; }
+
+  /* State zero is the start, state `j+1` the position `j` */
+  t = calloc(d->n + 1, 256);
+  acc = calloc(d->n + 1, 1);
+
+  if (!mpc_dfa_state(d, root.first, t)) { goto fail; }
+  acc[0] = root.nullable;
+  for (j = 0; j < d->n; j++) {
+    if (!mpc_dfa_state(d, d->follow[j], t + (j + 1) * 256)) { goto fail; }
+    acc[j + 1] = root.last[j];
+  }
+
+  p = mpc_undefined();
+  p->type = MPC_TYPE_DFA;
+  p->data.dfa.x = a;
+  p->data.dfa.n = d->n + 1;
+  p->data.dfa.t = t;
+  p->data.dfa.acc = acc;
+  free(d);
+  return p;
+
+fail:
+  free(d);
+  free(t);
+  free(acc);
+  return a;
+}
+
 mpc_parser_t *mpc_re(const char *re) {
   return mpc_re_mode(re, MPC_RE_DEFAULT);
 }
@@ -2426,7 +3596,7 @@ mpc_parser_t *mpc_re_mode(const char *re, int mode) {
 
   mpc_optimise(r.output);
 
-  return r.output;
+  return mpc_dfa(r.output);
 
 }
 
@@ -2778,6 +3948,8 @@ static void mpc_print_unretained(mpc_parser_t *p, int force) {
   if (p->type == MPC_TYPE_APPLY)    { mpc_print_unretained(p->data.apply.x, 0); }
   if (p->type == MPC_TYPE_APPLY_TO) { mpc_print_unretained(p->data.apply_to.x, 0); }
   if (p->type == MPC_TYPE_PREDICT)  { mpc_print_unretained(p->data.predict.x, 0); }
+  if (p->type == MPC_TYPE_DFA)      { mpc_print_unretained(p->data.dfa.x, 0); }
+  if (p->type == MPC_TYPE_MEMO)     { mpc_print_unretained(p->data.memo.x, 0); }
 
   if (p->type == MPC_TYPE_NOT)   { mpc_print_unretained(p->data.not.x, 0); printf("!"); }
   if (p->type == MPC_TYPE_MAYBE) { mpc_print_unretained(p->data.not.x, 0); printf("?"); }
@@ -3516,11 +4688,16 @@ static mpc_parser_t *mpca_grammar_find_parser(char *x, mpca_grammar_st_t *st) {
 
 static mpc_val_t *mpcaf_grammar_id(mpc_val_t *x, void *s) {
 
+  int i;
   mpca_grammar_st_t *st = s;
   mpc_parser_t *p = mpca_grammar_find_parser(x, st);
   free(x);
 
-  if (p->name) {
+  /* Every reference builds the same tree, so they share the results */
+  if (p->name && (st->flags & MPCA_LANG_PACKRAT)) {
+    for (i = 0; i < st->parsers_num && st->parsers[i] != p; i++);
+    return mpc_memo(mpca_state(mpca_root(mpca_add_tag(p, p->name))), p, i, (mpc_dtor_t)mpc_ast_delete);
+  } else if (p->name) {
     return mpca_state(mpca_root(mpca_add_tag(p, p->name)));
   } else {
     return mpca_state(mpca_root(p));
@@ -3864,6 +5041,8 @@ static int mpc_nodecount_unretained(mpc_parser_t* p, int force) {
   if (p->type == MPC_TYPE_APPLY)    { return 1 + mpc_nodecount_unretained(p->data.apply.x, 0); }
   if (p->type == MPC_TYPE_APPLY_TO) { return 1 + mpc_nodecount_unretained(p->data.apply_to.x, 0); }
   if (p->type == MPC_TYPE_PREDICT)  { return 1 + mpc_nodecount_unretained(p->data.predict.x, 0); }
+  if (p->type == MPC_TYPE_DFA)      { return 1 + mpc_nodecount_unretained(p->data.dfa.x, 0); }
+  if (p->type == MPC_TYPE_MEMO)     { return 1 + mpc_nodecount_unretained(p->data.memo.x, 0); }
 
   if (p->type == MPC_TYPE_CHECK)    { return 1 + mpc_nodecount_unretained(p->data.check.x, 0); }
   if (p->type == MPC_TYPE_CHECK_WITH) { return 1 + mpc_nodecount_unretained(p->data.check_with.x, 0); }
@@ -3916,6 +5095,7 @@ static void mpc_optimise_unretained(mpc_parser_t *p, int force) {
   if (p->type == MPC_TYPE_CHECK)      { mpc_optimise_unretained(p->data.check.x, 0); }
   if (p->type == MPC_TYPE_CHECK_WITH) { mpc_optimise_unretained(p->data.check_with.x, 0); }
   if (p->type == MPC_TYPE_PREDICT)    { mpc_optimise_unretained(p->data.predict.x, 0); }
+  if (p->type == MPC_TYPE_MEMO)       { mpc_optimise_unretained(p->data.memo.x, 0); }
   if (p->type == MPC_TYPE_NOT)        { mpc_optimise_unretained(p->data.not.x, 0); }
   if (p->type == MPC_TYPE_MAYBE)      { mpc_optimise_unretained(p->data.not.x, 0); }
   if (p->type == MPC_TYPE_MANY)       { mpc_optimise_unretained(p->data.repeat.x, 0); }
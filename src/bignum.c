@@ -0,0 +1,880 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <math.h>
+
+#include "eval.h"
+#include "heap.h"
+#include "bignum.h"
+#include "writer.h"
+
+/* Below this many limbs schoolbook multiplication beats Karatsuba. */
+#define LBIG_KARATSUBA 32
+/* Below this many limbs reciprocals come from long division instead of Newton. */
+#define LBIG_NEWTON 16
+/* Below this many limbs decimal conversion peels off 10^9 chunks directly. */
+#define LBIG_DEC_SMALL 32
+#define LBIG_DEC_CHUNK 1000000000u
+
+/************* Magnitudes ****************/
+/* Helpers working on raw little-endian limb arrays. Inputs may carry leading
+    zero limbs, results are written in full.
+*/
+static uint32_t *mag_new(long n)
+{
+    return lheap_alloc(LVAL_BIG, sizeof(uint32_t) * (n > 0 ? n : 1));
+}
+
+static long mag_norm(const uint32_t *a, long n)
+{
+    while (n > 0 && a[n - 1] == 0)
+        n--;
+    return n;
+}
+
+static int mag_cmp(const uint32_t *a, long na, const uint32_t *b, long nb)
+{
+    na = mag_norm(a, na);
+    nb = mag_norm(b, nb);
+    if (na != nb)
+        return na < nb ? -1 : 1;
+    for (long i = na - 1; i >= 0; i--)
+    {
+        if (a[i] != b[i])
+            return a[i] < b[i] ? -1 : 1;
+    }
+    return 0;
+}
+
+/* r = a + b. `r` holds max(na, nb) + 1 limbs and may alias an input. */
+static long mag_add(uint32_t *r, const uint32_t *a, long na, const uint32_t *b, long nb)
+{
+    if (na < nb)
+    {
+        const uint32_t *t = a;
+        a = b;
+        b = t;
+        long n = na;
+        na = nb;
+        nb = n;
+    }
+
+    uint64_t c = 0;
+    long i;
+    for (i = 0; i < nb; i++)
+    {
+        c += (uint64_t)a[i] + b[i];
+        r[i] = (uint32_t)c;
+        c >>= 32;
+    }
+    for (; i < na; i++)
+    {
+        c += a[i];
+        r[i] = (uint32_t)c;
+        c >>= 32;
+    }
+    r[i] = (uint32_t)c;
+    return na + 1;
+}
+
+/* a -= b in place, requires a >= b. */
+static void mag_sub_in(uint32_t *a, long na, const uint32_t *b, long nb)
+{
+    uint64_t borrow = 0;
+    for (long i = 0; i < na; i++)
+    {
+        if (i >= nb && !borrow)
+            break;
+        uint64_t t = (uint64_t)a[i] - (i < nb ? b[i] : 0) - borrow;
+        a[i] = (uint32_t)t;
+        borrow = t >> 63;
+    }
+}
+
+/* r += a in place, the carry runs at most up to r[nr - 1]. */
+static void mag_add_in(uint32_t *r, long nr, const uint32_t *a, long na)
+{
+    uint64_t c = 0;
+    long i;
+    for (i = 0; i < na; i++)
+    {
+        c += (uint64_t)r[i] + a[i];
+        r[i] = (uint32_t)c;
+        c >>= 32;
+    }
+    for (; c && i < nr; i++)
+    {
+        c += r[i];
+        r[i] = (uint32_t)c;
+        c >>= 32;
+    }
+}
+
+static void mag_mul_school(uint32_t *r, const uint32_t *a, long na, const uint32_t *b, long nb)
+{
+    memset(r, 0, sizeof(uint32_t) * (na + nb));
+    for (long i = 0; i < na; i++)
+    {
+        uint64_t ai = a[i];
+        uint64_t c = 0;
+        if (ai == 0)
+            continue;
+        for (long j = 0; j < nb; j++)
+        {
+            c += ai * b[j] + r[i + j];
+            r[i + j] = (uint32_t)c;
+            c >>= 32;
+        }
+        r[i + nb] = (uint32_t)c;
+    }
+}
+
+/* r = a * b with na + nb limbs, Karatsuba above LBIG_KARATSUBA limbs. */
+static void mag_mul(uint32_t *r, const uint32_t *a, long na, const uint32_t *b, long nb)
+{
+    if (na < nb)
+    {
+        const uint32_t *t = a;
+        a = b;
+        b = t;
+        long n = na;
+        na = nb;
+        nb = n;
+    }
+
+    if (nb < LBIG_KARATSUBA)
+    {
+        mag_mul_school(r, a, na, b, nb);
+        return;
+    }
+
+    /* Unbalanced operands: multiply `b` by `a` one slice at a time. */
+    if (2 * nb <= na)
+    {
+        uint32_t *t = mag_new(2 * nb);
+        memset(r, 0, sizeof(uint32_t) * (na + nb));
+        for (long off = 0; off < na; off += nb)
+        {
+            long len = na - off < nb ? na - off : nb;
+            mag_mul(t, a + off, len, b, nb);
+            mag_add_in(r + off, na + nb - off, t, len + nb);
+        }
+        lheap_free(t);
+        return;
+    }
+
+    /* a = a1 B^h + a0, b = b1 B^h + b0 and
+        a b = z2 B^2h + ((a0 + a1)(b0 + b1) - z0 - z2) B^h + z0.
+    */
+    long h = (na + 1) / 2;
+    long na1 = na - h;
+    long nb1 = nb - h;
+
+    mag_mul(r, a, h, b, h);
+    if (nb1 > 0)
+        mag_mul(r + 2 * h, a + h, na1, b + h, nb1);
+    else
+        memset(r + 2 * h, 0, sizeof(uint32_t) * na1);
+
+    uint32_t *sa = mag_new(h + 1);
+    uint32_t *sb = mag_new(h + 1);
+    uint32_t *z1 = mag_new(2 * h + 2);
+    mag_add(sa, a, h, a + h, na1);
+    mag_add(sb, b, h, b + h, nb1);
+    mag_mul(z1, sa, h + 1, sb, h + 1);
+    mag_sub_in(z1, 2 * h + 2, r, 2 * h);
+    mag_sub_in(z1, 2 * h + 2, r + 2 * h, na1 + nb1);
+    mag_add_in(r + h, na + nb - h, z1, mag_norm(z1, 2 * h + 2));
+
+    lheap_free(sa);
+    lheap_free(sb);
+    lheap_free(z1);
+}
+
+/* q = a / d, returns a % d. `q` may alias `a`. */
+static uint32_t mag_divmod_small(uint32_t *q, const uint32_t *a, long na, uint32_t d)
+{
+    uint64_t rem = 0;
+    for (long i = na - 1; i >= 0; i--)
+    {
+        uint64_t cur = (rem << 32) | a[i];
+        q[i] = (uint32_t)(cur / d);
+        rem = cur % d;
+    }
+    return (uint32_t)rem;
+}
+
+static int mag_clz(uint32_t x)
+{
+    int n = 0;
+    while (!(x & 0x80000000u))
+    {
+        x <<= 1;
+        n++;
+    }
+    return n;
+}
+
+/* Knuth's algorithm D: q = a / b with na - nb + 1 limbs and r = a % b with
+    nb limbs. Requires na >= nb and a normalized `b`.
+*/
+static void mag_divmod(uint32_t *q, uint32_t *r, const uint32_t *a, long na,
+                       const uint32_t *b, long nb)
+{
+    if (nb == 1)
+    {
+        r[0] = mag_divmod_small(q, a, na, b[0]);
+        return;
+    }
+
+    /* Shift so the top limb of the divisor has its high bit set. */
+    int s = mag_clz(b[nb - 1]);
+    uint32_t *bn = mag_new(nb);
+    uint32_t *an = mag_new(na + 1);
+    for (long i = nb - 1; i > 0; i--)
+        bn[i] = (b[i] << s) | (s ? b[i - 1] >> (32 - s) : 0);
+    bn[0] = b[0] << s;
+    an[na] = s ? a[na - 1] >> (32 - s) : 0;
+    for (long i = na - 1; i > 0; i--)
+        an[i] = (a[i] << s) | (s ? a[i - 1] >> (32 - s) : 0);
+    an[0] = a[0] << s;
+
+    for (long j = na - nb; j >= 0; j--)
+    {
+        /* Estimate the quotient digit from the top two limbs. */
+        uint64_t num = ((uint64_t)an[j + nb] << 32) | an[j + nb - 1];
+        uint64_t qhat = num / bn[nb - 1];
+        uint64_t rhat = num % bn[nb - 1];
+        while (qhat >> 32 || qhat * bn[nb - 2] > ((rhat << 32) | an[j + nb - 2]))
+        {
+            qhat--;
+            rhat += bn[nb - 1];
+            if (rhat >> 32)
+                break;
+        }
+
+        /* Multiply and subtract. */
+        int64_t k = 0;
+        int64_t t;
+        for (long i = 0; i < nb; i++)
+        {
+            uint64_t p = qhat * bn[i];
+            t = (int64_t)an[i + j] - k - (int64_t)(p & 0xFFFFFFFFu);
+            an[i + j] = (uint32_t)t;
+            k = (int64_t)(p >> 32) - (t >> 32);
+        }
+        t = (int64_t)an[j + nb] - k;
+        an[j + nb] = (uint32_t)t;
+
+        /* The estimate was one too large, add back. */
+        q[j] = (uint32_t)qhat;
+        if (t < 0)
+        {
+            q[j]--;
+            uint64_t c = 0;
+            for (long i = 0; i < nb; i++)
+            {
+                c += (uint64_t)an[i + j] + bn[i];
+                an[i + j] = (uint32_t)c;
+                c >>= 32;
+            }
+            an[j + nb] += (uint32_t)c;
+        }
+    }
+
+    for (long i = 0; i < nb; i++)
+        r[i] = (an[i] >> s) | (s ? an[i + 1] << (32 - s) : 0);
+
+    lheap_free(bn);
+    lheap_free(an);
+}
+
+/************* Construct and release bignums ****************/
+static struct lbig *lbig_alloc(long n)
+{
+    struct lbig *b = lheap_alloc(LVAL_BIG, sizeof(struct lbig) + sizeof(uint32_t) * n);
+    b->refs = 1;
+    b->sign = 0;
+    b->n = n;
+    return b;
+}
+
+/* Drop leading zero limbs and give zero its sign. */
+static struct lbig *lbig_trim(struct lbig *b, int sign)
+{
+    b->n = mag_norm(b->d, b->n);
+    b->sign = b->n ? sign : 0;
+    return b;
+}
+
+static struct lbig *lbig_dup(const struct lbig *x, int sign)
+{
+    struct lbig *b = lbig_alloc(x->n);
+    memcpy(b->d, x->d, sizeof(uint32_t) * x->n);
+    return lbig_trim(b, sign);
+}
+
+struct lbig *lbig_ref(struct lbig *b)
+{
+    b->refs++;
+    return b;
+}
+
+void lbig_unref(struct lbig *b)
+{
+    if (--b->refs == 0)
+        lheap_free(b);
+}
+
+struct lbig *lbig_from_long(long x)
+{
+    uint64_t m = x < 0 ? 0 - (uint64_t)x : (uint64_t)x;
+    struct lbig *b = lbig_alloc(2);
+    b->d[0] = (uint32_t)m;
+    b->d[1] = (uint32_t)(m >> 32);
+    return lbig_trim(b, x < 0 ? -1 : 1);
+}
+
+struct lbig *lbig_from_double(double x)
+{
+    double t = trunc(fabs(x));
+    if (t < 9223372036854775808.0)
+        return lbig_from_long((long)trunc(x));
+
+    /* Past 2^63 the value is the 53-bit mantissa shifted left by at least 11. */
+    int e;
+    uint64_t m = (uint64_t)ldexp(frexp(t, &e), 53);
+    long shift = e - 53;
+    long k = shift / 32;
+    int s = (int)(shift % 32);
+    uint64_t lo = m << s;
+    uint64_t hi = s ? m >> (64 - s) : 0;
+
+    struct lbig *b = lbig_alloc(k + 3);
+    memset(b->d, 0, sizeof(uint32_t) * k);
+    b->d[k] = (uint32_t)lo;
+    b->d[k + 1] = (uint32_t)(lo >> 32);
+    b->d[k + 2] = (uint32_t)hi;
+    return lbig_trim(b, x < 0 ? -1 : 1);
+}
+
+struct lbig *lbig_from_str(const char *s)
+{
+    int sign = 1;
+    if (*s == '-' || *s == '+')
+        sign = *s++ == '-' ? -1 : 1;
+
+    long digits = (long)strlen(s);
+    if (digits == 0)
+        return NULL;
+
+    /* Multiply in 9 digits at a time. */
+    struct lbig *b = lbig_alloc(digits / 9 + 2);
+    long n = 0;
+    long first = digits % 9 ? digits % 9 : 9;
+    for (long i = 0; i < digits;)
+    {
+        long len = i == 0 ? first : 9;
+        uint64_t chunk = 0;
+        uint64_t scale = 1;
+        for (long j = 0; j < len; j++, i++)
+        {
+            if (s[i] < '0' || s[i] > '9')
+            {
+                lbig_unref(b);
+                return NULL;
+            }
+            chunk = chunk * 10 + (uint64_t)(s[i] - '0');
+            scale *= 10;
+        }
+
+        uint64_t c = chunk;
+        for (long k = 0; k < n; k++)
+        {
+            c += (uint64_t)b->d[k] * scale;
+            b->d[k] = (uint32_t)c;
+            c >>= 32;
+        }
+        if (c)
+            b->d[n++] = (uint32_t)c;
+    }
+    b->n = n;
+    return lbig_trim(b, sign);
+}
+
+/* Wrap a bignum into an lval, demoting it to LVAL_NUM when it fits a long. */
+lval *lval_big(struct lbig *b)
+{
+    if (b->n <= 2)
+    {
+        uint64_t m = b->n ? b->d[0] : 0;
+        if (b->n == 2)
+            m |= (uint64_t)b->d[1] << 32;
+        if (b->sign >= 0 ? m <= (uint64_t)LONG_MAX : m <= (uint64_t)LONG_MAX + 1)
+        {
+            long x = b->sign >= 0 ? (long)m : (long)(0 - m);
+            lbig_unref(b);
+            return lval_num(x);
+        }
+    }
+
+    lval *v = lheap_alloc(LVAL_BIG, sizeof(lval));
+    v->type = LVAL_BIG;
+    v->big = b;
+    return v;
+}
+
+/************* Arithmetic ****************/
+static struct lbig *lbig_addsub(const struct lbig *x, const struct lbig *y, int ysign)
+{
+    if (x->sign == 0)
+        return lbig_dup(y, ysign);
+    if (ysign == 0)
+        return lbig_dup(x, x->sign);
+
+    struct lbig *r;
+    if (x->sign == ysign)
+    {
+        r = lbig_alloc((x->n > y->n ? x->n : y->n) + 1);
+        mag_add(r->d, x->d, x->n, y->d, y->n);
+        return lbig_trim(r, x->sign);
+    }
+
+    /* Opposite signs subtract the smaller magnitude from the larger. */
+    int c = mag_cmp(x->d, x->n, y->d, y->n);
+    const struct lbig *big = c >= 0 ? x : y;
+    const struct lbig *small = c >= 0 ? y : x;
+    r = lbig_dup(big, 1);
+    mag_sub_in(r->d, r->n, small->d, small->n);
+    return lbig_trim(r, c >= 0 ? x->sign : ysign);
+}
+
+struct lbig *lbig_add(const struct lbig *x, const struct lbig *y)
+{
+    return lbig_addsub(x, y, y->sign);
+}
+
+struct lbig *lbig_sub(const struct lbig *x, const struct lbig *y)
+{
+    return lbig_addsub(x, y, -y->sign);
+}
+
+struct lbig *lbig_mul(const struct lbig *x, const struct lbig *y)
+{
+    if (x->sign == 0 || y->sign == 0)
+        return lbig_alloc(0);
+
+    struct lbig *r = lbig_alloc(x->n + y->n);
+    mag_mul(r->d, x->d, x->n, y->d, y->n);
+    return lbig_trim(r, x->sign * y->sign);
+}
+
+/* Truncating division, either output may be NULL. */
+static void lbig_divmod(const struct lbig *x, const struct lbig *y,
+                        struct lbig **q, struct lbig **r)
+{
+    if (mag_cmp(x->d, x->n, y->d, y->n) < 0)
+    {
+        if (q)
+            *q = lbig_alloc(0);
+        if (r)
+            *r = lbig_dup(x, x->sign);
+        return;
+    }
+
+    struct lbig *qq = lbig_alloc(x->n - y->n + 1);
+    struct lbig *rr = lbig_alloc(y->n);
+    mag_divmod(qq->d, rr->d, x->d, x->n, y->d, y->n);
+    lbig_trim(qq, x->sign * y->sign);
+    lbig_trim(rr, x->sign);
+
+    if (q)
+        *q = qq;
+    else
+        lbig_unref(qq);
+    if (r)
+        *r = rr;
+    else
+        lbig_unref(rr);
+}
+
+struct lbig *lbig_div(const struct lbig *x, const struct lbig *y)
+{
+    struct lbig *q;
+    lbig_divmod(x, y, &q, NULL);
+    return q;
+}
+
+struct lbig *lbig_mod(const struct lbig *x, const struct lbig *y)
+{
+    struct lbig *r;
+    lbig_divmod(x, y, NULL, &r);
+    return r;
+}
+
+int lbig_cmp(const struct lbig *x, const struct lbig *y)
+{
+    if (x->sign != y->sign)
+        return x->sign < y->sign ? -1 : 1;
+    return x->sign * mag_cmp(x->d, x->n, y->d, y->n);
+}
+
+double lbig_to_double(const struct lbig *x)
+{
+    double r = 0.0;
+    for (long i = x->n - 1; i >= 0; i--)
+        r = r * 4294967296.0 + x->d[i];
+    return x->sign * r;
+}
+
+/************* Sub-quadratic decimal conversion ****************/
+/* x * B^k and floor(|x| / B^k) with the sign of x. */
+static struct lbig *lbig_shl_limbs(const struct lbig *x, long k)
+{
+    struct lbig *r = lbig_alloc(x->n + k);
+    memset(r->d, 0, sizeof(uint32_t) * k);
+    memcpy(r->d + k, x->d, sizeof(uint32_t) * x->n);
+    return lbig_trim(r, x->sign);
+}
+
+static struct lbig *lbig_shr_limbs(const struct lbig *x, long k)
+{
+    if (k >= x->n)
+        return lbig_alloc(0);
+    struct lbig *r = lbig_alloc(x->n - k);
+    memcpy(r->d, x->d + k, sizeof(uint32_t) * (x->n - k));
+    return lbig_trim(r, x->sign);
+}
+
+static struct lbig *lbig_pow_base(long k)
+{
+    struct lbig *r = lbig_alloc(k + 1);
+    memset(r->d, 0, sizeof(uint32_t) * k);
+    r->d[k] = 1;
+    return lbig_trim(r, 1);
+}
+
+/* Replace *x by a new value, releasing the old one. */
+static void lbig_set(struct lbig **x, struct lbig *v)
+{
+    lbig_unref(*x);
+    *x = v;
+}
+
+/* floor(B^2n / p) for a positive p of n limbs. Newton iteration from a half
+    precision reciprocal keeps the cost at a few multiplications.
+*/
+static struct lbig *lbig_recip(const struct lbig *p)
+{
+    long n = p->n;
+    struct lbig *top = lbig_pow_base(2 * n);
+    if (n < LBIG_NEWTON)
+    {
+        struct lbig *r = lbig_div(top, p);
+        lbig_unref(top);
+        return r;
+    }
+
+    /* Start from the reciprocal of the leading h limbs. */
+    long h = (n + 1) / 2 + 2;
+    struct lbig *ph = lbig_shr_limbs(p, n - h);
+    struct lbig *rh = lbig_recip(ph);
+    struct lbig *x = lbig_shl_limbs(rh, n - h);
+    lbig_unref(ph);
+    lbig_unref(rh);
+
+    /* x += x (B^2n - p x) / B^2n */
+    struct lbig *e = lbig_mul(p, x);
+    lbig_set(&e, lbig_sub(top, e));
+    struct lbig *t = lbig_mul(x, e);
+    lbig_set(&t, lbig_shr_limbs(t, 2 * n));
+    lbig_set(&x, lbig_add(x, t));
+    lbig_unref(t);
+
+    /* Settle the last few units exactly. */
+    struct lbig *one = lbig_from_long(1);
+    lbig_set(&e, lbig_mul(p, x));
+    lbig_set(&e, lbig_sub(top, e));
+    while (e->sign < 0)
+    {
+        lbig_set(&x, lbig_sub(x, one));
+        lbig_set(&e, lbig_add(e, p));
+    }
+    while (lbig_cmp(e, p) >= 0)
+    {
+        lbig_set(&x, lbig_add(x, one));
+        lbig_set(&e, lbig_sub(e, p));
+    }
+
+    lbig_unref(one);
+    lbig_unref(e);
+    lbig_unref(top);
+    return x;
+}
+
+/* Barrett reduction: q = x / p, r = x % p for 0 <= x < B^2m, where p has m
+    limbs and mu = floor(B^2m / p).
+*/
+static void lbig_barrett(const struct lbig *x, const struct lbig *p, const struct lbig *mu,
+                         struct lbig **q, struct lbig **r)
+{
+    long m = p->n;
+    struct lbig *qq = lbig_shr_limbs(x, m - 1);
+    lbig_set(&qq, lbig_mul(qq, mu));
+    lbig_set(&qq, lbig_shr_limbs(qq, m + 1));
+
+    struct lbig *rr = lbig_mul(qq, p);
+    lbig_set(&rr, lbig_sub(x, rr));
+
+    /* The estimate is at most two short. */
+    struct lbig *one = lbig_from_long(1);
+    while (lbig_cmp(rr, p) >= 0)
+    {
+        lbig_set(&rr, lbig_sub(rr, p));
+        lbig_set(&qq, lbig_add(qq, one));
+    }
+    lbig_unref(one);
+
+    *q = qq;
+    *r = rr;
+}
+
+/* Powers 10^(9 2^k) and their reciprocals, grown on demand and kept. */
+static struct
+{
+    long count;
+    struct lbig **pow;
+    struct lbig **mu;
+} lbig_dec;
+
+static void lbig_dec_powers(long k)
+{
+    while (lbig_dec.count <= k)
+    {
+        long i = lbig_dec.count++;
+        lbig_dec.pow = lheap_realloc(LVAL_BIG, lbig_dec.pow, sizeof(struct lbig *) * lbig_dec.count);
+        lbig_dec.mu = lheap_realloc(LVAL_BIG, lbig_dec.mu, sizeof(struct lbig *) * lbig_dec.count);
+        lbig_dec.pow[i] = i == 0 ? lbig_from_long(LBIG_DEC_CHUNK)
+                                 : lbig_mul(lbig_dec.pow[i - 1], lbig_dec.pow[i - 1]);
+        lbig_dec.mu[i] = lbig_dec.pow[i]->n >= LBIG_NEWTON ? lbig_recip(lbig_dec.pow[i]) : NULL;
+    }
+}
+
+/* Write the digits of a non-negative x, zero padded to exactly `width`
+    digits, or unpadded when `width` is negative. Returns the end of output.
+*/
+static char *lbig_dec_write(const struct lbig *x, char *out, long width)
+{
+    if (x->n <= LBIG_DEC_SMALL)
+    {
+        /* Peel 9 digit chunks off a scratch copy, least significant first. */
+        uint32_t t[LBIG_DEC_SMALL];
+        uint32_t chunks[LBIG_DEC_SMALL * 32 / 29 + 1];
+        long n = x->n;
+        long k = 0;
+        memcpy(t, x->d, sizeof(uint32_t) * n);
+        while (n > 0)
+        {
+            chunks[k++] = mag_divmod_small(t, t, n, LBIG_DEC_CHUNK);
+            n = mag_norm(t, n);
+        }
+
+        char buf[LBIG_DEC_SMALL * 10 + 1];
+        long len = 0;
+        for (long i = k - 1; i >= 0; i--)
+            len += sprintf(buf + len, i == k - 1 ? "%u" : "%09u", chunks[i]);
+
+        for (long i = len; i < width; i++)
+            *out++ = '0';
+        memcpy(out, buf, len);
+        return out + len;
+    }
+
+    /* Split around the largest power not above x, so the quotient is
+        below that same power.
+    */
+    long k = 0;
+    for (;; k++)
+    {
+        lbig_dec_powers(k + 1);
+        if (lbig_cmp(lbig_dec.pow[k + 1], x) > 0)
+            break;
+    }
+
+    struct lbig *q;
+    struct lbig *r;
+    if (lbig_dec.mu[k])
+        lbig_barrett(x, lbig_dec.pow[k], lbig_dec.mu[k], &q, &r);
+    else
+        lbig_divmod(x, lbig_dec.pow[k], &q, &r);
+
+    long low = 9L << k;
+    out = lbig_dec_write(q, out, width < 0 ? -1 : width - low);
+    out = lbig_dec_write(r, out, low);
+    lbig_unref(q);
+    lbig_unref(r);
+    return out;
+}
+
+char *lbig_to_str(const struct lbig *x)
+{
+    char *s = malloc(x->n * 10 + 3);
+    char *p = s;
+    if (x->sign == 0)
+    {
+        *p++ = '0';
+    }
+    else
+    {
+        struct lbig *m = lbig_dup(x, 1);
+        if (x->sign < 0)
+            *p++ = '-';
+        p = lbig_dec_write(m, p, -1);
+        lbig_unref(m);
+    }
+    *p = '\0';
+    return s;
+}
+
+/************* Integration with the evaluator ****************/
+/* Borrow or build a bignum view of an integer lval. */
+static struct lbig *lbig_of(lval *v)
+{
+    return v->type == LVAL_BIG ? lbig_ref(v->big) : lbig_from_long(v->num);
+}
+
+static double lbig_lval_double(lval *v)
+{
+    switch (v->type)
+    {
+    case LVAL_BIG:
+        return lbig_to_double(v->big);
+    case LVAL_DBL:
+        return v->dbl;
+    default:
+        return (double)v->num;
+    }
+}
+
+/* Generic fold of `op` over numbers, bignums and doubles. Consumes `a`. */
+lval *lbig_op(lval *a, char *op)
+{
+    char o = op[0];
+    int dbl = a->cell[0]->type == LVAL_DBL;
+    double d = dbl ? a->cell[0]->dbl : 0.0;
+    struct lbig *b = dbl ? NULL : lbig_of(a->cell[0]);
+    lval *err = NULL;
+
+    /* If no arguments and sub then perform unary negation. */
+    if (o == '-' && a->count == 1)
+    {
+        if (dbl)
+            d = -d;
+        else
+            lbig_set(&b, lbig_dup(b, -b->sign));
+    }
+
+    for (int i = 1; !err && i < a->count; i++)
+    {
+        lval *y = a->cell[i];
+
+        /* The first double switches the rest of the fold to doubles. */
+        if (!dbl && y->type == LVAL_DBL)
+        {
+            dbl = 1;
+            d = lbig_to_double(b);
+            lbig_unref(b);
+            b = NULL;
+        }
+
+        if (dbl)
+        {
+            double dy = lbig_lval_double(y);
+            if ((o == '/' || o == '%') && dy == 0.0)
+                err = lval_err_code(LERR_DIV_ZERO);
+            else if (o == '+')
+                d += dy;
+            else if (o == '-')
+                d -= dy;
+            else if (o == '*')
+                d *= dy;
+            else if (o == '/')
+                d /= dy;
+            else
+                err = lval_err("Operator '%s' expects integers.", op);
+            continue;
+        }
+
+        struct lbig *yb = lbig_of(y);
+        if ((o == '/' || o == '%') && yb->sign == 0)
+            err = lval_err_code(LERR_DIV_ZERO);
+        else if (o == '+')
+            lbig_set(&b, lbig_add(b, yb));
+        else if (o == '-')
+            lbig_set(&b, lbig_sub(b, yb));
+        else if (o == '*')
+            lbig_set(&b, lbig_mul(b, yb));
+        else if (o == '/')
+            lbig_set(&b, lbig_div(b, yb));
+        else
+            lbig_set(&b, lbig_mod(b, yb));
+        lbig_unref(yb);
+    }
+
+    lval_del(a);
+    if (err)
+    {
+        if (b)
+            lbig_unref(b);
+        return err;
+    }
+    return dbl ? lval_dbl(d) : lval_big(b);
+}
+
+/* Three way compare of two integer lvals, at least one of them a bignum. */
+int lbig_cmp_lval(lval *x, lval *y)
+{
+    struct lbig *bx = lbig_of(x);
+    struct lbig *by = lbig_of(y);
+    int c = lbig_cmp(bx, by);
+    lbig_unref(bx);
+    lbig_unref(by);
+    return c;
+}
+
+int lbig_cmp_dbl(lval *x, double d)
+{
+    if (isnan(d))
+        return 2;
+
+    /* Compare with the integer part first, the fraction only breaks ties. */
+    double t = trunc(d);
+    int c;
+    if (isinf(t))
+    {
+        c = t > 0 ? -1 : 1;
+    }
+    else if (x->type == LVAL_NUM && t >= -9223372036854775808.0 && t < 9223372036854775808.0)
+    {
+        c = (x->num > (long)t) - (x->num < (long)t);
+    }
+    else
+    {
+        struct lbig *bx = lbig_of(x);
+        struct lbig *bt = lbig_from_double(t);
+        c = lbig_cmp(bx, bt);
+        lbig_unref(bx);
+        lbig_unref(bt);
+    }
+    if (c)
+        return c;
+    return d > t ? -1 : d < t ? 1 : 0;
+}
+
+void lval_print_big(lwriter *w, lval *v)
+{
+    char *s = lbig_to_str(v->big);
+    lw_puts(w, s);
+    free(s);
+}
@@ -0,0 +1,55 @@
+#ifndef _LISPY_BIGNUM
+#define _LISPY_BIGNUM
+
+#include <stdint.h>
+#include "eval.h"
+
+/* Arbitrary precision integer, stored as sign and magnitude with 32-bit
+    limbs, least significant first. The magnitude never has leading zero
+    limbs and zero has no limbs at all. Values are immutable and shared
+    between lval copies through the reference count.
+*/
+struct lbig
+{
+    int refs;
+    int sign;
+    long n;
+    uint32_t d[];
+};
+
+/************* Construct and release bignums ****************/
+/* Wrap a bignum into an lval, demoting it to LVAL_NUM when it fits a long. */
+lval *lval_big(struct lbig *b);
+struct lbig *lbig_from_long(long x);
+/* The integer part of a finite double, exactly. */
+struct lbig *lbig_from_double(double x);
+/* Parse an optionally signed decimal literal. Returns NULL on bad input. */
+struct lbig *lbig_from_str(const char *s);
+struct lbig *lbig_ref(struct lbig *b);
+void lbig_unref(struct lbig *b);
+
+/************* Arithmetic ****************/
+struct lbig *lbig_add(const struct lbig *x, const struct lbig *y);
+struct lbig *lbig_sub(const struct lbig *x, const struct lbig *y);
+struct lbig *lbig_mul(const struct lbig *x, const struct lbig *y);
+/* Truncating division and remainder like C's `/` and `%`. `y` must not be zero. */
+struct lbig *lbig_div(const struct lbig *x, const struct lbig *y);
+struct lbig *lbig_mod(const struct lbig *x, const struct lbig *y);
+int lbig_cmp(const struct lbig *x, const struct lbig *y);
+double lbig_to_double(const struct lbig *x);
+
+/* Decimal representation, allocated with `malloc`. */
+char *lbig_to_str(const struct lbig *x);
+
+/************* Integration with the evaluator ****************/
+/* Generic fold of `op` over numbers, bignums and doubles. Consumes `a`. */
+lval *lbig_op(lval *a, char *op);
+/* Three way compare of two integer lvals, at least one of them a bignum. */
+int lbig_cmp_lval(lval *x, lval *y);
+/* Three way compare of an integer lval with a double, exact for every pair
+    of values. Returns 2 when `d` is NaN.
+*/
+int lbig_cmp_dbl(lval *x, double d);
+void lval_print_big(lwriter *w, lval *v);
+
+#endif
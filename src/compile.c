@@ -0,0 +1,553 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <limits.h>
+
+#include "mpc.h"
+#include "eval.h"
+#include "heap.h"
+#include "writer.h"
+#include "grammar.h"
+#include "compile.h"
+
+/* State of one translation. Functions are written to `fns` while the
+    constants they use are collected, the rest of the file follows once
+    the constant pool is known.
+*/
+struct lcomp
+{
+    lwriter fns;
+    /* Q-Expression holding the constant pool, `lc_k[i]` in the output. */
+    lval *consts;
+    int tmp;
+    int indent;
+};
+
+/************* Output helpers ****************/
+static void lcomp_line(struct lcomp *c, const char *fmt, ...)
+{
+    char buf[256];
+    va_list va;
+    va_start(va, fmt);
+    vsnprintf(buf, sizeof(buf), fmt, va);
+    va_end(va);
+
+    for (int i = 0; i < c->indent; i++)
+        lw_puts(&c->fns, "    ");
+    lw_puts(&c->fns, buf);
+    lw_putc(&c->fns, '\n');
+}
+
+/* Write a C string literal. Octal escapes keep NULs, and trigraphs out. */
+static void lcomp_write_cstr(lwriter *w, const char *s, long len)
+{
+    lw_putc(w, '"');
+    for (long i = 0; i < len; i++)
+    {
+        unsigned char ch = s[i];
+        if (ch >= ' ' && ch <= '~' && ch != '"' && ch != '\\' && ch != '?')
+            lw_putc(w, ch);
+        else
+            lw_printf(w, "\\%03o", ch);
+    }
+    lw_putc(w, '"');
+}
+
+/* Index of `v` in the constant pool, symbols are shared. Takes a copy. */
+static int lcomp_const(struct lcomp *c, lval *v)
+{
+    if (v->type == LVAL_SYM)
+    {
+        for (int i = 0; i < c->consts->count; i++)
+        {
+            lval *k = c->consts->cell[i];
+            if (k->type == LVAL_SYM && k->sym == v->sym)
+                return i;
+        }
+    }
+    lval_add(c->consts, lval_copy(v));
+    return c->consts->count - 1;
+}
+
+/* C expression that builds `v`. Only values the reader produces occur. */
+static int lcomp_build(lwriter *w, lval *v)
+{
+    switch (v->type)
+    {
+    case LVAL_NUM:
+        if (v->num == LONG_MIN)
+            lw_puts(w, "lval_num(LONG_MIN)");
+        else
+            lw_printf(w, "lval_num(%ldL)", v->num);
+        return 1;
+
+    case LVAL_DBL:
+        lw_printf(w, "lval_dbl(%a)", v->dbl);
+        return 1;
+
+    case LVAL_BIG:
+    {
+        lwriter m;
+        lw_open_mem(&m);
+        lval_write(&m, NULL, v);
+        lval *s = lw_take_str(&m);
+        lw_puts(w, "lval_big(lbig_from_str(");
+        lcomp_write_cstr(w, s->str, s->len);
+        lw_puts(w, "))");
+        lval_del(s);
+        return 1;
+    }
+
+    case LVAL_SYM:
+        lw_puts(w, "lval_sym(");
+        lcomp_write_cstr(w, v->sym, strlen(v->sym));
+        lw_putc(w, ')');
+        return 1;
+
+    case LVAL_STR:
+        lw_puts(w, "lc_str(");
+        lcomp_write_cstr(w, v->str, v->len);
+        lw_printf(w, ", %ld)", v->len);
+        return 1;
+
+    case LVAL_ERR:
+    {
+        /* Literals the reader rejected, raised when they are evaluated. */
+        lwriter m;
+        lw_open_mem(&m);
+        lerr_write_msg(&m, v);
+        lval *s = lw_take_str(&m);
+        lw_puts(w, "lval_err(\"%s\", ");
+        lcomp_write_cstr(w, s->str, s->len);
+        lw_putc(w, ')');
+        lval_del(s);
+        return 1;
+    }
+
+    case LVAL_SEXPR:
+    case LVAL_QEXPR:
+        lw_printf(w, "lc_list(%s, %d, %d, %d", v->type == LVAL_SEXPR ? "lval_sexpr()" : "lval_qexpr()",
+                  v->line, v->col, v->count);
+        for (int i = 0; i < v->count; i++)
+        {
+            lw_puts(w, ",\n        ");
+            if (!lcomp_build(w, v->cell[i]))
+                return 0;
+        }
+        lw_putc(w, ')');
+        return 1;
+
+    default:
+        fprintf(stderr, "Cannot compile a literal of type %s.\n", ltype_name(v->type));
+        return 0;
+    }
+}
+
+/************* Expressions ****************/
+/* Symbols, S-Expressions and literal errors can raise when evaluated,
+    everything else evaluates to itself.
+*/
+static int lcomp_may_raise(lval *x)
+{
+    return x->type == LVAL_SYM || x->type == LVAL_SEXPR || x->type == LVAL_ERR;
+}
+
+static int lcomp_list(struct lcomp *c, lval *v);
+
+/* Emit code evaluating `x` into a new temporary and return its number. */
+static int lcomp_expr(struct lcomp *c, lval *x)
+{
+    if (x->type == LVAL_SEXPR)
+        return lcomp_list(c, x);
+
+    int t = ++c->tmp;
+    if (x->type == LVAL_SYM)
+        lcomp_line(c, "lval *t%d = lenv_get(e, lc_k[%d]);", t, lcomp_const(c, x));
+    else if (x->type == LVAL_NUM && x->num != LONG_MIN)
+        lcomp_line(c, "lval *t%d = lval_num(%ldL);", t, x->num);
+    else
+        lcomp_line(c, "lval *t%d = lval_copy(lc_k[%d]);", t, lcomp_const(c, x));
+    return t;
+}
+
+/* Leave the enclosing block with the error in `t` as the value of `r`. */
+static void lcomp_check(struct lcomp *c, lval *v, int t, int r, int owned)
+{
+    lcomp_line(c, "if (LVAL_IS_RAISED(t%d))", t);
+    lcomp_line(c, "{");
+    c->indent++;
+    if (owned)
+        lcomp_line(c, "lval_del(t%d);", r);
+    lcomp_line(c, "t%d = lerr_locate(t%d, %d, %d);", r, t, v->line, v->col);
+    lcomp_line(c, "break;");
+    c->indent--;
+    lcomp_line(c, "}");
+}
+
+/* `if` with Q-Expression branches runs the chosen branch directly. */
+static int lcomp_if(struct lcomp *c, lval *v)
+{
+    int r = ++c->tmp;
+    lcomp_line(c, "lval *t%d;", r);
+    lcomp_line(c, "do");
+    lcomp_line(c, "{");
+    c->indent++;
+
+    int t = lcomp_expr(c, v->cell[1]);
+    if (lcomp_may_raise(v->cell[1]))
+        lcomp_check(c, v, t, r, 0);
+    lcomp_line(c, "if (t%d->type != LVAL_BOOL)", t);
+    lcomp_line(c, "{");
+    c->indent++;
+    lcomp_line(c, "/* Let `if` report the wrong type. */");
+    lcomp_line(c, "t%d = builtin_if(e, lc_list(lval_sexpr(), %d, %d, 3, t%d, lval_copy(lc_k[%d]), lval_copy(lc_k[%d])));",
+               r, v->line, v->col, t, lcomp_const(c, v->cell[2]), lcomp_const(c, v->cell[3]));
+    lcomp_line(c, "t%d = lerr_locate(t%d, %d, %d);", r, r, v->line, v->col);
+    lcomp_line(c, "break;");
+    c->indent--;
+    lcomp_line(c, "}");
+
+    for (int i = 2; i <= 3; i++)
+    {
+        lcomp_line(c, i == 2 ? "if (t%d->num)" : "else", t);
+        lcomp_line(c, "{");
+        c->indent++;
+        lcomp_line(c, "lval_del(t%d);", t);
+        int b = lcomp_list(c, v->cell[i]);
+        lcomp_line(c, "t%d = lerr_locate(t%d, %d, %d);", r, b, v->line, v->col);
+        c->indent--;
+        lcomp_line(c, "}");
+    }
+
+    c->indent--;
+    lcomp_line(c, "} while (0);");
+    return r;
+}
+
+/* Evaluate the elements of `v` as an S-Expression, like `lval_eval_sexpr`. */
+static int lcomp_list(struct lcomp *c, lval *v)
+{
+    if (v->count == 4 && v->cell[0]->type == LVAL_SYM && STR_EQ(v->cell[0]->sym, "if") &&
+        v->cell[2]->type == LVAL_QEXPR && v->cell[3]->type == LVAL_QEXPR)
+        return lcomp_if(c, v);
+
+    int r = ++c->tmp;
+    lcomp_line(c, "lval *t%d = lc_list(lval_sexpr(), %d, %d, 0);", r, v->line, v->col);
+    lcomp_line(c, "do");
+    lcomp_line(c, "{");
+    c->indent++;
+    for (int i = 0; i < v->count; i++)
+    {
+        int t = lcomp_expr(c, v->cell[i]);
+        if (lcomp_may_raise(v->cell[i]))
+            lcomp_check(c, v, t, r, 1);
+        lcomp_line(c, "lval_add(t%d, t%d);", r, t);
+    }
+    lcomp_line(c, "t%d = lval_apply(e, t%d);", r, r);
+    c->indent--;
+    lcomp_line(c, "} while (0);");
+    return r;
+}
+
+/************* Top-level forms ****************/
+/* Whether `v` mentions the symbol `name` anywhere. */
+static int lcomp_mentions(lval *v, const char *name)
+{
+    if (v->type == LVAL_SYM)
+        return STR_EQ(v->sym, name);
+    if (v->type != LVAL_SEXPR && v->type != LVAL_QEXPR)
+        return 0;
+    for (int i = 0; i < v->count; i++)
+    {
+        if (lcomp_mentions(v->cell[i], name))
+            return 1;
+    }
+    return 0;
+}
+
+/* Whether `v` holds a value of type `t`, or is one. */
+static int lcomp_mentions_type(lval *v, enum lval_type t)
+{
+    if (v->type == t)
+        return 1;
+    if (v->type != LVAL_SEXPR && v->type != LVAL_QEXPR)
+        return 0;
+    for (int i = 0; i < v->count; i++)
+    {
+        if (lcomp_mentions_type(v->cell[i], t))
+            return 1;
+    }
+    return 0;
+}
+
+/* Fewest arguments any list headed by `name` passes it. */
+static int lcomp_min_args(lval *v, const char *name)
+{
+    if (v->type != LVAL_SEXPR && v->type != LVAL_QEXPR)
+        return INT_MAX;
+    int n = INT_MAX;
+    if (v->count && v->cell[0]->type == LVAL_SYM && v->cell[0]->sym == name)
+        n = v->count - 1;
+    for (int i = 0; i < v->count; i++)
+    {
+        int m = lcomp_min_args(v->cell[i], name);
+        n = m < n ? m : n;
+    }
+    return n;
+}
+
+/* `(fun {name formals...} {body})` with plain formals, never partially
+    applied in the program, can become a builtin. Without formals it could
+    never be called, so it stays a lambda.
+*/
+static int lcomp_is_fun(lval *prog, lval *x)
+{
+    if (x->type != LVAL_SEXPR || x->count != 3 || x->cell[0]->type != LVAL_SYM ||
+        !STR_EQ(x->cell[0]->sym, "fun") || x->cell[1]->type != LVAL_QEXPR ||
+        x->cell[2]->type != LVAL_QEXPR || x->cell[1]->count < 2)
+        return 0;
+
+    lval *decl = x->cell[1];
+    for (int i = 0; i < decl->count; i++)
+    {
+        if (decl->cell[i]->type != LVAL_SYM || STR_EQ(decl->cell[i]->sym, "&"))
+            return 0;
+    }
+    return lcomp_min_args(prog, decl->cell[0]->sym) >= decl->count - 1;
+}
+
+static void lcomp_fun(struct lcomp *c, lval *x, int index)
+{
+    lval *decl = x->cell[1];
+    int name = lcomp_const(c, decl->cell[0]);
+    int n = decl->count - 1;
+    c->tmp = 0;
+
+    /* Names may hold the end of a comment. */
+    if (!strstr(decl->cell[0]->sym, "*/"))
+        lcomp_line(c, "/* %.200s, line %d */", decl->cell[0]->sym, x->line);
+    lcomp_line(c, "static lval *lc_fun_%d(lenv *caller, lval *a)", index);
+    lcomp_line(c, "{");
+    c->indent++;
+    lcomp_line(c, "LASSERT(a, a->count == %d, \"Function '%%s' passed wrong number of arguments. \"", n);
+    lcomp_line(c, "                          \"Got %%d, Expected %%d.\",");
+    lcomp_line(c, "        lc_k[%d]->sym, a->count, %d);", name, n);
+    lcomp_line(c, "if (lheap_take_exceeded())");
+    lcomp_line(c, "{");
+    lcomp_line(c, "    lval_del(a);");
+    lcomp_line(c, "    return lval_err_code(LERR_HEAP);");
+    lcomp_line(c, "}");
+    lw_putc(&c->fns, '\n');
+
+    /* Bind the arguments as a lambda call does, callees still see them. */
+    lcomp_line(c, "lenv frame;");
+    lcomp_line(c, "lenv *e = &frame;");
+    lcomp_line(c, "lenv_push(e, caller, %d);", n);
+    for (int i = 0; i < n; i++)
+        lcomp_line(c, "lenv_bind(e, lc_k[%d], a->cell[%d]);", lcomp_const(c, decl->cell[i + 1]), i);
+    lcomp_line(c, "a->count = 0;");
+    lcomp_line(c, "lval_del(a);");
+    lw_putc(&c->fns, '\n');
+
+    int r = lcomp_list(c, x->cell[2]);
+    lcomp_line(c, "lenv_pop(e);");
+    lcomp_line(c, "return t%d;", r);
+    c->indent--;
+    lcomp_line(c, "}");
+    lw_putc(&c->fns, '\n');
+}
+
+static const char lcomp_prelude[] =
+    "#include <stdlib.h>\n"
+    "#include <stdarg.h>\n"
+    "#include <limits.h>\n"
+    "#include <unistd.h>\n"
+    "\n"
+    "#include \"eval.h\"\n"
+    "#include \"heap.h\"\n"
+    "#include \"bignum.h\"\n"
+    "#include \"writer.h\"\n"
+    "#include \"macro.h\"\n"
+    "#include \"opt.h\"\n"
+    "#include \"grammar.h\"\n"
+    "#include \"module.h\"\n"
+    "\n";
+
+/* Helpers, only emitted when the program needs them. */
+static const char lcomp_prelude_list[] =
+    "/* A list at a source position, with `n` elements. */\n"
+    "static lval *lc_list(lval *v, int line, int col, int n, ...)\n"
+    "{\n"
+    "    va_list va;\n"
+    "    va_start(va, n);\n"
+    "    for (int i = 0; i < n; i++)\n"
+    "        lval_add(v, va_arg(va, lval *));\n"
+    "    va_end(va);\n"
+    "    v->line = line;\n"
+    "    v->col = col;\n"
+    "    return v;\n"
+    "}\n"
+    "\n";
+
+static const char lcomp_prelude_str[] =
+    "static lval *lc_str(const char *s, long len)\n"
+    "{\n"
+    "    char *p = lheap_alloc(LVAL_STR, len + 1);\n"
+    "    memcpy(p, s, len + 1);\n"
+    "    return lval_str_take(p, len);\n"
+    "}\n"
+    "\n";
+
+static const char lcomp_main[] =
+    "int main(void)\n"
+    "{\n"
+    "    /* Show output line by line on a terminal, in big blocks otherwise. */\n"
+    "    lw_out.line_buffered = isatty(STDOUT_FILENO);\n"
+    "\n"
+    "    lenv *e = lenv_new();\n"
+    "    e->global = true;\n"
+    "    lenv_add_builtins(e);\n"
+    "    lc_init();\n"
+    "\n"
+    "    for (int i = 0; lc_steps[i].fun || lc_steps[i].form >= 0; i++)\n"
+    "    {\n"
+    "        if (lc_steps[i].fun)\n"
+    "        {\n"
+    "            lenv_add_builtin(e, lc_steps[i].name, lc_steps[i].fun);\n"
+    "            continue;\n"
+    "        }\n"
+    "\n"
+    "        /* Evaluate the form as `load` does. */\n"
+    "        lheap_take_exceeded();\n"
+    "        lval *x = lval_eval(e, lval_optimize(e, lval_expand(e, lval_copy(lc_k[lc_steps[i].form]))));\n"
+    "        if (LVAL_IS_RAISED(x) && x->code == LERR_EXIT)\n"
+    "        {\n"
+    "            lval_del(x);\n"
+    "            break;\n"
+    "        }\n"
+    "        if (LVAL_IS_RAISED(x))\n"
+    "        {\n"
+    "            lval_println(e, x);\n"
+    "        }\n"
+    "        lval_del(x);\n"
+    "    }\n"
+    "\n"
+    "    for (int i = 0; i < LC_NCONSTS; i++)\n"
+    "        lval_del(lc_k[i]);\n"
+    "    lenv_del(e);\n"
+    "    lmod_cleanup();\n"
+    "    lw_flush(&lw_out);\n"
+    "    lgrammar_cleanup();\n"
+    "\n"
+    "    return EXIT_SUCCESS;\n"
+    "}\n";
+
+/************* Translation ****************/
+int lcomp_file(const char *in, const char *out)
+{
+    lgrammar_init();
+    mpc_result_t r;
+    if (!lgrammar_parse_file(in, &r))
+    {
+        mpc_err_print_to(r.error, stderr);
+        mpc_err_delete(r.error);
+        return 0;
+    }
+    lval *prog = lval_read(r.output);
+    mpc_view_delete(r.output);
+
+    struct lcomp c;
+    lw_open_mem(&c.fns);
+    c.consts = lval_qexpr();
+    c.tmp = 0;
+    c.indent = 0;
+
+    /* Macros rewrite code when it is loaded, so leave everything to them. */
+    int macros = lcomp_mentions(prog, "defmacro");
+
+    lwriter steps;
+    lw_open_mem(&steps);
+    int ok = 1;
+    for (int i = 0; i < prog->count && ok; i++)
+    {
+        lval *x = prog->cell[i];
+        if (!macros && lcomp_is_fun(prog, x))
+        {
+            lcomp_fun(&c, x, i);
+            lw_puts(&steps, "    {");
+            lcomp_write_cstr(&steps, x->cell[1]->cell[0]->sym, strlen(x->cell[1]->cell[0]->sym));
+            lw_printf(&steps, ", lc_fun_%d, -1},\n", i);
+        }
+        else
+        {
+            lw_printf(&steps, "    {NULL, NULL, %d},\n", lcomp_const(&c, x));
+        }
+    }
+
+    /* Assemble the file now that the constant pool is complete. */
+    lwriter w;
+    lw_open_mem(&w);
+    lw_puts(&w, "/* Generated by lispy --compile-c from ");
+    lw_puts(&w, strstr(in, "*/") ? "a script" : in);
+    lw_puts(&w, ", do not edit. */\n");
+    lw_puts(&w, lcomp_prelude);
+    int lists = c.fns.len > 0, strs = 0;
+    for (int i = 0; i < c.consts->count; i++)
+    {
+        lists |= lcomp_mentions_type(c.consts->cell[i], LVAL_SEXPR) || lcomp_mentions_type(c.consts->cell[i], LVAL_QEXPR);
+        strs |= lcomp_mentions_type(c.consts->cell[i], LVAL_STR);
+    }
+    if (lists)
+        lw_puts(&w, lcomp_prelude_list);
+    if (strs)
+        lw_puts(&w, lcomp_prelude_str);
+    lw_printf(&w, "#define LC_NCONSTS %d\n", c.consts->count);
+    lw_puts(&w, "static lval *lc_k[LC_NCONSTS + 1];\n\n");
+
+    lval *fns = lw_take_str(&c.fns);
+    lw_write(&w, fns->str, fns->len);
+    lval_del(fns);
+
+    lw_puts(&w, "static void lc_init(void)\n{\n");
+    for (int i = 0; i < c.consts->count && ok; i++)
+    {
+        lw_printf(&w, "    lc_k[%d] = ", i);
+        ok = lcomp_build(&w, c.consts->cell[i]);
+        lw_puts(&w, ";\n");
+    }
+    lw_puts(&w, "}\n\n");
+
+    lw_puts(&w, "/* Top-level forms in order, a compiled `fun` or a form to evaluate. */\n"
+                "static const struct\n{\n    char *name;\n    lbuiltin fun;\n    int form;\n} lc_steps[] = {\n");
+    lval *s = lw_take_str(&steps);
+    lw_write(&w, s->str, s->len);
+    lval_del(s);
+    lw_puts(&w, "    {NULL, NULL, -1},\n};\n\n");
+    lw_puts(&w, lcomp_main);
+
+    lval *text = lw_take_str(&w);
+    lval_del(c.consts);
+    lval_del(prog);
+    if (!ok)
+    {
+        lval_del(text);
+        return 0;
+    }
+
+    FILE *f = out ? fopen(out, "w") : stdout;
+    if (!f)
+    {
+        fprintf(stderr, "Could not open '%s' for writing.\n", out);
+        lval_del(text);
+        return 0;
+    }
+    ok = fwrite(text->str, 1, text->len, f) == (size_t)text->len;
+    if (out)
+        ok = fclose(f) == 0 && ok;
+    else
+        ok = fflush(f) == 0 && ok;
+    if (!ok)
+        fprintf(stderr, "Could not write '%s'.\n", out ? out : "<stdout>");
+    lval_del(text);
+    return ok;
+}
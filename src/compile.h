@@ -0,0 +1,16 @@
+#ifndef _LISPY_COMPILE
+#define _LISPY_COMPILE
+
+/* Translate the program in the file `in` into a C program written to
+    `out`, or to the standard output when `out` is NULL. Returns 1 on
+    success, otherwise prints the problem to stderr and returns 0.
+
+    Top-level `fun` forms become C functions registered as builtins, all
+    other forms are built as data at start up and handed to `lval_eval`
+    in order, so the program never runs the parser. The output links with
+    the `lispyrt` library, every source file but main.c, and mpc, plus
+    libm and pthread.
+*/
+int lcomp_file(const char *in, const char *out);
+
+#endif
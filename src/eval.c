@@ -1,58 +1,187 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
 
 #include "mpc.h"
 #include "eval.h"
-
-extern mpc_parser_t *Lispy;
+#include "heap.h"
+#include "vec.h"
+#include "bignum.h"
+#include "map.h"
+#include "strbuf.h"
+#include "writer.h"
+#include "macro.h"
+#include "symbol.h"
+#include "jit.h"
+#include "grammar.h"
+#include "opt.h"
+#include "module.h"
+#include "scan.h"
 
 /************* Functions to manipulate the environment. ****************/
 lenv *lenv_new(void)
 {
-    lenv *e = malloc(sizeof(lenv));
+    lenv *e = lheap_alloc(LHEAP_ENV, sizeof(lenv));
     e->par = NULL;
     e->count = 0;
     e->dicts = NULL;
+    e->global = false;
+    e->mod = NULL;
+    e->slots = 0;
+    e->stacked = false;
     return e;
 }
 
+/* The evaluation stack grows by chunks, the bindings of a call all lie in
+    one of them, so they stay in place while deeper calls come and go.
+*/
+#define LSTACK_CHUNK 4096
+struct lstack_chunk
+{
+    struct lstack_chunk *prev;
+    int top;
+    int cap;
+    struct env_map slots[];
+};
+static struct lstack_chunk *lstack;
+/* Last chunk emptied, kept for recursion going back and forth across the
+    end of a chunk.
+*/
+static struct lstack_chunk *lstack_spare;
+
+void lenv_push(lenv *e, lenv *par, int n)
+{
+    struct lstack_chunk *s = lstack;
+    if (!s || s->top + n > s->cap)
+    {
+        if (lstack_spare && lstack_spare->cap >= n)
+        {
+            s = lstack_spare;
+            lstack_spare = NULL;
+        }
+        else
+        {
+            int cap = n > LSTACK_CHUNK ? n : LSTACK_CHUNK;
+            s = lheap_alloc(LHEAP_ENV, sizeof(struct lstack_chunk) + sizeof(struct env_map) * cap);
+            s->cap = cap;
+        }
+        s->top = 0;
+        s->prev = lstack;
+        lstack = s;
+    }
+
+    e->par = par;
+    e->count = 0;
+    e->dicts = s->slots + s->top;
+    e->global = false;
+    e->mod = par->mod;
+    e->slots = n;
+    e->stacked = true;
+    s->top += n;
+}
+
+void lenv_pop(lenv *e)
+{
+    for (int i = 0; i < e->count; i++)
+    {
+        lval_del(e->dicts[i].val);
+    }
+    if (!e->stacked)
+        lheap_free(e->dicts);
+
+    struct lstack_chunk *s = lstack;
+    s->top -= e->slots;
+    if (s->top == 0 && s->prev)
+    {
+        lstack = s->prev;
+        lheap_free(lstack_spare);
+        lstack_spare = s;
+    }
+}
+
 void lenv_del(lenv *e)
 {
+    /* Names are interned, only the values belong to the environment. */
     for (int i = 0; i < e->count; i++)
     {
-        free(e->dicts[i].sym);
         lval_del(e->dicts[i].val);
     }
-    free(e->dicts);
-    free(e);
+    lheap_free(e->dicts);
+    lheap_free(e);
 }
 
 lval *lenv_get(lenv *e, lval *k)
 {
-    /* Iterate over all items in environment */
-    for (int i = 0; i < e->count; i++)
+    /* A global binding resolved here before, and nothing redefined since. */
+    struct lic *ic = k->ic;
+    if (ic->version == lenv_version && !ic->rec->local)
     {
-        /* Check if the stored string mathces the symbol string.
-            If it does, return a copy of the value.
-        */
-        if (STR_EQ(e->dicts[i].sym, k->sym))
+        return lval_copy(ic->env->dicts[ic->index].val);
+    }
+
+    /* Qualified names look in the namespace of an imported module only. */
+    struct lsym *ns = ic->rec->ns;
+    if (ns && ns->module)
+    {
+        lenv *m = ns->module;
+        for (int i = 0; i < m->count; i++)
         {
-            return lval_copy(e->dicts[i].val);
+            if (m->dicts[i].sym == ic->rec->member->name)
+            {
+                ic->env = m;
+                ic->index = i;
+                ic->version = lenv_version;
+                return lval_copy(m->dicts[i].val);
+            }
         }
+        e = NULL;
     }
 
-    /* If no symbol check in parent otherwise error. */
-    if (e->par)
+    /* Walk the environment chain, names compare by pointer. */
+    for (; e; e = e->par)
     {
-        return lenv_get(e->par, k);
+        for (int i = 0; i < e->count; i++)
+        {
+            if (e->dicts[i].sym == k->sym)
+            {
+                /* Remember global bindings no local binding can shadow. */
+                if (e->global && !ic->rec->local)
+                {
+                    ic->env = e;
+                    ic->index = i;
+                    ic->version = lenv_version;
+                }
+                return lval_copy(e->dicts[i].val);
+            }
+        }
     }
 
-    return lval_err("Unbound symbol '%s'", k->sym);
+    lval *err = lval_err("Unbound symbol '%s'", k->sym);
+    err->code = LERR_UNBOUND;
+    return err;
+}
+
+/* Global changes invalidate the inline caches, local bindings stop the
+    name from being cached at all.
+*/
+static void lenv_changed(lenv *e, lval *k)
+{
+    if (e->global)
+        lenv_version++;
+    else if (!k->ic->rec->local || e->mod == e)
+    {
+        /* Module bindings also shadow global ones, and qualified names cache them. */
+        /* Compiled code may rely on the name being global. */
+        k->ic->rec->local = true;
+        lenv_version++;
+    }
 }
 
 void lenv_put(lenv *e, lval *k, lval *v)
 {
+    lenv_changed(e, k);
+
     /* Iterate over all items in environment */
     /* This is to see if variable already exists. */
     for (int i = 0; i < e->count; i++)
@@ -60,7 +189,7 @@ void lenv_put(lenv *e, lval *k, lval *v)
         /* If variable is found delete the old item at that position.
             And replace with variable supplied by user.
         */
-        if (STR_EQ(e->dicts[i].sym, k->sym))
+        if (e->dicts[i].sym == k->sym)
         {
             lval_del(e->dicts[i].val);
             e->dicts[i].val = lval_copy(v);
@@ -69,27 +198,63 @@ void lenv_put(lenv *e, lval *k, lval *v)
     }
 
     /* If no existing entry found, allocate space for new entry. */
+    if (!e->stacked)
+    {
+        e->dicts = lheap_realloc(LHEAP_ENV, e->dicts, (e->count + 1) * sizeof(struct env_map));
+    }
+    else if (e->count == e->slots)
+    {
+        /* Out of room on the evaluation stack, go on on the heap. */
+        struct env_map *dicts = lheap_alloc(LHEAP_ENV, (e->count + 1) * sizeof(struct env_map));
+        memcpy(dicts, e->dicts, e->count * sizeof(struct env_map));
+        e->dicts = dicts;
+        e->stacked = false;
+    }
     e->count++;
-    e->dicts = realloc(e->dicts, e->count * sizeof(struct env_map));
 
     /* Copy contents of lval and symbol string into new location. */
     e->dicts[e->count - 1].val = lval_copy(v);
-    e->dicts[e->count - 1].sym = malloc(strlen(k->sym) + 1);
-    strcpy(e->dicts[e->count - 1].sym, k->sym);
+    e->dicts[e->count - 1].sym = k->sym;
+}
+
+void lenv_bind(lenv *e, lval *k, lval *v)
+{
+    lenv_changed(e, k);
+    e->dicts[e->count].sym = k->sym;
+    e->dicts[e->count].val = v;
+    e->count++;
+}
+
+static struct lpart *lpart_ref(struct lpart *p)
+{
+    if (p)
+        p->refs++;
+    return p;
+}
+
+static void lpart_unref(struct lpart *p)
+{
+    while (p && --p->refs == 0)
+    {
+        struct lpart *prev = p->prev;
+        for (int i = 0; i < p->count; i++)
+            lval_del(p->vals[i]);
+        lheap_free(p);
+        p = prev;
+    }
 }
 
 lenv *lenv_copy(lenv *e)
 {
     lenv *x = lenv_new();
     x->par = e->par;
+    x->mod = e->mod;
     x->count = e->count;
-    x->dicts = malloc(sizeof(struct env_map) * x->count);
+    x->dicts = lheap_alloc(LHEAP_ENV, sizeof(struct env_map) * x->count);
 
     for (int i = 0; i < e->count; i++)
     {
-        x->dicts[i].sym = malloc(strlen(e->dicts[i].sym) + 1);
-        strcpy(x->dicts[i].sym, e->dicts[i].sym);
-
+        x->dicts[i].sym = e->dicts[i].sym;
         x->dicts[i].val = lval_copy(e->dicts[i].val);
     }
 
@@ -98,8 +263,8 @@ lenv *lenv_copy(lenv *e)
 
 void lenv_def(lenv *e, lval *k, lval *v)
 {
-    /* Iterate till e has no parent */
-    while (e->par)
+    /* Iterate till e has no parent, or is the module being run */
+    while (e->par && e->mod != e)
     {
         e = e->par;
     }
@@ -126,29 +291,62 @@ lval *builtin_print_env(lenv *e, lval *a)
     LASSERT(a, a->count == 0, "'_Env' invalidly called. "
         "It should called without any argument.");
 
-    puts("\n******* All the Variables in the Environment *******");
+    lw_puts(&lw_out, "\n******* All the Variables in the Environment *******\n");
     for (int i = 0; i < e->count; i++)
     {
-        printf("%s = ", e->dicts[i].sym);
+        lw_printf(&lw_out, "%s = ", e->dicts[i].sym);
         lval_println(e, e->dicts[i].val);
     }
-    puts("");
+    lw_endline(&lw_out);
     return lval_sexpr();
 }
 
 /************************ Evaluate the AST ********************/
+/* Builtins that run when they stand alone in an S-Expression, instead of
+    evaluating to themselves.
+*/
+static lbuiltin const lval_nullary[] = {
+    builtin_print_env,
+    builtin_heap,
+    lispy_exit,
+    builtin_map_new,
+    builtin_sb_new,
+};
+
+/* Record where an error came from, unless a deeper expression already did. */
+lval *lerr_locate(lval *x, int line, int col)
+{
+    if (LVAL_IS_RAISED(x) && x->err_line == 0)
+    {
+        x->err_line = line;
+        x->err_col = col;
+    }
+    return x;
+}
+
 lval *lval_eval_sexpr(lenv *e, lval *v)
 {
+    int line = v->line;
+    int col = v->col;
+
     /* Evaluate the children. */
     for (int i = 0; i < v->count; i++)
     {
         v->cell[i] = lval_eval(e, v->cell[i]);
 
         /* If Error happens, return this error. */
-        if (v->cell[i]->type == LVAL_ERR)
-            return lval_take(v, i);
+        if (LVAL_IS_RAISED(v->cell[i]))
+            return lerr_locate(lval_take(v, i), line, col);
     }
 
+    return lval_apply(e, v);
+}
+
+lval *lval_apply(lenv *e, lval *v)
+{
+    int line = v->line;
+    int col = v->col;
+
     /* Empty Expreesion */
     if (v->count == 0)
         return v;
@@ -157,13 +355,15 @@ lval *lval_eval_sexpr(lenv *e, lval *v)
     if (v->count == 1)
     {
         lval *x = lval_take(v, 0);
-        if (x->type == LVAL_FUN && x->builtin == builtin_print_env)
-        {
-            return builtin_print_env(e, lval_sexpr());
-        }
-        if (x->type == LVAL_FUN && x->builtin == lispy_exit)
+        if (x->type != LVAL_FUN || !x->builtin)
+            return x;
+        for (size_t i = 0; i < sizeof(lval_nullary) / sizeof(lval_nullary[0]); i++)
         {
-            return lispy_exit(e, lval_sexpr());
+            if (x->builtin == lval_nullary[i])
+            {
+                lval_del(x);
+                return lval_nullary[i](e, lval_sexpr());
+            }
         }
         return x;
     }
@@ -177,17 +377,24 @@ lval *lval_eval_sexpr(lenv *e, lval *v)
                              ltype_name(f->type), ltype_name(LVAL_FUN));
         lval_del(f);
         lval_del(v);
-        return err;
+        return lerr_locate(err, line, col);
     }
 
     /* If so call function to get result. */
     lval *result = lval_call(e, f, v);
     lval_del(f);
-    return result;
+    return lerr_locate(result, line, col);
 }
 
 lval *lval_eval(lenv *e, lval *v)
 {
+    /* Stop the job as soon as it has grown past the heap limit. */
+    if (lheap_take_exceeded())
+    {
+        lval_del(v);
+        return lval_err_code(LERR_HEAP);
+    }
+
     if (v->type == LVAL_SYM)
     {
         lval *x = lenv_get(e, v);
@@ -217,7 +424,7 @@ lval *lval_pop(lval *v, int i)
     v->count--;
 
     /** Reallocate the memory used. */
-    v->cell = realloc(v->cell, sizeof(lval *) * v->count);
+    v->cell = lheap_realloc(v->type, v->cell, sizeof(lval *) * v->count);
 
     return x;
 }
@@ -229,55 +436,162 @@ lval *lval_take(lval *v, int i)
     return x;
 }
 
+/* Outcome of one step of integer arithmetic. */
+enum lnum_status
+{
+    LNUM_OK,
+    LNUM_DIV_ZERO,
+    LNUM_OVERFLOW,
+};
+
+/* Fold one step of integer arithmetic, detecting overflow. */
+static enum lnum_status lnum_step(char op, long *x, long y)
+{
+    switch (op)
+    {
+    case '+':
+        return __builtin_add_overflow(*x, y, x) ? LNUM_OVERFLOW : LNUM_OK;
+    case '-':
+        return __builtin_sub_overflow(*x, y, x) ? LNUM_OVERFLOW : LNUM_OK;
+    case '*':
+        return __builtin_mul_overflow(*x, y, x) ? LNUM_OVERFLOW : LNUM_OK;
+    case '/':
+    case '%':
+        if (y == 0)
+            return LNUM_DIV_ZERO;
+        if (*x == LONG_MIN && y == -1)
+            return LNUM_OVERFLOW;
+        *x = op == '/' ? *x / y : *x % y;
+        break;
+    }
+    return LNUM_OK;
+}
+
+/* Fold one step of floating point arithmetic. Returns 0 on division by zero. */
+static int ldbl_step(char op, double *x, double y)
+{
+    switch (op)
+    {
+    case '+':
+        *x += y;
+        break;
+    case '-':
+        *x -= y;
+        break;
+    case '*':
+        *x *= y;
+        break;
+    case '/':
+        if (y == 0.0)
+            return 0;
+        *x /= y;
+        break;
+    }
+    return 1;
+}
+
 lval *builtin_op(lenv *e, lval *a, char *op)
 {
-    /* Ensure all arguments are numbers */
+    LASSERT(a, a->count >= 1, "Operator '%s' expects %d or more arguments, "
+        "but got only %d.", op, 1, a->count);
+
+    /* Ensure all arguments are numbers or vectors */
+    int vec = 0;
+    int big = 0;
+    int dbl = 0;
     for (int i = 0; i < a->count; i++)
     {
         a->cell[i] = lval_eval(e, a->cell[i]);
-        if (a->cell[i]->type != LVAL_NUM)
+        switch (a->cell[i]->type)
         {
+        case LVAL_F64VEC:
+        case LVAL_I64VEC:
+            vec = 1;
+            break;
+        case LVAL_BIG:
+            big = 1;
+            break;
+        case LVAL_DBL:
+            dbl = 1;
+            /* fall through */
+        case LVAL_NUM:
+            break;
+        default:
+        {
+            lval *err = lval_err("Operator '%s' expects %s as arguments at pos %d, but got %s.",
+                                 op, ltype_name(LVAL_NUM), i, ltype_name(a->cell[i]->type));
             lval_del(a);
-            return lval_err("Operator '%s' expects %s as arguments at pos %d, but got %s.",
-                            op, ltype_name(LVAL_NUM), i, ltype_name(a->cell[i]->type));
+            return err;
+        }
         }
     }
 
-    /* Pop the first element */
-    lval *x = lval_pop(a, 0);
+    char o = op[0];
+    LASSERT(a, o != '%' || !(vec || dbl), "Operator '%s' expects integers.", op);
+    LASSERT(a, !(vec && big), "Operator '%s' cannot mix vectors and %s.", op,
+            ltype_name(LVAL_BIG));
+
+    /* Elementwise arithmetic runs in the vector kernels. */
+    if (vec)
+        return lvec_op(a, op);
+
+    /* Bignum operands take the generic path. */
+    if (big)
+        return lbig_op(a, op);
+
+    /* Accumulate in unboxed registers, staying with integers until the first
+        double shows up and continuing in double precision from there on.
+    */
+    int i = 1;
+    enum lnum_status st = LNUM_OK;
+    long n = 0;
+    double d = 0.0;
+    lval *x;
+
+    dbl = a->cell[0]->type == LVAL_DBL;
+    if (dbl)
+        d = a->cell[0]->dbl;
+    else
+        n = a->cell[0]->num;
 
     /* If no arguments and sub then perform unary negation. */
-    if (STR_EQ(op, "-") && a->count == 0)
+    if (o == '-' && a->count == 1)
     {
-        x->num = -x->num;
+        if (!dbl && __builtin_sub_overflow(0, n, &n))
+            st = LNUM_OVERFLOW;
+        d = -d;
     }
 
-    /* While there are still elements remaining */
-    while (a->count > 0)
+    /* Integer only prefix. */
+    if (!dbl)
     {
-        /* Pop the next element */
-        lval *y = lval_pop(a, 0);
+        for (; st == LNUM_OK && i < a->count && a->cell[i]->type == LVAL_NUM; i++)
+            st = lnum_step(o, &n, a->cell[i]->num);
 
-        if (STR_EQ(op, "+"))
-            x->num += y->num;
-        if (STR_EQ(op, "-"))
-            x->num -= y->num;
-        if (STR_EQ(op, "*"))
-            x->num *= y->num;
-        if (STR_EQ(op, "/"))
+        /* Promote to bignums and redo the fold once a long overflows. */
+        if (st == LNUM_OVERFLOW)
+            return lbig_op(a, op);
+
+        if (i < a->count)
         {
-            if (y->num == 0)
-            {
-                lval_del(x);
-                lval_del(y);
-                x = lval_err("Division by Zero.");
-                break;
-            }
-            x->num /= y->num;
+            dbl = 1;
+            d = (double)n;
         }
+    }
 
-        lval_del(y);
+    /* Double and mixed remainder. */
+    int ok = st == LNUM_OK;
+    for (; ok && i < a->count; i++)
+    {
+        lval *y = a->cell[i];
+        ok = ldbl_step(o, &d, y->type == LVAL_DBL ? y->dbl : (double)y->num);
     }
+
+    if (!ok)
+        x = lval_err_code(LERR_DIV_ZERO);
+    else
+        x = dbl ? lval_dbl(d) : lval_num(n);
+
     lval_del(a);
     return x;
 }
@@ -335,6 +649,9 @@ lval *builtin_eval(lenv *e, lval *a)
             "Got %d, Expected %d",
             a->count, 1);
     a->cell[0] = lval_eval(e, a->cell[0]);
+    /* Let errors raised while evaluating the argument pass through. */
+    if (LVAL_IS_RAISED(a->cell[0]))
+        return lval_take(a, 0);
     LASSERT(a, a->cell[0]->type == LVAL_QEXPR,
             "Function 'eval' passed incorrect type for argument 0. "
             "Got %s, Expected %s",
@@ -350,10 +667,13 @@ lval *builtin_join(lenv *e, lval *a)
     for (int i = 0; i < a->count; i++)
     {
         a->cell[i] = lval_eval(e, a->cell[i]);
+        /* Let errors raised while evaluating the argument pass through. */
+        if (LVAL_IS_RAISED(a->cell[i]))
+            return lval_take(a, i);
         LASSERT(a, a->cell[i]->type == LVAL_QEXPR,
                 "Function 'join' passed incorrect type for argument %d. "
                 "Got %s, Expected %s",
-                i, ltype_name(a->cell[0]->type), ltype_name(LVAL_QEXPR));
+                i, ltype_name(a->cell[i]->type), ltype_name(LVAL_QEXPR));
     }
 
     lval *x = lval_pop(a, 0);
@@ -398,6 +718,11 @@ lval *builtin_div(lenv *e, lval *a)
     return builtin_op(e, a, "/");
 }
 
+lval *builtin_mod(lenv *e, lval *a)
+{
+    return builtin_op(e, a, "%");
+}
+
 lval *builtin_def(lenv *e, lval *a)
 {
     return builtin_var(e, a, "def");
@@ -474,12 +799,21 @@ lval *builtin_lambda(lenv *e, lval *a)
                 i, ltype_name(a->cell[0]->cell[i]->type), ltype_name(LVAL_SYM));
     }
 
-    /* Pop first two arguments and pass them to lval_lambda. */
+    /* Pop first two arguments, expand macros in the body once, and pass
+        them to lval_lambda.
+    */
     lval *formals = lval_pop(a, 0);
-    lval *body = lval_pop(a, 0);
+    lval *body = lval_expand(e, lval_pop(a, 0));
     lval_del(a);
+    if (LVAL_IS_RAISED(body))
+    {
+        lval_del(formals);
+        return body;
+    }
 
-    return lval_lambda(formals, body);
+    lval *f = lval_lambda(formals, body);
+    f->mod = e->mod;
+    return f;
 }
 
 lval *builtin_fun(lenv *e, lval *a)
@@ -490,7 +824,15 @@ lval *builtin_fun(lenv *e, lval *a)
 
     lval *decl = lval_pop(a, 0);
     lval *fun_name = lval_pop(decl, 0);
+    a = lval_expand(e, a);
+    if (LVAL_IS_RAISED(a))
+    {
+        lval_del(decl);
+        lval_del(fun_name);
+        return a;
+    }
     lval *lambda = lval_lambda(decl, a);
+    lambda->mod = e->mod;
     lenv_def(e, fun_name, lambda);
     return lval_sexpr();
 }
@@ -515,27 +857,59 @@ lval *builtin_le(lenv *e, lval *a)
     return builtin_ord(e, a, "<=");
 }
 
+/* Three way compare of two numbers, bignums or doubles by exact value, so
+    large integers never meet a rounded copy of themselves. Returns 2 when
+    the pair is unordered because of NaN.
+*/
+static int lnum_cmp(lval *x, lval *y)
+{
+    if (x->type == LVAL_NUM && y->type == LVAL_NUM)
+        return (x->num > y->num) - (x->num < y->num);
+    if (x->type == LVAL_DBL && y->type == LVAL_DBL)
+        return x->dbl > y->dbl ? 1 : x->dbl < y->dbl ? -1 : x->dbl == y->dbl ? 0 : 2;
+    if (y->type == LVAL_DBL)
+        return lbig_cmp_dbl(x, y->dbl);
+    if (x->type == LVAL_DBL)
+    {
+        int c = lbig_cmp_dbl(y, x->dbl);
+        return c == 2 ? 2 : -c;
+    }
+    return lbig_cmp_lval(x, y);
+}
+
 lval *builtin_ord(lenv *e, lval *a, char *op)
 {
     LASSERT(a, a->count == 2, "Operator %s passed too many arguments. "
                               "Got %d, Expected %d.",
             op, a->count, 2);
-    LASSERT(a, a->cell[0]->type == LVAL_NUM, "Operator %s passed invalid type at pos %d. "
-                                             "Got %s, Expected %s.",
-            op, 0, ltype_name(a->cell[0]->type), ltype_name(LVAL_NUM));
-    LASSERT(a, a->cell[1]->type == LVAL_NUM, "Operator %s passed invalid type at pos %d. "
-                                             "Got %s, Expected %s.",
-            op, 1, ltype_name(a->cell[1]->type), ltype_name(LVAL_NUM));
+    /* Comparing a vector gives a vector of 0/1 results. */
+    for (int i = 0; i < 2; i++)
+    {
+        if (a->cell[i]->type == LVAL_F64VEC || a->cell[i]->type == LVAL_I64VEC)
+        {
+            LASSERT(a, LVAL_IS_NUMERIC(a->cell[1 - i]) || a->cell[1 - i]->type == LVAL_F64VEC ||
+                           a->cell[1 - i]->type == LVAL_I64VEC,
+                    "Operator %s passed invalid type at pos %d. Got %s, Expected %s.",
+                    op, 1 - i, ltype_name(a->cell[1 - i]->type), ltype_name(LVAL_NUM));
+            return lvec_ord(a, op);
+        }
+    }
 
-    int r;
-    if (STR_EQ(op, ">"))
-        r = a->cell[0]->num > a->cell[1]->num;
-    if (STR_EQ(op, "<"))
-        r = a->cell[0]->num < a->cell[1]->num;
-    if (STR_EQ(op, ">="))
-        r = a->cell[0]->num >= a->cell[1]->num;
-    if (STR_EQ(op, "<="))
-        r = a->cell[0]->num <= a->cell[1]->num;
+    for (int i = 0; i < 2; i++)
+    {
+        LASSERT(a, LVAL_IS_NUMERIC(a->cell[i]) || a->cell[i]->type == LVAL_BIG,
+                "Operator %s passed invalid type at pos %d. "
+                "Got %s, Expected %s.",
+                op, i, ltype_name(a->cell[i]->type), ltype_name(LVAL_NUM));
+    }
+
+    /* Any comparison involving NaN is false. */
+    int c = lnum_cmp(a->cell[0], a->cell[1]);
+    int r = 0;
+    if (op[0] == '>')
+        r = op[1] == '=' ? (c == 1 || c == 0) : c == 1;
+    else
+        r = op[1] == '=' ? (c == -1 || c == 0) : c == -1;
 
     lval_del(a);
     return lval_bool(r);
@@ -543,6 +917,11 @@ lval *builtin_ord(lenv *e, lval *a, char *op)
 
 int lval_eq(lval *x, lval *y)
 {
+    /* Integers, bignums and doubles compare by exact numeric value. */
+    if ((LVAL_IS_NUMERIC(x) || x->type == LVAL_BIG) && (LVAL_IS_NUMERIC(y) || y->type == LVAL_BIG) &&
+        x->type != y->type)
+        return lnum_cmp(x, y) == 0;
+
     /* Different types are always unequal. */
     if (x->type != y->type)
         return 0;
@@ -554,15 +933,34 @@ int lval_eq(lval *x, lval *y)
     case LVAL_BOOL:
     case LVAL_NUM:
         return (x->num == y->num);
+    case LVAL_DBL:
+        return (x->dbl == y->dbl);
+    case LVAL_BIG:
+        return lbig_cmp(x->big, y->big) == 0;
+
+    /* Compare vectors element by element */
+    case LVAL_F64VEC:
+    case LVAL_I64VEC:
+        return lvec_eq(x, y);
+
+    /* Maps are mutable, so only the same table is equal */
+    case LVAL_MAP:
+        return x->map == y->map;
 
     /* Compare String Values */
     case LVAL_ERR:
-        return STR_EQ(x->err, y->err);
+        if (x->code != y->code)
+            return 0;
+        return lerr_text(x) == lerr_text(y) || (x->err && y->err && STR_EQ(x->err, y->err));
     case LVAL_SYM:
-        return STR_EQ(x->sym, y->sym);
+        return x->sym == y->sym;
 
     case LVAL_STR:
-        return STR_EQ(x->str, y->str);
+        return x->len == y->len && memcmp(x->str, y->str, x->len) == 0;
+
+    /* Builders are mutable, so only the same builder is equal */
+    case LVAL_SB:
+        return x->sb == y->sb;
 
     /* If builtin compare, otherwise compare formals and body */
     case LVAL_FUN:
@@ -572,7 +970,7 @@ int lval_eq(lval *x, lval *y)
         }
         else
         {
-            return lval_eq(x->formals, y->formals) && lval_eq(x->body, y->body);
+            return x->bound == y->bound && lval_eq(x->formals, y->formals) && lval_eq(x->body, y->body);
         }
     /* If list compare every individual element */
     case LVAL_QEXPR:
@@ -764,11 +1162,36 @@ lval *builtin_bool(lenv *e, lval *a)
             b = x->num;
             lval_del(x);
             return b ? lval_bool(1) : lval_bool(0);
+        case LVAL_BIG:
+        /* Bignums are never zero. */
+            lval_del(x);
+            return lval_bool(1);
+        case LVAL_DBL:
+        /* If Double value, return false if 0.0, otherwise true. */
+            b = x->dbl != 0.0;
+            lval_del(x);
+            return lval_bool(b);
         case LVAL_STR:
         /* If String value, return false if "", otherwise true. */
-            b = STR_EQ(x->str, "");
+            b = x->len == 0;
             lval_del(x);
             return b ? lval_bool(0) : lval_bool(1);
+        case LVAL_F64VEC:
+        case LVAL_I64VEC:
+        /* If vector, return false if empty, otherwise true. */
+            b = x->vec->len != 0;
+            lval_del(x);
+            return lval_bool(b);
+        case LVAL_MAP:
+        /* If map, return false if empty, otherwise true. */
+            b = x->map->count != 0;
+            lval_del(x);
+            return lval_bool(b);
+        case LVAL_SB:
+        /* If string builder, return false if empty, otherwise true. */
+            b = x->sb->len != 0;
+            lval_del(x);
+            return lval_bool(b);
         case LVAL_QEXPR:
         case LVAL_SEXPR:
         /* If Q-Expression OR S-Expression, return false if empty, otherwise true. */
@@ -791,28 +1214,53 @@ lval *builtin_load(lenv *e, lval *a)
             "load", ltype_name(a->cell[0]->type), ltype_name(LVAL_STR));
 
     /* Parse file given by string name */
+    lgrammar_init();
+    lval *x = lscan_load(e, a->cell[0]->str);
+    if (x)
+    {
+        lval_del(a);
+        return x;
+    }
     mpc_result_t r;
-    if (mpc_parse_contents(a->cell[0]->str, Lispy, &r))
+    int ok = lgrammar_parse_file(a->cell[0]->str, &r);
+    lval_del(a);
+    return lval_load_result(e, ok, &r);
+}
+
+lval *lval_load_result(lenv *e, int ok, mpc_result_t *r)
+{
+    if (ok)
     {
         /* Read contents */
-        lval *expr = lval_read(r.output);
-        mpc_ast_delete(r.output);
+        lval *expr = lval_read(r->output);
+        mpc_view_delete(r->output);
 
-        /* Evaluate each Expression */
-        while (expr->count)
+        /* Evaluate each Expression, taking them over in turn. */
+        for (int i = 0; i < expr->count; i++)
         {
-            lval *x = lval_eval(e, lval_pop(expr, 0));
+            /* Each form starts over, whatever the previous one left behind. */
+            lheap_take_exceeded();
+            lval *x = lval_eval(e, lval_optimize(e, lval_expand(e, expr->cell[i])));
+            /* Stop loading on exit and hand it to the caller. */
+            if (LVAL_IS_RAISED(x) && x->code == LERR_EXIT)
+            {
+                for (int j = i + 1; j < expr->count; j++)
+                    lval_del(expr->cell[j]);
+                expr->count = 0;
+                lval_del(expr);
+                return x;
+            }
             /* If evaluation leads to error, print it. */
-            if (x->type == LVAL_ERR)
+            if (LVAL_IS_RAISED(x))
             {
                 lval_println(e, x);
             }
             lval_del(x);
         }
 
-        /* Delete expressions and arguments */
+        /* Delete the emptied list */
+        expr->count = 0;
         lval_del(expr);
-        lval_del(a);
 
         /* Return empty list */
         return lval_sexpr();
@@ -820,13 +1268,12 @@ lval *builtin_load(lenv *e, lval *a)
     else
     {
         /* Get Parse Error as string. */
-        char *err_msg = mpc_err_string(r.error);
-        mpc_err_delete(r.error);
+        char *err_msg = mpc_err_string(r->error);
+        mpc_err_delete(r->error);
 
         /* Create new error message using it */
         lval *err = lval_err("Could not load library %s", err_msg);
         free(err_msg);
-        lval_del(a);
 
         /* Clearn and return error. */
         return err;
@@ -839,16 +1286,29 @@ lval *builtin_print(lenv *e, lval *a)
     for (int i = 0; i < a->count; i++)
     {
         lval_print(e, a->cell[i]);
-        putchar(' ');
+        lw_putc(&lw_out, ' ');
     }
 
     /* Print a newline and delete arguments. */
-    putchar('\n');
+    lw_endline(&lw_out);
     lval_del(a);
 
     return lval_sexpr();
 }
 
+lval *builtin_to_string(lenv *e, lval *a)
+{
+    LASSERT(a, a->count == 1, "Function 'to-string' passed wrong number of arguments. "
+        "Got %d, Expected %d.", a->count, 1);
+
+    /* Print into memory, the result reads back as the same value. */
+    lwriter w;
+    lw_open_mem(&w);
+    lval_write(&w, e, a->cell[0]);
+    lval_del(a);
+    return lw_take_str(&w);
+}
+
 lval *builtin_error(lenv *e, lval *a)
 {
     LASSERT(a, a->count == 1, "Function 'error' passed wrong number of arguments. "
@@ -858,14 +1318,129 @@ lval *builtin_error(lenv *e, lval *a)
                                              "Got %s, Expected %s.",
             ltype_name(a->cell[0]->type), ltype_name(LVAL_STR));
 
-    /* Construct Error from first argument */
-    lval *err = lval_err(a->cell[0]->str);
+    /* Construct Error from first argument, taking over its buffer */
+    lval *s = lval_pop(a, 0);
+    lval *err = lval_err_code(LERR_USER);
+    err->err = s->str;
+    lheap_free(s);
 
     /* Delete arguments and return error. */
     lval_del(a);
     return err;
 }
 
+/* Exit and running out of heap always unwind to the top level. */
+static int lerr_catchable(lval *x)
+{
+    return LVAL_IS_RAISED(x) && x->code != LERR_EXIT && x->code != LERR_HEAP;
+}
+
+/* Evaluate a Q-Expression body the way `eval` does. */
+static lval *lval_eval_body(lenv *e, lval *body)
+{
+    body->type = LVAL_SEXPR;
+    return lval_eval(e, body);
+}
+
+lval *builtin_try(lenv *e, lval *a)
+{
+    LASSERT(a, a->count == 2, "Function 'try' passed wrong number of arguments. "
+                              "Got %d, Expected %d.",
+            a->count, 2);
+    LASSERT(a, a->cell[0]->type == LVAL_QEXPR, "Function 'try' passed invalid type for argument 0. "
+                                               "Got %s, Expected %s.",
+            ltype_name(a->cell[0]->type), ltype_name(LVAL_QEXPR));
+    LASSERT(a, a->cell[1]->type == LVAL_FUN, "Function 'try' passed invalid type for argument 1. "
+                                             "Got %s, Expected %s.",
+            ltype_name(a->cell[1]->type), ltype_name(LVAL_FUN));
+
+    lval *x = lval_eval_body(e, lval_pop(a, 0));
+    if (!lerr_catchable(x))
+    {
+        lval_del(a);
+        return x;
+    }
+
+    /* Hand the error to the handler as an ordinary value. */
+    x->caught = true;
+    lval *f = lval_pop(a, 0);
+    lval *r = lval_call(e, f, lval_add(a, x));
+    lval_del(f);
+    return r;
+}
+
+lval *builtin_catch(lenv *e, lval *a)
+{
+    LASSERT(a, a->count == 1, "Function 'catch' passed wrong number of arguments. "
+                              "Got %d, Expected %d.",
+            a->count, 1);
+    LASSERT(a, a->cell[0]->type == LVAL_QEXPR, "Function 'catch' passed invalid type. "
+                                               "Got %s, Expected %s.",
+            ltype_name(a->cell[0]->type), ltype_name(LVAL_QEXPR));
+
+    /* Return the error as a value instead of unwinding. */
+    lval *x = lval_eval_body(e, lval_take(a, 0));
+    if (lerr_catchable(x))
+        x->caught = true;
+    return x;
+}
+
+lval *builtin_throw(lenv *e, lval *a)
+{
+    LASSERT(a, a->count == 1, "Function 'throw' passed wrong number of arguments. "
+                              "Got %d, Expected %d.",
+            a->count, 1);
+    LASSERT(a, a->cell[0]->type == LVAL_ERR, "Function 'throw' passed invalid type. "
+                                             "Got %s, Expected %s.",
+            ltype_name(a->cell[0]->type), ltype_name(LVAL_ERR));
+
+    /* Raise a caught error again, keeping its code and position. */
+    lval *x = lval_take(a, 0);
+    x->caught = false;
+    return x;
+}
+
+#define LASSERT_CAUGHT(a, func)                                                    \
+    do                                                                             \
+    {                                                                              \
+        LASSERT(a, a->count == 1, "Function '%s' passed wrong number of arguments. " \
+                                  "Got %d, Expected %d.",                          \
+                func, a->count, 1);                                                \
+        LASSERT(a, a->cell[0]->type == LVAL_ERR, "Function '%s' passed invalid type. " \
+                                                 "Got %s, Expected %s.",           \
+                func, ltype_name(a->cell[0]->type), ltype_name(LVAL_ERR));         \
+    } while (0)
+
+lval *builtin_err_code(lenv *e, lval *a)
+{
+    LASSERT_CAUGHT(a, "err-code");
+    lval *x = lval_num(a->cell[0]->code);
+    lval_del(a);
+    return x;
+}
+
+lval *builtin_err_msg(lenv *e, lval *a)
+{
+    LASSERT_CAUGHT(a, "err-msg");
+
+    /* Fixed messages are only formatted here. */
+    lwriter w;
+    lw_open_mem(&w);
+    lerr_write_msg(&w, a->cell[0]);
+    lval_del(a);
+    return lw_take_str(&w);
+}
+
+lval *builtin_err_pos(lenv *e, lval *a)
+{
+    LASSERT_CAUGHT(a, "err-pos");
+    lval *x = lval_qexpr();
+    x = lval_add(x, lval_num(a->cell[0]->err_line));
+    x = lval_add(x, lval_num(a->cell[0]->err_col));
+    lval_del(a);
+    return x;
+}
+
 void lenv_add_builtin(lenv *e, char *name, lbuiltin func)
 {
     lval *k = lval_sym(name);
@@ -889,12 +1464,15 @@ void lenv_add_builtins(lenv *e)
     lenv_add_builtin(e, "-", builtin_sub);
     lenv_add_builtin(e, "*", builtin_mul);
     lenv_add_builtin(e, "/", builtin_div);
+    lenv_add_builtin(e, "%", builtin_mod);
 
     /* Variable Functions */
     lenv_add_builtin(e, "def", builtin_def);
 
     /* Print environment function */
     lenv_add_builtin(e, "_Env", builtin_print_env);
+    /* Print heap usage function */
+    lenv_add_builtin(e, "_Heap", builtin_heap);
 
     /* Exit function */
     lenv_add_builtin(e, "exit", (lbuiltin)lispy_exit);
@@ -922,7 +1500,14 @@ void lenv_add_builtins(lenv *e)
 
     /* Add load, print and error function */
     lenv_add_builtin(e, "error", builtin_error);
+    lenv_add_builtin(e, "try", builtin_try);
+    lenv_add_builtin(e, "catch", builtin_catch);
+    lenv_add_builtin(e, "throw", builtin_throw);
+    lenv_add_builtin(e, "err-code", builtin_err_code);
+    lenv_add_builtin(e, "err-msg", builtin_err_msg);
+    lenv_add_builtin(e, "err-pos", builtin_err_pos);
     lenv_add_builtin(e, "print", builtin_print);
+    lenv_add_builtin(e, "to-string", builtin_to_string);
     lenv_add_builtin(e, "load", builtin_load);
 
     /* Add logic operators */
@@ -930,77 +1515,393 @@ void lenv_add_builtins(lenv *e)
     lenv_add_builtin(e, "&&", builtin_and);
     lenv_add_builtin(e, "!", builtin_not);
     lenv_add_builtin(e, "bool", builtin_bool);
+
+    /* Add typed numeric vectors */
+    lenv_add_vec_builtins(e);
+    lenv_add_map_builtins(e);
+    lenv_add_module_builtins(e);
+    lenv_add_macro_builtins(e);
+    lenv_add_sb_builtins(e);
 }
 
 /********** Construct new lvals ****************/
 /* Create a pointer to a new Number lval */
 lval *lval_num(long x)
 {
-    lval *v = malloc(sizeof(lval));
+    lval *v = lheap_alloc(LVAL_NUM, sizeof(lval));
     v->type = LVAL_NUM;
     v->num = x;
     return v;
 }
 
+/* Create a pointer to a new Double lval */
+lval *lval_dbl(double x)
+{
+    lval *v = lheap_alloc(LVAL_DBL, sizeof(lval));
+    v->type = LVAL_DBL;
+    v->dbl = x;
+    return v;
+}
+
+/************* Lazily formatted messages ****************/
+/* Most errors are caught or dropped unread, so `lval_err` only keeps the
+    format and its arguments. The message is written when it is shown.
+*/
+#define LERR_MAX_ARGS 8
+#define LERR_MAX_SPEC 32
+
+/* Kind of argument a printf conversion takes. */
+enum larg
+{
+    LARG_NONE,
+    LARG_INT,
+    LARG_LONG,
+    LARG_LLONG,
+    LARG_UINT,
+    LARG_ULONG,
+    LARG_ULLONG,
+    LARG_DBL,
+    LARG_STR,
+    LARG_PTR,
+    LARG_BAD,
+};
+
+/* Format and arguments of a message. Strings are copied behind the block
+    and kept as offsets, so a copy of the error is a single `memcpy`.
+*/
+struct lerr_fmt
+{
+    const char *fmt;
+    size_t size;
+    union
+    {
+        long long i;
+        unsigned long long u;
+        double d;
+        size_t s;
+        void *p;
+    } args[LERR_MAX_ARGS];
+};
+
+/* Read the conversion following a '%', returning its end and the kind of argument it takes. */
+static const char *larg_spec(const char *p, enum larg *kind)
+{
+    const char *start = p;
+    int longs = 0;
+    p += strspn(p, "-+ #0");
+    p += strspn(p, "0123456789");
+    if (*p == '.')
+    {
+        p++;
+        p += strspn(p, "0123456789");
+    }
+    for (; *p == 'l' || *p == 'h'; p++)
+        longs += *p == 'l';
+
+    switch (*p)
+    {
+    case '%':
+        *kind = p == start ? LARG_NONE : LARG_BAD;
+        break;
+    case 'd':
+    case 'i':
+    case 'c':
+        *kind = longs == 0 ? LARG_INT : longs == 1 ? LARG_LONG : LARG_LLONG;
+        break;
+    case 'u':
+    case 'x':
+    case 'X':
+    case 'o':
+        *kind = longs == 0 ? LARG_UINT : longs == 1 ? LARG_ULONG : LARG_ULLONG;
+        break;
+    case 'f':
+    case 'F':
+    case 'e':
+    case 'E':
+    case 'g':
+    case 'G':
+    case 'a':
+    case 'A':
+        *kind = LARG_DBL;
+        break;
+    case 's':
+        *kind = longs ? LARG_BAD : LARG_STR;
+        break;
+    case 'p':
+        *kind = LARG_PTR;
+        break;
+    default:
+        /* Widths from arguments, wide strings and other rarities. */
+        *kind = LARG_BAD;
+        return p;
+    }
+    if (longs > 2 || p + 2 - start >= LERR_MAX_SPEC)
+        *kind = LARG_BAD;
+    return p + 1;
+}
+
+/* Write the message the way printf would have. */
+static void lerr_write_fmt(lwriter *w, struct lerr_fmt *f)
+{
+    const char *p = f->fmt;
+    const char *strs = (const char *)(f + 1);
+    int n = 0;
+    for (const char *q = strchr(p, '%'); q; q = strchr(p, '%'))
+    {
+        lw_write(w, p, q - p);
+
+        enum larg kind;
+        p = larg_spec(q + 1, &kind);
+        char spec[LERR_MAX_SPEC];
+        memcpy(spec, q, p - q);
+        spec[p - q] = '\0';
+
+        switch (kind)
+        {
+        case LARG_INT:
+            lw_printf(w, spec, (int)f->args[n++].i);
+            break;
+        case LARG_LONG:
+            lw_printf(w, spec, (long)f->args[n++].i);
+            break;
+        case LARG_LLONG:
+            lw_printf(w, spec, f->args[n++].i);
+            break;
+        case LARG_UINT:
+            lw_printf(w, spec, (unsigned)f->args[n++].u);
+            break;
+        case LARG_ULONG:
+            lw_printf(w, spec, (unsigned long)f->args[n++].u);
+            break;
+        case LARG_ULLONG:
+            lw_printf(w, spec, f->args[n++].u);
+            break;
+        case LARG_DBL:
+            lw_printf(w, spec, f->args[n++].d);
+            break;
+        case LARG_STR:
+            lw_printf(w, spec, strs + f->args[n++].s);
+            break;
+        case LARG_PTR:
+            lw_printf(w, spec, f->args[n++].p);
+            break;
+        default:
+            lw_putc(w, '%');
+            break;
+        }
+    }
+    lw_puts(w, p);
+}
+
+/* Format the message right away, for formats `lerr_write_fmt` cannot replay. */
+static void lerr_vformat(lval *v, const char *fmt, va_list va)
+{
+    /* printf the error string on the stack with a maximum of 511 characters. */
+    char buf[512];
+    int n = vsnprintf(buf, sizeof(buf), fmt, va);
+    if (n >= (int)sizeof(buf))
+        n = sizeof(buf) - 1;
+
+    /* Keep exactly the bytes used. */
+    v->err = lheap_alloc(LVAL_ERR, n + 1);
+    memcpy(v->err, buf, n + 1);
+}
+
 /* Create a pointer to a new Error lval  */
 lval *lval_err(char *fmt, ...)
 {
-    lval *v = malloc(sizeof(lval));
-    v->type = LVAL_ERR;
+    lval *v = lval_err_code(LERR_OTHER);
+
+    /* Collect the arguments, strings are only measured for now. */
+    struct lerr_fmt f;
+    enum larg kinds[LERR_MAX_ARGS];
+    size_t strs = 0;
+    int n = 0;
+    int ok = 1;
 
-    /* Create a va list and initialize it */
     va_list va;
     va_start(va, fmt);
+    for (const char *p = strchr(fmt, '%'); p; p = strchr(p, '%'))
+    {
+        enum larg kind;
+        p = larg_spec(p + 1, &kind);
+        if (kind == LARG_NONE)
+            continue;
+        if (kind == LARG_BAD || n == LERR_MAX_ARGS)
+        {
+            ok = 0;
+            break;
+        }
 
-    /* Allocate 512 bytes of space */
-    v->err = malloc(512);
-
-    /* printf the error string with a maximum of 511 characters. */
-    vsnprintf(v->err, 511, fmt, va);
+        kinds[n] = kind;
+        switch (kind)
+        {
+        case LARG_INT:
+            f.args[n].i = va_arg(va, int);
+            break;
+        case LARG_LONG:
+            f.args[n].i = va_arg(va, long);
+            break;
+        case LARG_LLONG:
+            f.args[n].i = va_arg(va, long long);
+            break;
+        case LARG_UINT:
+            f.args[n].u = va_arg(va, unsigned);
+            break;
+        case LARG_ULONG:
+            f.args[n].u = va_arg(va, unsigned long);
+            break;
+        case LARG_ULLONG:
+            f.args[n].u = va_arg(va, unsigned long long);
+            break;
+        case LARG_DBL:
+            f.args[n].d = va_arg(va, double);
+            break;
+        case LARG_STR:
+            f.args[n].p = va_arg(va, char *);
+            strs += strlen(f.args[n].p) + 1;
+            break;
+        default:
+            f.args[n].p = va_arg(va, void *);
+            break;
+        }
+        n++;
+    }
+    va_end(va);
 
-    /* Reallocate to number ot bytes actually used. */
-    v->err = realloc(v->err, strlen(v->err) + 1);
+    if (!ok)
+    {
+        va_start(va, fmt);
+        lerr_vformat(v, fmt, va);
+        va_end(va);
+        return v;
+    }
 
-    /* Clean up our va list. */
-    va_end(va);
+    /* Copy the strings, their owners may be gone when the message is shown. */
+    f.fmt = fmt;
+    f.size = sizeof(struct lerr_fmt) + strs;
+    v->fmt = lheap_alloc(LVAL_ERR, f.size);
+    char *s = (char *)(v->fmt + 1);
+    size_t off = 0;
+    for (int i = 0; i < n; i++)
+    {
+        if (kinds[i] != LARG_STR)
+            continue;
+        size_t len = strlen(f.args[i].p) + 1;
+        memcpy(s + off, f.args[i].p, len);
+        f.args[i].s = off;
+        off += len;
+    }
+    memcpy(v->fmt, &f, sizeof(struct lerr_fmt));
+    return v;
+}
 
+/* Create an error whose message follows from its code, without formatting */
+lval *lval_err_code(enum lerr_code code)
+{
+    lval *v = lheap_alloc(LVAL_ERR, sizeof(lval));
+    v->type = LVAL_ERR;
+    v->err = NULL;
+    v->fmt = NULL;
+    v->code = code;
+    v->err_line = 0;
+    v->err_col = 0;
+    v->caught = false;
     return v;
 }
 
+/* Write the message of an error */
+void lerr_write_msg(lwriter *w, lval *v)
+{
+    if (v->err)
+    {
+        lw_puts(w, v->err);
+        return;
+    }
+    if (v->fmt)
+    {
+        lerr_write_fmt(w, v->fmt);
+        return;
+    }
+
+    switch (v->code)
+    {
+    case LERR_DIV_ZERO:
+        lw_puts(w, "Division by Zero.");
+        break;
+    case LERR_KEY:
+        lw_puts(w, "Key not found in map.");
+        break;
+    case LERR_HEAP:
+        if (lheap_limit())
+            lw_printf(w, "Heap limit of %lu bytes exceeded.", (unsigned long)lheap_limit());
+        else
+            lw_puts(w, "Out of memory.");
+        break;
+    case LERR_EXIT:
+        lw_puts(w, "exit");
+        break;
+    default:
+        lw_printf(w, "Error code %d.", (int)v->code);
+        break;
+    }
+}
+
+char *lerr_text(lval *v)
+{
+    if (v->fmt)
+    {
+        /* Keep the written message, taking over the buffer of the string. */
+        lwriter w;
+        lw_open_mem(&w);
+        lerr_write_fmt(&w, v->fmt);
+        lval *s = lw_take_str(&w);
+        v->err = s->str;
+        lheap_free(s);
+        lheap_free(v->fmt);
+        v->fmt = NULL;
+    }
+    return v->err;
+}
+
 /* Create a pointer to a new Symbol lval*/
 lval *lval_sym(char *sym)
 {
-    lval *v = malloc(sizeof(lval));
+    lval *v = lheap_alloc(LVAL_SYM, sizeof(lval));
     v->type = LVAL_SYM;
-    v->sym = malloc(strlen(sym) + 1);
-    strcpy(v->sym, sym);
+    v->ic = lic_new(sym);
+    v->sym = v->ic->rec->name;
     return v;
 }
 
 /* Create a pointer to a new S-expression lval */
 lval *lval_sexpr(void)
 {
-    lval *v = malloc(sizeof(lval));
+    lval *v = lheap_alloc(LVAL_SEXPR, sizeof(lval));
     v->type = LVAL_SEXPR;
     v->count = 0;
     v->cell = NULL;
+    v->line = 0;
+    v->col = 0;
     return v;
 }
 
 /* Create a pointer to a new Q-expression lval */
 lval *lval_qexpr(void)
 {
-    lval *v = malloc(sizeof(lval));
+    lval *v = lheap_alloc(LVAL_QEXPR, sizeof(lval));
     v->type = LVAL_QEXPR;
     v->count = 0;
     v->cell = NULL;
+    v->line = 0;
+    v->col = 0;
     return v;
 }
 
 /* Create a pointer to a list function */
 lval *lval_fun(lbuiltin func)
 {
-    lval *v = malloc(sizeof(lval));
+    lval *v = lheap_alloc(LVAL_FUN, sizeof(lval));
     v->type = LVAL_FUN;
     v->builtin = func;
     return v;
@@ -1009,133 +1910,165 @@ lval *lval_fun(lbuiltin func)
 /* Create a user defined function. */
 lval *lval_lambda(lval *formals, lval *body)
 {
-    lval *v = malloc(sizeof(lval));
+    lval *v = lheap_alloc(LVAL_FUN, sizeof(lval));
     v->type = LVAL_FUN;
 
     /* Set Builtin to NULL */
     v->builtin = NULL;
 
     /* Build new environment */
-    v->env = lenv_new();
+    v->part = NULL;
+    v->mod = NULL;
 
     /* Set Formals and Body */
     v->formals = formals;
     v->body = body;
+    v->jit = ljit_new();
+
+    /* Analyse the formals once, calls bind arguments by position. */
+    v->arity = formals->count;
+    v->rest = 0;
+    v->bound = 0;
+    for (int i = 0; i < formals->count; i++)
+    {
+        if (STR_EQ(formals->cell[i]->sym, "&"))
+        {
+            v->arity = i;
+            v->rest = formals->count - i == 2 ? 1 : -1;
+            break;
+        }
+    }
     return v;
 }
 
+/* Replace the result of a builtin with a heap limit error when it had to grow
+    past the limit, so the error is reported against the call that caused it.
+*/
+static lval *lheap_check(lval *r)
+{
+    if (!lheap_take_exceeded() || LVAL_IS_RAISED(r))
+        return r;
+    lval_del(r);
+    return lval_err_code(LERR_HEAP);
+}
+
 /* Call a function */
 lval *lval_call(lenv *e, lval *f, lval *a)
 {
     /* If Builtin then simply apply that */
     if (f->builtin)
     {
-        return f->builtin(e, a);
+        return lheap_check(f->builtin(e, a));
+    }
+
+    /* Hot lambdas with Number arguments may run as native code. */
+    lval *r = ljit_call(e, f, a);
+    if (r)
+    {
+        return r;
     }
 
     /* Record Argument Counts */
     int given = a->count;
-    int total = f->formals->count;
+    int total = f->formals->count - f->bound;
+    int fixed = f->arity - f->bound;
 
-    /* While arguments still remain to be processed */
-    while (a->count)
+    /* Arguments beyond the fixed parameters go to the rest parameter. */
+    if (given > fixed && f->rest != 1)
     {
-        /* If we've ran out of formal arguments to bind.*/
-        if (f->formals->count == 0)
+        lval_del(a);
+        if (f->rest == 0)
         {
-            lval_del(a);
             return lval_err("Function passed too many arguments. "
                             "Got %d, Expected %d.",
                             given, total);
         }
-
-        /* Pop the first symbol from the formals */
-        lval *sym = lval_pop(f->formals, 0);
-
-        /* Special case to deal with '&' */
-        if (STR_EQ(sym->sym, "&"))
-        {
-            /* Ensure '&' is followed by another symbol */
-            if (f->formals->count != 1)
-            {
-                lval_del(a);
-                return lval_err("Function format invalid. Symbol '&' not followed by single symbol.");
-            }
-
-            /* Next formal should be bound to remaining arguments */
-            lval *nsym = lval_pop(f->formals, 0);
-            lenv_put(f->env, nsym, builtin_list(e, a));
-            lval_del(sym);
-            lval_del(nsym);
-            break;
-        }
-
-        /* Pop the next argument from the list */
-        lval *val = lval_pop(a, 0);
-
-        /* Bind a copy into the function's environment */
-        lenv_put(f->env, sym, val);
-
-        /* Delete symbol and value */
-        lval_del(sym);
-        lval_del(val);
+        return lval_err("Function format invalid. Symbol '&' not followed by single symbol.");
     }
 
-    /* Argument list is now bound so can be cleaned up */
-    lval_del(a);
-
-    /* If '&' remains in formal list, bind to empty list */
-    if (f->formals->count > 0 && STR_EQ(f->formals->cell[0]->sym, "&"))
+    /* Too few arguments give a function waiting for the others. */
+    if (given < fixed)
     {
-        /* Check to ensure that & is not passed invalidly. */
-        if (f->formals->count != 2)
-        {
-            return lval_err("function format invalid. Symbol '&' not followed by single symbol.");
-        }
-
-        /* Pop and delete '&' symbol */
-        lval_del(lval_pop(f->formals, 0));
-
-        /* Pop next symbol and create empty list */
-        lval *sym = lval_pop(f->formals, 0);
-        lval *val = lval_qexpr();
-
-        /* Bind to environment and delete */
-        lenv_put(f->env, sym, val);
-        lval_del(sym);
-        lval_del(val);
+        struct lpart *part = lheap_alloc(LVAL_FUN, sizeof(struct lpart) + sizeof(lval *) * given);
+        part->refs = 1;
+        part->prev = lpart_ref(f->part);
+        part->first = f->bound;
+        part->count = given;
+        memcpy(part->vals, a->cell, sizeof(lval *) * given);
+
+        lval *p = lval_copy(f);
+        lpart_unref(p->part);
+        p->part = part;
+        p->bound += given;
+        a->count = 0;
+        lval_del(a);
+        return p;
     }
-
-    /* If all formals have been bound evaluate it */
-    if (f->formals->count == 0)
+    if (f->rest == -1)
     {
-        /* Set environment parent to evaluation environment */
-        f->env->par = e;
+        lval_del(a);
+        return lval_err("function format invalid. Symbol '&' not followed by single symbol.");
+    }
 
-        /* Evaluate and return the result */
-        return builtin_eval(f->env, lval_add(lval_qexpr(), lval_copy(f->body)));
+    /* Bind by position into a record on the evaluation stack, taking over the arguments. */
+    lenv record;
+    lenv *frame = &record;
+    lenv_push(frame, f->mod ? f->mod : e, f->arity + f->rest);
+    for (struct lpart *p = f->part; p; p = p->prev)
+    {
+        for (int i = 0; i < p->count; i++)
+        {
+            lval *k = f->formals->cell[p->first + i];
+            lenv_changed(frame, k);
+            frame->dicts[p->first + i].sym = k->sym;
+            frame->dicts[p->first + i].val = lval_copy(p->vals[i]);
+        }
     }
-    else
+    frame->count = f->bound;
+    for (int i = 0; i < fixed; i++)
+        lenv_bind(frame, f->formals->cell[f->bound + i], a->cell[i]);
+    if (f->rest)
     {
-        /* Otherwise return partially evaluated function */
-        return lval_copy(f);
+        lval *rest = lval_qexpr();
+        for (int i = fixed; i < given; i++)
+            lval_add(rest, a->cell[i]);
+        lenv_bind(frame, f->formals->cell[f->arity + 1], rest);
     }
+    a->count = 0;
+    lval_del(a);
+
+    /* Evaluate the body in the frame, whose parent is the caller's environment */
+    lval *x = builtin_eval(frame, lval_add(lval_qexpr(), lval_copy(lopt_body(frame, f))));
+    lenv_pop(frame);
+    return x;
 }
 
 /* Create a string value */
 lval *lval_str(char *s)
 {
-    lval *v = malloc(sizeof(lval));
+    lval *v = lheap_alloc(LVAL_STR, sizeof(lval));
     v->type = LVAL_STR;
-    v->str = malloc(strlen(s) + 1);
-    strcpy(v->str, s);
+    v->len = strlen(s);
+    v->str = lheap_alloc(LVAL_STR, v->len + 1);
+    memcpy(v->str, s, v->len + 1);
+    return v;
+}
+
+/* Wrap a buffer of `len` bytes allocated in the LVAL_STR bucket, taking ownership */
+lval *lval_str_take(char *s, long len)
+{
+    lval *v = lheap_alloc(LVAL_STR, sizeof(lval));
+    v->type = LVAL_STR;
+    v->str = s;
+    v->len = len;
+    v->str[len] = '\0';
     return v;
 }
 
 /* Create a bool value */
 lval *lval_bool(long x)
 {
-    lval *v = malloc(sizeof(lval));
+    lval *v = lheap_alloc(LVAL_BOOL, sizeof(lval));
     v->type = LVAL_BOOL;
     v->num = x;
     return v;
@@ -1148,26 +2081,47 @@ void lval_del(lval *v)
     {
     /* Do nothing special for the number and bool types. */
     case LVAL_NUM:
+    case LVAL_DBL:
     case LVAL_BOOL:
         break;
     case LVAL_FUN:
         if (!v->builtin)
         {
-            lenv_del(v->env);
-            lval_del(v->formals);
-            lval_del(v->body);
+            lpart_unref(v->part);
+            if (v->jit->refs == 1)
+            {
+                lval_del(v->formals);
+                lval_del(v->body);
+            }
+            ljit_unref(v->jit);
         }
         break;
 
+    /* Bignums and vectors share their payload, drop our reference. */
+    case LVAL_BIG:
+        lbig_unref(v->big);
+        break;
+    case LVAL_F64VEC:
+    case LVAL_I64VEC:
+        lvec_unref(v->vec);
+        break;
+    case LVAL_MAP:
+        lmap_unref(v->map);
+        break;
+    case LVAL_SB:
+        lsb_unref(v->sb);
+        break;
+
     /* For Err or Sym, free the string data. */
     case LVAL_ERR:
-        free(v->err);
+        lheap_free(v->err);
+        lheap_free(v->fmt);
         break;
     case LVAL_SYM:
-        free(v->sym);
+        lic_unref(v->ic);
         break;
     case LVAL_STR:
-        free(v->str);
+        lheap_free(v->str);
         break;
 
     /* If Sexpr or Qexpr then delete all elements inside. */
@@ -1178,58 +2132,94 @@ void lval_del(lval *v)
             lval_del(v->cell[i]);
         }
         /* Also free the memory allocated to the cell array itself. */
-        free(v->cell);
+        lheap_free(v->cell);
         break;
     }
 
     /* Free the memory allocated to the `lval` struct itself. */
-    free(v);
+    lheap_free(v);
 }
 
 /************** Parse And Read the input. *******************/
-lval *lval_read_num(mpc_ast_t *t)
+/* The text of a node as a C string, in `buf` when it fits, otherwise in a
+    block of the bucket `kind` that the caller frees when it is not `buf`.
+*/
+static char *lval_read_text(mpc_view_t *t, int kind, char *buf, size_t size)
+{
+    char *s = t->len < size ? buf : lheap_alloc(kind, t->len + 1);
+    memcpy(s, t->contents, t->len);
+    s[t->len] = '\0';
+    return s;
+}
+
+lval *lval_read_num(mpc_view_t *t)
 {
+    char buf[64];
+    char *s = lval_read_text(t, LVAL_NUM, buf, sizeof(buf));
+    lval *x;
+
     errno = 0;
-    long x = strtol(t->contents, NULL, 10);
-    return errno != ERANGE ? lval_num(x) : lval_err("Invalid Number: Out of range.");
+    /* Literals with a fraction or an exponent are doubles. */
+    if (strpbrk(s, ".eE"))
+    {
+        double d = strtod(s, NULL);
+        x = errno != ERANGE ? lval_dbl(d) : lval_err("Invalid Number: Out of range.");
+    }
+    else
+    {
+        long n = strtol(s, NULL, 10);
+        /* Integer literals beyond a long become bignums. */
+        x = errno != ERANGE ? lval_num(n) : lval_big(lbig_from_str(s));
+    }
+
+    if (s != buf)
+        lheap_free(s);
+    return x;
 }
 
-lval *lval_read(mpc_ast_t *t)
+lval *lval_read(mpc_view_t *t)
 {
     /* If Symbol or Number return conversion to that type. */
-    if (STR_CONTAIN(t->tag, "number"))
+    if (t->tag == LRULE_NUMBER)
     {
         return lval_read_num(t);
     }
-    if (STR_CONTAIN(t->tag, "symbol"))
+    if (t->tag == LRULE_SYMBOL)
     {
-        return lval_sym(t->contents);
+        char buf[64];
+        char *s = lval_read_text(t, LVAL_SYM, buf, sizeof(buf));
+        lval *x = lval_sym(s);
+        if (s != buf)
+            lheap_free(s);
+        return x;
     }
-    if (STR_CONTAIN(t->tag, "string"))
+    if (t->tag == LRULE_STRING)
     {
         return lval_read_str(t);
     }
 
     /* if root (>) or sexpr then create empty list. */
     lval *x = NULL;
-    if (STR_CONTAIN(t->tag, "sexpr") || STR_EQ(t->tag, ">"))
+    if (t->tag == LRULE_QEXPR)
     {
-        x = lval_sexpr();
+        x = lval_qexpr();
     }
-    if (STR_CONTAIN(t->tag, "qexpr"))
+    else
     {
-        x = lval_qexpr();
+        x = lval_sexpr();
     }
 
-    /* Fill this list with any valid expression contained within. */
+    /* Remember where the list starts, for error positions. */
+    x->line = t->state.row + 1;
+    x->col = t->state.col + 1;
+
+    /* Fill this list with any valid expression contained within, brackets
+        and the start and end of the input are tokens.
+    */
     for (int i = 0; i < t->children_num; i++)
     {
-        if (STR_EQ(t->children[i]->contents, "(") ||
-            STR_EQ(t->children[i]->contents, ")") ||
-            STR_EQ(t->children[i]->contents, "{") ||
-            STR_EQ(t->children[i]->contents, "}") ||
-            STR_CONTAIN(t->children[i]->tag, "comment") ||
-            STR_EQ(t->children[i]->tag, "regex"))
+        if (t->children[i]->tag == MPC_VIEW_TOKEN ||
+            t->children[i]->tag == LRULE_COMMENT)
             continue;
 
         x = lval_add(x, lval_read(t->children[i]));
@@ -1241,14 +2231,14 @@ lval *lval_read(mpc_ast_t *t)
 lval *lval_add(lval *v, lval *x)
 {
     v->count++;
-    v->cell = realloc(v->cell, sizeof(lval *) * v->count);
+    v->cell = lheap_realloc(v->type, v->cell, sizeof(lval *) * v->count);
     v->cell[v->count - 1] = x;
     return v;
 }
 
 lval *lval_copy(lval *v)
 {
-    lval *x = malloc(sizeof(lval));
+    lval *x = lheap_alloc(v->type, sizeof(lval));
     x->type = v->type;
 
     switch (v->type)
@@ -1262,36 +2252,70 @@ lval *lval_copy(lval *v)
         else
         {
             x->builtin = NULL;
-            x->env = lenv_copy(v->env);
-            x->formals = lval_copy(v->formals);
-            x->body = lval_copy(v->body);
+            x->part = lpart_ref(v->part);
+            x->mod = v->mod;
+            x->formals = v->formals;
+            x->body = v->body;
+            x->jit = ljit_ref(v->jit);
+            x->arity = v->arity;
+            x->rest = v->rest;
+            x->bound = v->bound;
         }
         break;
     case LVAL_BOOL:
     case LVAL_NUM:
         x->num = v->num;
         break;
+    case LVAL_DBL:
+        x->dbl = v->dbl;
+        break;
 
-    /* Copy Strings using malloc and strcpy. */
+    /* Bignums and vectors are immutable, so copies share the payload. */
+    case LVAL_BIG:
+        x->big = lbig_ref(v->big);
+        break;
+    case LVAL_F64VEC:
+    case LVAL_I64VEC:
+        x->vec = lvec_ref(v->vec);
+        break;
+
+    /* Maps are reference values, copies share the same table. */
+    case LVAL_MAP:
+        x->map = lmap_ref(v->map);
+        break;
+
+    /* Copy Strings into the tracked heap. */
     case LVAL_ERR:
-        x->err = malloc(strlen(v->err) + 1);
-        strcpy(x->err, v->err);
+        x->err = v->err ? lheap_strdup(LVAL_ERR, v->err) : NULL;
+        x->fmt = v->fmt ? memcpy(lheap_alloc(LVAL_ERR, v->fmt->size), v->fmt, v->fmt->size) : NULL;
+        x->code = v->code;
+        x->err_line = v->err_line;
+        x->err_col = v->err_col;
+        x->caught = v->caught;
         break;
     case LVAL_SYM:
-        x->sym = malloc(strlen(v->sym) + 1);
-        strcpy(x->sym, v->sym);
+        x->sym = v->sym;
+        x->ic = lic_ref(v->ic);
         break;
 
     case LVAL_STR:
-        x->str = malloc(strlen(v->str) + 1);
-        strcpy(x->str, v->str);
+        x->len = v->len;
+        x->str = lheap_alloc(LVAL_STR, v->len + 1);
+        memcpy(x->str, v->str, v->len + 1);
+        break;
+
+    /* Builders are mutable, so copies share the chunks. */
+    case LVAL_SB:
+        x->sb = lsb_ref(v->sb);
         break;
 
     /* Copy Lists by copying each sub-expression */
     case LVAL_SEXPR:
     case LVAL_QEXPR:
         x->count = v->count;
-        x->cell = malloc(sizeof(lval *) * x->count);
+        x->line = v->line;
+        x->col = v->col;
+        x->cell = lheap_alloc(x->type, sizeof(lval *) * x->count);
         for (int i = 0; i < x->count; i++)
         {
             x->cell[i] = lval_copy(v->cell[i]);
@@ -1302,40 +2326,49 @@ lval *lval_copy(lval *v)
     return x;
 }
 
-lval *lval_read_str(mpc_ast_t *t)
+lval *lval_read_str(mpc_view_t *t)
 {
-    /* Cut off the final quote character */
-    t->contents[strlen(t->contents) - 1] = '\0';
-    /* Copy the string missing out the first quote character */
-    char *unescaped = malloc(strlen(t->contents + 1) + 1);
-    strcpy(unescaped, t->contents + 1);
-    /* Pass through the unescaped function */
-    unescaped = mpcf_unescape(unescaped);
-    /* Construct a new lval using the string */
-    lval *str = lval_str(unescaped);
-    /* free the string and return */
-    free(unescaped);
-    return str;
+    /* Unescape between the quotes straight into the string, as mpcf_unescape does */
+    static const char from[] = "abfnrtv\\'\"0";
+    static const char to[] = "\a\b\f\n\r\t\v\\'\"";
+    const char *s = t->contents + 1;
+    long n = (long)t->len - 2;
+    char *str = lheap_alloc(LVAL_STR, n + 1);
+    long len = 0;
+    for (long i = 0; i < n; i++)
+    {
+        const char *e = s[i] == '\\' && i + 1 < n ? strchr(from, s[i + 1]) : NULL;
+        if (!e || !*e)
+        {
+            str[len++] = s[i];
+            continue;
+        }
+        /* An escaped nul is dropped. */
+        if (*e != '0')
+            str[len++] = to[e - from];
+        i++;
+    }
+    return lval_str_take(str, len);
 }
 
 /****************** Print the expressions *****************/
-void lval_expr_print(lenv *e, lval *v, char open, char close)
+void lval_expr_print(lwriter *w, lenv *e, lval *v, char open, char close)
 {
-    putchar(open);
+    lw_putc(w, open);
     for (int i = 0; i < v->count; i++)
     {
         /* Print the value contained within. */
-        lval_print(e, v->cell[i]);
+        lval_write(w, e, v->cell[i]);
 
         /* Don't print the trailing space for the last element. */
         if (i != v->count - 1)
-            putchar(' ');
+            lw_putc(w, ' ');
     }
-    putchar(close);
+    lw_putc(w, close);
 }
 
-/* Print an lval value. */
-void lval_print(lenv *e, lval *v)
+/* Write an lval value into a writer. */
+void lval_write(lwriter *w, lenv *e, lval *v)
 {
     switch (v->type)
     {
@@ -1343,73 +2376,119 @@ void lval_print(lenv *e, lval *v)
             Then 'break' out of the switch.
         */
     case LVAL_NUM:
-        printf("%ld", v->num);
+        lw_printf(w, "%ld", v->num);
+        break;
+
+    case LVAL_DBL:
+        lval_print_dbl(w, v);
+        break;
+
+    case LVAL_BIG:
+        lval_print_big(w, v);
+        break;
+
+    case LVAL_F64VEC:
+    case LVAL_I64VEC:
+        lval_print_vec(w, v);
+        break;
+
+    case LVAL_MAP:
+        lval_print_map(w, e, v);
+        break;
+
+    case LVAL_SB:
+        lval_print_sb(w, v);
         break;
 
     /* In the case the type is an error */
     case LVAL_ERR:
-        printf("Error: %s", v->err);
+        lw_puts(w, "Error: ");
+        lerr_write_msg(w, v);
+        if (v->err_line)
+            lw_printf(w, " (line %d, column %d)", v->err_line, v->err_col);
         break;
 
     case LVAL_SYM:
-        printf("%s", v->sym);
+        lw_puts(w, v->sym);
         break;
 
     case LVAL_STR:
-        lval_print_str(v);
+        lval_print_str(w, v);
         break;
 
     case LVAL_BOOL:
-        printf(v->num ? "true" : "false");
+        lw_puts(w, v->num ? "true" : "false");
         break;
 
     case LVAL_SEXPR:
-        lval_expr_print(e, v, '(', ')');
+        lval_expr_print(w, e, v, '(', ')');
         break;
 
     case LVAL_QEXPR:
-        lval_expr_print(e, v, '{', '}');
+        lval_expr_print(w, e, v, '{', '}');
         break;
 
     case LVAL_FUN:
         if (v->builtin)
         {
-            printf("Builtin `%s` at 0X%p",
-                   lenv_find_fun(e, v->builtin), (void *)v->builtin);
+            lw_printf(w, "Builtin `%s` at 0X%p",
+                      lenv_find_fun(e, v->builtin), (void *)v->builtin);
         }
         else
         {
-            printf("(\\ ");
-            lval_print(e, v->formals);
-            putchar(' ');
-            lval_print(e, v->body);
-            putchar(')');
+            /* Parameters bound by partial application are left out. */
+            lw_puts(w, "(\\ {");
+            for (int i = v->bound; i < v->formals->count; i++)
+            {
+                lval_write(w, e, v->formals->cell[i]);
+                if (i != v->formals->count - 1)
+                    lw_putc(w, ' ');
+            }
+            lw_puts(w, "} ");
+            lval_write(w, e, v->body);
+            lw_putc(w, ')');
         }
         break;
     }
 }
 
+/* Print an lval value to the standard output writer. */
+void lval_print(lenv *e, lval *v)
+{
+    lval_write(&lw_out, e, v);
+}
+
 /* Print an lval value followed by a newline. */
 void lval_println(lenv *e, lval *v)
 {
-    lval_print(e, v);
-    putchar('\n');
+    lval_write(&lw_out, e, v);
+    lw_endline(&lw_out);
 }
 
-/* Print a string */
-void lval_print_str(lval *v)
+/* Print a double with the fewest digits that read back to the same value. */
+void lval_print_dbl(lwriter *w, lval *v)
 {
-    /* Make a copy of the string */
-    char *escaped = malloc(strlen(v->str) + 1);
-    strcpy(escaped, v->str);
+    char buf[32];
+    for (int prec = 15; prec <= 17; prec++)
+    {
+        snprintf(buf, sizeof(buf), "%.*g", prec, v->dbl);
+        if (strtod(buf, NULL) == v->dbl)
+            break;
+    }
 
-    /* Pass it through the escape function. */
-    escaped = mpcf_escape(escaped);
+    /* Keep a decimal point so that the value reads back as a double. */
+    if (!strpbrk(buf, ".eEin"))
+        strcat(buf, ".0");
+    lw_puts(w, buf);
+}
 
-    /* Print it between " characters*/
-    printf("\"%s\"", escaped);
-    /* free the copied string */
-    free(escaped);
+/* Print a string */
+void lval_print_str(lwriter *w, lval *v)
+{
+    /* Escape straight into the writer, between " characters. */
+    lw_putc(w, '"');
+    lw_write_escaped(w, v->str, v->len);
+    lw_putc(w, '"');
 }
 
 /*********** Utilities *******************/
@@ -1421,6 +2500,18 @@ char *ltype_name(enum lval_type t)
         return "Function";
     case LVAL_NUM:
         return "Number";
+    case LVAL_DBL:
+        return "Double";
+    case LVAL_BIG:
+        return "Bignum";
+    case LVAL_F64VEC:
+        return "F64 Vector";
+    case LVAL_I64VEC:
+        return "I64 Vector";
+    case LVAL_MAP:
+        return "Map";
+    case LVAL_SB:
+        return "String Builder";
     case LVAL_ERR:
         return "Error";
     case LVAL_SYM:
@@ -1442,5 +2533,5 @@ lval *lispy_exit(lenv *e, lval *a)
 {
     LASSERT(a, a->count == 0, "'exit' invalidly called. "
         "It should called without any argument.");
-    return lval_err("exit");
+    return lval_err_code(LERR_EXIT);
 }
\ No newline at end of file
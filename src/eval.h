@@ -7,6 +7,9 @@
 
 #define STR_EQ(X, Y) (strcmp((X), (Y)) == 0)
 #define STR_CONTAIN(X, Y) strstr((X), (Y))
+#define LVAL_IS_NUMERIC(v) ((v)->type == LVAL_NUM || (v)->type == LVAL_DBL)
+/* An error that is still unwinding, as opposed to one held by `catch`. */
+#define LVAL_IS_RAISED(v) ((v)->type == LVAL_ERR && !(v)->caught)
 #define LASSERT(args, cond, fmt, ...)                 \
     do                                                \
     {                                                 \
@@ -21,21 +24,52 @@
 /* Forward Declarations */
 struct lval;
 struct lenv;
+struct lvec;
+struct lbig;
+struct lmap;
+struct lsb;
+struct lic;
+struct ljit;
+struct lpart;
+struct lerr_fmt;
 typedef struct lval lval;
 typedef struct lenv lenv;
+typedef struct lwriter lwriter;
 
 /* Crate Enumeration of possible lval types. */
 enum lval_type
 {
     LVAL_ERR,
     LVAL_NUM,
+    LVAL_DBL,
+    LVAL_BIG,
     LVAL_SYM,
     LVAL_STR,
     LVAL_BOOL,
     LVAL_FUN,
+    LVAL_F64VEC,
+    LVAL_I64VEC,
+    LVAL_MAP,
+    LVAL_SB,
     LVAL_SEXPR,
     LVAL_QEXPR,
 };
+/* Number of lval types, keep it in step with the last enumerator. */
+#define LVAL_TYPES (LVAL_QEXPR + 1)
+
+/* Error codes. Errors with a fixed message carry no string at all, their
+    text comes from a static table when it is printed.
+*/
+enum lerr_code
+{
+    LERR_OTHER,
+    LERR_USER,
+    LERR_UNBOUND,
+    LERR_DIV_ZERO,
+    LERR_KEY,
+    LERR_HEAP,
+    LERR_EXIT,
+};
 
 typedef lval *(*lbuiltin)(lenv *, lval *);
 
@@ -49,26 +83,80 @@ struct lval
     {
         /* Basic types. */
         long num;
+        double dbl;
 
         /* Use string characters to store the error info and symbols. */
-        char *err;
-        char *sym;
-        char *str;
+        /* Symbols, `sym` is the interned name and `ic` the inline cache
+            shared by the copies of this reference.
+        */
+        struct
+        {
+            char *sym;
+            struct lic *ic;
+        };
+
+        /* Errors, `err` is NULL when the message follows from the code or
+            is still waiting in `fmt` to be written. Position is the innermost
+            S-Expression the error passed, line 0 when unknown.
+        */
+        struct
+        {
+            char *err;
+            struct lerr_fmt *fmt;
+            enum lerr_code code;
+            int err_line;
+            int err_col;
+            bool caught;
+        };
+
+        /* Strings keep their length, so copies and joins skip `strlen`. */
+        struct
+        {
+            char *str;
+            long len;
+        };
+
+        /* Arbitrary precision integers */
+        struct lbig *big;
+
+        /* Typed numeric arrays */
+        struct lvec *vec;
+
+        /* Hash maps */
+        struct lmap *map;
+
+        /* String builders */
+        struct lsb *sb;
 
         /* Functions */
         struct
         {
             lbuiltin builtin;
-            lenv *env;
+            /* Arguments bound by partial application, or NULL */
+            struct lpart *part;
+            /* Module the lambda was defined in, NULL in the main program */
+            lenv *mod;
+            /* Never modified once built, copies of a lambda share them. */
             lval *formals;
             lval *body;
+            /* Call profile and native code, shared by copies of a lambda */
+            struct ljit *jit;
+            /* Parameters before '&', whether a rest parameter follows it
+                (-1 when '&' is not followed by exactly one symbol), and how
+                many of them partial application has bound in `part`.
+            */
+            int arity;
+            int rest;
+            int bound;
         };
 
-        /* Count and pointer to a list of lval*/
+        /* Count and pointer to a list of lval, with the source position */
         struct
         {
             int count;
             struct lval **cell;
+            int line;
+            int col;
         };
     };
 };
@@ -81,11 +169,34 @@ struct env_map
     char *sym;
     lval *val;
 };
+/* Arguments a partial function was given, shared by its copies. Each
+    step of a curried call links the arguments it got, for the formals
+    from `first` on, to the ones bound before.
+*/
+struct lpart
+{
+    int refs;
+    struct lpart *prev;
+    int first;
+    int count;
+    lval *vals[];
+};
 struct lenv
 {
     lenv *par;
     int count;
     struct env_map *dicts;
+    /* The top-level environment, whose bindings inline caches remember. */
+    bool global;
+    /* Module whose code runs in this environment, NULL in the main program.
+        A module's own environment points at itself and takes its `def`s.
+    */
+    lenv *mod;
+    /* Bindings reserved on the evaluation stack by lenv_push, and whether
+        `dicts` still points there rather than to the heap.
+    */
+    int slots;
+    bool stacked;
 };
 
 /************* Functions to manipulate the environment. ****************/
@@ -93,6 +204,16 @@ lenv *lenv_new(void);
 void lenv_del(lenv *e);
 lval *lenv_get(lenv *e, lval *k);
 void lenv_put(lenv *e, lval *k, lval *v);
+/* Add a binding of a name not in `e` yet, taking over `v`. The caller has
+    made room for it in `dicts`.
+*/
+void lenv_bind(lenv *e, lval *k, lval *v);
+/* Start the activation record `e` of a call, with room for `n` bindings on
+    the evaluation stack. Records are popped in the reverse order. A record
+    outgrowing its room moves its bindings to the heap.
+*/
+void lenv_push(lenv *e, lenv *par, int n);
+void lenv_pop(lenv *e);
 lenv *lenv_copy(lenv *e);
 void lenv_def(lenv *e, lval *k, lval *v);
 char *lenv_find_fun(lenv *e, lbuiltin fun);
@@ -101,6 +222,10 @@ lval *builtin_print_env(lenv *e, lval *a);
 
 /************ Evaluate the AST ******************/
 lval *lval_eval_sexpr(lenv *e, lval *v);
+/* Apply an S-Expression whose children are evaluated already and hold no error. */
+lval *lval_apply(lenv *e, lval *v);
+/* Record where an error came from, unless a deeper expression already did. */
+lval *lerr_locate(lval *x, int line, int col);
 lval *lval_eval(lenv *e, lval *v);
 lval *lval_pop(lval *v, int i);
 lval *lval_take(lval *v, int i);
@@ -116,6 +241,7 @@ lval *builtin_add(lenv *e, lval *a);
 lval *builtin_sub(lenv *e, lval *a);
 lval *builtin_mul(lenv *e, lval *a);
 lval *builtin_div(lenv *e, lval *a);
+lval *builtin_mod(lenv *e, lval *a);
 lval *builtin_def(lenv *e, lval *a);
 lval *builtin_put(lenv *e, lval *a);
 lval *builtin_var(lenv *e, lval *a, char *func);
@@ -140,8 +266,19 @@ lval *builtin_not(lenv *e, lval *a);
 lval *builtin_bool(lenv *e, lval *a);
 
 lval *builtin_load(lenv *e, lval *a);
+/* Evaluate the forms of a file parsed already, as `load` does, or turn
+    its parse error into a `load` error. Takes over the result.
+*/
+lval *lval_load_result(lenv *e, int ok, mpc_result_t *r);
 lval *builtin_print(lenv *e, lval *a);
+lval *builtin_to_string(lenv *e, lval *a);
 lval *builtin_error(lenv *e, lval *a);
+lval *builtin_try(lenv *e, lval *a);
+lval *builtin_catch(lenv *e, lval *a);
+lval *builtin_throw(lenv *e, lval *a);
+lval *builtin_err_code(lenv *e, lval *a);
+lval *builtin_err_msg(lenv *e, lval *a);
+lval *builtin_err_pos(lenv *e, lval *a);
 
 void lenv_add_builtin(lenv *e, char *name, lbuiltin fun);
 void lenv_add_builtins(lenv *e);
@@ -149,8 +286,16 @@ void lenv_add_builtins(lenv *e);
 /**************** Construct new lval *********************/
 /* Create a pointer to a new Number lval */
 lval *lval_num(long x);
+/* Create a pointer to a new Double lval */
+lval *lval_dbl(double x);
 /* Create a pointer to a new Error lval  */
 lval *lval_err(char *fmt, ...);
+/* Create an error whose message follows from its code, without formatting */
+lval *lval_err_code(enum lerr_code code);
+/* Write the message of an error */
+void lerr_write_msg(lwriter *w, lval *v);
+/* Message text of an error, written on first use. NULL when it follows from the code. */
+char *lerr_text(lval *v);
 /* Create a pointer to a new Symbol lval*/
 lval *lval_sym(char *sym);
 /* Create a pointer to a new S-expression lval */
@@ -165,27 +310,33 @@ lval *lval_lambda(lval *formals, lval *body);
 lval *lval_call(lenv *e, lval *f, lval *a);
 /* Create a string value */
 lval *lval_str(char *s);
+/* Wrap a buffer of `len` bytes allocated in the LVAL_STR bucket, taking ownership */
+lval *lval_str_take(char *s, long len);
 /* Create a bool value */
 lval *lval_bool(long x);
 /* Delete a lval to free the memory. */
 void lval_del(lval *v);
 
 /* Read the input and contruct the lval. */
-lval *lval_read_num(mpc_ast_t *t);
-lval *lval_read(mpc_ast_t *t);
+lval *lval_read_num(mpc_view_t *t);
+lval *lval_read(mpc_view_t *t);
 lval *lval_add(lval *v, lval *x);
 lval *lval_copy(lval *v);
-lval *lval_read_str(mpc_ast_t *t);
+lval *lval_read_str(mpc_view_t *t);
 
 /* Print the expression*/
-void lval_expr_print(lenv *e, lval *v, char open, char close);
-/* Print an lval value. */
+void lval_expr_print(lwriter *w, lenv *e, lval *v, char open, char close);
+/* Write an lval value into a writer. */
+void lval_write(lwriter *w, lenv *e, lval *v);
+/* Print an lval value to the standard output writer. */
 void lval_print(lenv *e, lval *v);
 /* Print an lval value followed by a newline. */
 void lval_println(lenv *e, lval *v);
 
+/* Print a double */
+void lval_print_dbl(lwriter *w, lval *v);
 /* Print a string */
-void lval_print_str(lval *v);
+void lval_print_str(lwriter *w, lval *v);
 
 /*********** Utilities *******************/
 char *ltype_name(enum lval_type t);
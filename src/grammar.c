@@ -0,0 +1,64 @@
+#include "mpc.h"
+#include "grammar.h"
+
+/* Create parsers */
+mpc_parser_t *Number;
+mpc_parser_t *Symbol;
+mpc_parser_t *String;
+mpc_parser_t *Comment;
+// mpc_parser_t *Bool = mpc_new("bool");
+mpc_parser_t *Sexpr;
+mpc_parser_t *Qexpr;
+mpc_parser_t *Expr;
+mpc_parser_t *Lispy;
+
+void lgrammar_init(void)
+{
+    if (Lispy)
+        return;
+
+    /* Create parsers */
+    Number = mpc_new("number");
+    Symbol = mpc_new("symbol");
+    String = mpc_new("string");
+    Comment = mpc_new("comment");
+    // Bool = mpc_new("bool");
+    Sexpr = mpc_new("sexpr");
+    Qexpr = mpc_new("qexpr");
+    Expr = mpc_new("expr");
+    Lispy = mpc_new("lispy");
+
+    /* Define parsers with the following DSL. */
+    mpca_lang(MPCA_LANG_DEFAULT,
+              "number: /-?[0-9]+(\\.[0-9]+)?([eE][-+]?[0-9]+)?/;"
+              //   "bool: \"true\" | \"false\";"
+              "symbol: /[a-zA-Z0-9_+%:\\-*\\/\\\\=<>!&\\|]+/;"
+              "string: /\"(\\\\.|[^\"\\\\])*\"/s;"
+              "comment: /;[^\\r\\n]*/;"
+              "sexpr: '(' <expr>* ')';"
+              "qexpr: '{' <expr>* '}';"
+              "expr: <number> | <symbol> | <string> | <comment> | <sexpr> | <qexpr>;"
+              "lispy: /^/ <expr>* /$/;",
+              Number, Symbol, String, Comment, Sexpr, Qexpr, Expr, Lispy);
+}
+
+int lgrammar_parse(const char *path, const char *text, mpc_result_t *r)
+{
+    return mpc_parse_view(path, text, Lispy, r, LRULE_COUNT,
+                          Number, Symbol, String, Comment, Sexpr, Qexpr, Expr, Lispy);
+}
+
+int lgrammar_parse_file(const char *path, mpc_result_t *r)
+{
+    return mpc_parse_view_contents(path, Lispy, r, LRULE_COUNT,
+                                   Number, Symbol, String, Comment, Sexpr, Qexpr, Expr, Lispy);
+}
+
+void lgrammar_cleanup(void)
+{
+    if (!Lispy)
+        return;
+
+    mpc_cleanup(8, Number, Symbol, String, Comment, Sexpr, Qexpr, Expr, Lispy);
+    Lispy = NULL;
+}
@@ -0,0 +1,37 @@
+#ifndef _LISPY_GRAMMAR
+#define _LISPY_GRAMMAR
+
+#include "mpc.h"
+
+/* Parser of a whole Lispy program, valid after `lgrammar_init`. */
+extern mpc_parser_t *Lispy;
+
+/* Tags of the nodes in a parsed program, the rules in grammar order. */
+enum lrule
+{
+    LRULE_NUMBER,
+    LRULE_SYMBOL,
+    LRULE_STRING,
+    LRULE_COMMENT,
+    LRULE_SEXPR,
+    LRULE_QEXPR,
+    LRULE_EXPR,
+    LRULE_LISPY,
+    LRULE_COUNT
+};
+
+/* Parse a program into a view of `text`, which must outlive it. The
+    output is freed with `mpc_view_delete`.
+*/
+int lgrammar_parse(const char *path, const char *text, mpc_result_t *r);
+/* Parse a file into a view that keeps the text of the file itself. */
+int lgrammar_parse_file(const char *path, mpc_result_t *r);
+
+/* Build the parsers from the grammar. Calling it again does nothing, so
+    `load` can set them up on demand in compiled programs.
+*/
+void lgrammar_init(void);
+/* Undefine and delete the parsers, if they were built. */
+void lgrammar_cleanup(void);
+
+#endif
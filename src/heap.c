@@ -0,0 +1,253 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "eval.h"
+#include "heap.h"
+#include "writer.h"
+
+/* Bytes kept aside so that the interpreter can still build an error value
+    and unwind after the system allocator itself has run dry.
+*/
+#define LHEAP_RESERVE (64 * 1024)
+
+/* Every block is prefixed with its size and kind, so frees and reallocs
+    can be accounted without the caller remembering either. The union keeps
+    the payload aligned like a plain `malloc` result.
+*/
+typedef union lheap_header
+{
+    struct
+    {
+        size_t size;
+        int kind;
+    };
+    long double align;
+} lheap_header;
+
+static struct
+{
+    size_t current;
+    size_t peak;
+    size_t limit;
+    int exceeded;
+    size_t kind_current[LHEAP_KINDS];
+    size_t kind_peak[LHEAP_KINDS];
+    void *reserve;
+} lheap;
+
+static void lheap_account(int kind, size_t add, size_t sub)
+{
+    lheap.current = lheap.current + add - sub;
+    lheap.kind_current[kind] = lheap.kind_current[kind] + add - sub;
+
+    if (lheap.current > lheap.peak)
+        lheap.peak = lheap.current;
+    if (lheap.kind_current[kind] > lheap.kind_peak[kind])
+        lheap.kind_peak[kind] = lheap.kind_current[kind];
+}
+
+/* Check whether growing by `add` bytes while releasing `sub` passes the limit. */
+static int lheap_over(size_t add, size_t sub)
+{
+    if (lheap.limit == 0 || add <= sub)
+        return 0;
+    return lheap.current >= lheap.limit || add - sub > lheap.limit - lheap.current;
+}
+
+/* Call the system allocator, falling back on the reserve when it fails. */
+static void *lheap_sys_realloc(void *ptr, size_t size)
+{
+    void *p = realloc(ptr, size);
+    if (p == NULL && lheap.reserve)
+    {
+        free(lheap.reserve);
+        lheap.reserve = NULL;
+        lheap.exceeded = 1;
+        p = realloc(ptr, size);
+    }
+    if (p == NULL)
+    {
+        lw_flush(&lw_out);
+        fprintf(stderr, "lispy: out of memory allocating %lu bytes.\n",
+                (unsigned long)size);
+        abort();
+    }
+    return p;
+}
+
+void *lheap_alloc(int kind, size_t size)
+{
+    /* Blocks sized by the interpreter itself are small and cannot fail, so
+        going over the limit only raises a flag. The evaluator turns it into
+        an error as soon as the running builtin returns.
+    */
+    if (lheap_over(size, 0))
+        lheap.exceeded = 1;
+
+    lheap_header *h = lheap_sys_realloc(NULL, sizeof(lheap_header) + size);
+    h->size = size;
+    h->kind = kind;
+    lheap_account(kind, size, 0);
+    return h + 1;
+}
+
+void *lheap_realloc(int kind, void *ptr, size_t size)
+{
+    if (ptr == NULL)
+        return size ? lheap_alloc(kind, size) : NULL;
+
+    if (size == 0)
+    {
+        lheap_free(ptr);
+        return NULL;
+    }
+
+    lheap_header *h = (lheap_header *)ptr - 1;
+    size_t old = h->size;
+    kind = h->kind;
+
+    if (lheap_over(size, old))
+        lheap.exceeded = 1;
+
+    h = lheap_sys_realloc(h, sizeof(lheap_header) + size);
+    h->size = size;
+    lheap_account(kind, size, old);
+    return h + 1;
+}
+
+void *lheap_try_alloc(int kind, size_t size)
+{
+    if (size > SIZE_MAX - sizeof(lheap_header) || lheap_over(size, 0))
+        return NULL;
+
+    /* The reserve is kept for the infallible path, a refused request here is
+        reported to the caller instead.
+    */
+    lheap_header *h = malloc(sizeof(lheap_header) + size);
+    if (h == NULL)
+        return NULL;
+    h->size = size;
+    h->kind = kind;
+    lheap_account(kind, size, 0);
+    return h + 1;
+}
+
+void lheap_free(void *ptr)
+{
+    if (ptr == NULL)
+        return;
+
+    lheap_header *h = (lheap_header *)ptr - 1;
+    lheap_account(h->kind, 0, h->size);
+    free(h);
+}
+
+char *lheap_strdup(int kind, const char *s)
+{
+    size_t n = strlen(s) + 1;
+    char *x = lheap_alloc(kind, n);
+    memcpy(x, s, n);
+    return x;
+}
+
+size_t lheap_current(void)
+{
+    return lheap.current;
+}
+
+size_t lheap_peak(void)
+{
+    return lheap.peak;
+}
+
+size_t lheap_kind_current(int kind)
+{
+    return lheap.kind_current[kind];
+}
+
+size_t lheap_kind_peak(int kind)
+{
+    return lheap.kind_peak[kind];
+}
+
+void lheap_set_limit(size_t limit)
+{
+    lheap.limit = limit;
+    if (lheap.reserve == NULL)
+        lheap.reserve = malloc(LHEAP_RESERVE);
+}
+
+size_t lheap_limit(void)
+{
+    return lheap.limit;
+}
+
+size_t lheap_parse_size(const char *s)
+{
+    char *end;
+    unsigned long long n = strtoull(s, &end, 10);
+    if (end == s)
+        return 0;
+
+    switch (toupper((unsigned char)*end))
+    {
+    case 'G':
+        n *= 1024;
+        /* fall through */
+    case 'M':
+        n *= 1024;
+        /* fall through */
+    case 'K':
+        n *= 1024;
+        end++;
+        break;
+    }
+    return *end == '\0' ? (size_t)n : 0;
+}
+
+int lheap_exceeded(void)
+{
+    return lheap.exceeded;
+}
+
+int lheap_take_exceeded(void)
+{
+    if (!lheap.exceeded)
+        return 0;
+
+    lheap.exceeded = 0;
+    /* Try to win back the reserve once the failing job has unwound. */
+    if (lheap.reserve == NULL)
+        lheap.reserve = malloc(LHEAP_RESERVE);
+    return 1;
+}
+
+static char *lheap_kind_name(int kind)
+{
+    return kind == LHEAP_ENV ? "Environment" : ltype_name(kind);
+}
+
+/* Print the heap usage per allocation kind. */
+lval *builtin_heap(lenv *e, lval *a)
+{
+    LASSERT(a, a->count == 0, "'_Heap' invalidly called. "
+        "It should called without any argument.");
+    lval_del(a);
+
+    lw_puts(&lw_out, "\n******* Heap Usage (current / peak bytes) *******\n");
+    for (int i = 0; i < LHEAP_KINDS; i++)
+    {
+        lw_printf(&lw_out, "%-14s %10lu / %lu\n", lheap_kind_name(i),
+                  (unsigned long)lheap.kind_current[i],
+                  (unsigned long)lheap.kind_peak[i]);
+    }
+    lw_printf(&lw_out, "%-14s %10lu / %lu\n", "Total",
+              (unsigned long)lheap.current, (unsigned long)lheap.peak);
+    if (lheap.limit)
+        lw_printf(&lw_out, "%-14s %10lu\n", "Limit", (unsigned long)lheap.limit);
+    lw_endline(&lw_out);
+    return lval_sexpr();
+}
@@ -0,0 +1,51 @@
+#ifndef _LISPY_HEAP
+#define _LISPY_HEAP
+
+#include <stddef.h>
+#include "eval.h"
+
+/* Allocation kinds. Every lval type owns its own bucket, environments
+    are accounted separately.
+*/
+#define LHEAP_ENV LVAL_TYPES
+#define LHEAP_KINDS (LVAL_TYPES + 1)
+
+/************* Tracking allocator ****************/
+/* Allocate `size` bytes accounted to the bucket `kind`. */
+void *lheap_alloc(int kind, size_t size);
+/* Resize a block. A NULL `ptr` allocates, a zero `size` frees and returns NULL. */
+void *lheap_realloc(int kind, void *ptr, size_t size);
+/* Allocate like `lheap_alloc`, but return NULL instead of going over the
+    limit or failing. Meant for blocks whose size comes from the program.
+*/
+void *lheap_try_alloc(int kind, size_t size);
+/* Free a block obtained from the tracking allocator. */
+void lheap_free(void *ptr);
+/* Duplicate a NUL-terminated string into the bucket `kind`. */
+char *lheap_strdup(int kind, const char *s);
+
+/************* Usage and limits ****************/
+size_t lheap_current(void);
+size_t lheap_peak(void);
+size_t lheap_kind_current(int kind);
+size_t lheap_kind_peak(int kind);
+
+/* Set the hard limit in bytes, 0 means unlimited. */
+void lheap_set_limit(size_t limit);
+size_t lheap_limit(void);
+/* Parse a size such as "512", "64K", "256M" or "2G". Returns 0 on failure. */
+size_t lheap_parse_size(const char *s);
+
+/* Check whether the limit has been passed since the flag was last cleared,
+    for loops that should stop early rather than keep growing.
+*/
+int lheap_exceeded(void);
+/* Check and clear the limit-exceeded flag raised by `lheap_alloc` and
+    `lheap_realloc` when they had to grow past the limit.
+*/
+int lheap_take_exceeded(void);
+
+/* Print the heap usage per allocation kind. */
+lval *builtin_heap(lenv *e, lval *a);
+
+#endif
@@ -0,0 +1,549 @@
+/* mmap, mprotect and getpid are POSIX. */
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "eval.h"
+#include "heap.h"
+#include "symbol.h"
+#include "jit.h"
+
+/* The emitter targets the System V x86-64 ABI, the result comes back in
+    rax:rdx as a two word struct. Everywhere else lambdas stay interpreted.
+*/
+#if defined(__x86_64__) && !defined(_WIN32)
+#define LJIT_X64 1
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+/* Calls before a lambda is compiled. */
+#define LJIT_THRESHOLD 50
+/* Give up on lambdas that keep being recompiled or bailing out. */
+#define LJIT_MAX_COMPILES 16
+#define LJIT_MAX_BAILS 64
+#define LJIT_MAX_PARAMS 16
+
+#ifdef LJIT_X64
+int ljit_enabled = 1;
+#else
+int ljit_enabled = 0;
+#endif
+
+struct ljit *ljit_new(void)
+{
+    struct ljit *j = lheap_alloc(LVAL_FUN, sizeof(struct ljit));
+    memset(j, 0, sizeof(struct ljit));
+    j->refs = 1;
+    j->state = LJIT_COLD;
+    return j;
+}
+
+struct ljit *ljit_ref(struct ljit *j)
+{
+    j->refs++;
+    return j;
+}
+
+static void ljit_drop_code(struct ljit *j)
+{
+#ifdef LJIT_X64
+    if (j->code)
+        munmap(j->code, j->map_len);
+#endif
+    j->code = NULL;
+    j->code_len = 0;
+    j->map_len = 0;
+}
+
+void ljit_unref(struct ljit *j)
+{
+    if (--j->refs)
+        return;
+    ljit_drop_code(j);
+    if (j->opt)
+        lval_del(j->opt);
+    lheap_free(j);
+}
+
+#ifdef LJIT_X64
+/************* Emitter ****************/
+/* Native entry point: arguments in an array, `bail` set when the call has
+    to be redone by the interpreter (overflow, division by zero).
+*/
+typedef struct
+{
+    int64_t val;
+    int64_t bail;
+} ljit_ret;
+typedef ljit_ret (*ljit_fn)(const int64_t *args);
+
+struct ljit_ctx
+{
+    unsigned char *buf;
+    size_t len;
+    size_t cap;
+    /* rel32 fields that jump to the bail out path or call the entry. */
+    size_t *bails;
+    int nbails;
+    size_t *calls;
+    int ncalls;
+
+    lenv *e;
+    lval *formals;
+    struct ljit *self;
+};
+
+static void ljit_emit(struct ljit_ctx *c, const void *p, size_t n)
+{
+    if (c->len + n > c->cap)
+    {
+        c->cap = c->cap ? c->cap * 2 + n : 256 + n;
+        c->buf = lheap_realloc(LVAL_FUN, c->buf, c->cap);
+    }
+    memcpy(c->buf + c->len, p, n);
+    c->len += n;
+}
+
+#define LJIT_EMIT(c, ...)                                      \
+    do                                                         \
+    {                                                          \
+        static const unsigned char ljit_op_[] = {__VA_ARGS__}; \
+        ljit_emit(c, ljit_op_, sizeof(ljit_op_));              \
+    } while (0)
+
+static void ljit_emit_u32(struct ljit_ctx *c, uint32_t x)
+{
+    ljit_emit(c, &x, 4);
+}
+
+/* Emit an empty rel32 field and return its offset. */
+static size_t ljit_rel32(struct ljit_ctx *c)
+{
+    size_t at = c->len;
+    ljit_emit_u32(c, 0);
+    return at;
+}
+
+static void ljit_patch(struct ljit_ctx *c, size_t at, size_t target)
+{
+    int32_t rel = (int32_t)((long)target - (long)(at + 4));
+    memcpy(c->buf + at, &rel, 4);
+}
+
+static void ljit_fixup(size_t **list, int *n, size_t at)
+{
+    *list = lheap_realloc(LVAL_FUN, *list, sizeof(size_t) * (*n + 1));
+    (*list)[(*n)++] = at;
+}
+
+/* jo/jnz/jz to the bail out path. */
+static void ljit_bail_if(struct ljit_ctx *c, unsigned char jcc)
+{
+    unsigned char op[] = {0x0F, jcc};
+    ljit_emit(c, op, 2);
+    ljit_fixup(&c->bails, &c->nbails, ljit_rel32(c));
+}
+#define LJIT_JO 0x80
+#define LJIT_JE 0x84
+#define LJIT_JNE 0x85
+
+static void ljit_mov_imm(struct ljit_ctx *c, long x)
+{
+    if (x >= INT32_MIN && x <= INT32_MAX)
+    {
+        LJIT_EMIT(c, 0x48, 0xC7, 0xC0); /* mov rax, simm32 */
+        ljit_emit_u32(c, (uint32_t)(int32_t)x);
+    }
+    else
+    {
+        LJIT_EMIT(c, 0x48, 0xB8); /* mov rax, imm64 */
+        int64_t v = x;
+        ljit_emit(c, &v, 8);
+    }
+}
+
+/************* Templates ****************/
+/* Static result kinds, LVAL_ERR marks an unsupported form. */
+#define LJIT_NONE LVAL_ERR
+
+static enum lval_type ljit_expr(struct ljit_ctx *c, lval *x);
+static enum lval_type ljit_list(struct ljit_ctx *c, lval *v);
+
+static int ljit_param(struct ljit_ctx *c, lval *sym)
+{
+    for (int i = 0; i < c->formals->count; i++)
+    {
+        if (c->formals->cell[i]->sym == sym->sym)
+            return i;
+    }
+    return -1;
+}
+
+/* Function bound to a global name no local binding can shadow. */
+static lval *ljit_resolve(struct ljit_ctx *c, lval *sym)
+{
+    if (sym->ic->rec->local)
+        return NULL;
+    lval *f = lenv_get(c->e, sym);
+    if (f->type != LVAL_FUN)
+    {
+        lval_del(f);
+        return NULL;
+    }
+    return f;
+}
+
+static enum lval_type ljit_expr(struct ljit_ctx *c, lval *x)
+{
+    switch (x->type)
+    {
+    case LVAL_NUM:
+        ljit_mov_imm(c, x->num);
+        return LVAL_NUM;
+
+    case LVAL_SYM:
+    {
+        /* Parameters are checked to be Numbers on entry. */
+        int i = ljit_param(c, x);
+        if (i < 0)
+            return LJIT_NONE;
+        LJIT_EMIT(c, 0x48, 0x8B, 0x83); /* mov rax, [rbx + disp32] */
+        ljit_emit_u32(c, (uint32_t)(8 * i));
+        return LVAL_NUM;
+    }
+
+    case LVAL_SEXPR:
+        return ljit_list(c, x);
+
+    default:
+        return LJIT_NONE;
+    }
+}
+
+/* Evaluate operand `i` into rcx, keeping the running value in rax. */
+static int ljit_operand(struct ljit_ctx *c, lval *x)
+{
+    LJIT_EMIT(c, 0x50); /* push rax */
+    if (ljit_expr(c, x) != LVAL_NUM)
+        return 0;
+    LJIT_EMIT(c, 0x48, 0x89, 0xC1); /* mov rcx, rax */
+    LJIT_EMIT(c, 0x58);             /* pop rax */
+    return 1;
+}
+
+static enum lval_type ljit_arith(struct ljit_ctx *c, lval *v, char op)
+{
+    int n = v->count - 1;
+    if (n < 1 || (n == 1 && op != '-'))
+        return LJIT_NONE;
+    if (ljit_expr(c, v->cell[1]) != LVAL_NUM)
+        return LJIT_NONE;
+
+    if (n == 1)
+    {
+        LJIT_EMIT(c, 0x48, 0xF7, 0xD8); /* neg rax */
+        ljit_bail_if(c, LJIT_JO);
+        return LVAL_NUM;
+    }
+
+    for (int i = 2; i <= n; i++)
+    {
+        if (!ljit_operand(c, v->cell[i]))
+            return LJIT_NONE;
+        switch (op)
+        {
+        case '+':
+            LJIT_EMIT(c, 0x48, 0x01, 0xC8); /* add rax, rcx */
+            ljit_bail_if(c, LJIT_JO);
+            break;
+        case '-':
+            LJIT_EMIT(c, 0x48, 0x29, 0xC8); /* sub rax, rcx */
+            ljit_bail_if(c, LJIT_JO);
+            break;
+        case '*':
+            LJIT_EMIT(c, 0x48, 0x0F, 0xAF, 0xC1); /* imul rax, rcx */
+            ljit_bail_if(c, LJIT_JO);
+            break;
+        case '/':
+        case '%':
+            /* Division by zero and LONG_MIN / -1 go back to the interpreter. */
+            LJIT_EMIT(c, 0x48, 0x85, 0xC9); /* test rcx, rcx */
+            ljit_bail_if(c, LJIT_JE);
+            LJIT_EMIT(c, 0x48, 0x83, 0xF9, 0xFF, /* cmp rcx, -1 */
+                      0x75, 0x13,                /* jne +19 */
+                      0x48, 0xBA, 0, 0, 0, 0, 0, 0, 0, 0x80, /* mov rdx, LONG_MIN */
+                      0x48, 0x39, 0xD0);         /* cmp rax, rdx */
+            ljit_bail_if(c, LJIT_JE);
+            LJIT_EMIT(c, 0x48, 0x99,        /* cqo */
+                      0x48, 0xF7, 0xF9);    /* idiv rcx */
+            if (op == '%')
+                LJIT_EMIT(c, 0x48, 0x89, 0xD0); /* mov rax, rdx */
+            break;
+        }
+    }
+    return LVAL_NUM;
+}
+
+static enum lval_type ljit_compare(struct ljit_ctx *c, lval *v, unsigned char setcc)
+{
+    if (v->count != 3 || ljit_expr(c, v->cell[1]) != LVAL_NUM || !ljit_operand(c, v->cell[2]))
+        return LJIT_NONE;
+    unsigned char op[] = {0x48, 0x39, 0xC8,  /* cmp rax, rcx */
+                          0x0F, setcc, 0xC0, /* setcc al */
+                          0x0F, 0xB6, 0xC0}; /* movzx eax, al */
+    ljit_emit(c, op, sizeof(op));
+    return LVAL_BOOL;
+}
+
+static enum lval_type ljit_if(struct ljit_ctx *c, lval *v)
+{
+    if (v->count != 4 || v->cell[2]->type != LVAL_QEXPR || v->cell[3]->type != LVAL_QEXPR)
+        return LJIT_NONE;
+    if (ljit_expr(c, v->cell[1]) != LVAL_BOOL)
+        return LJIT_NONE;
+
+    LJIT_EMIT(c, 0x48, 0x85, 0xC0, 0x0F, 0x84); /* test rax, rax; jz else */
+    size_t to_else = ljit_rel32(c);
+    enum lval_type then = ljit_list(c, v->cell[2]);
+    LJIT_EMIT(c, 0xE9); /* jmp end */
+    size_t to_end = ljit_rel32(c);
+    ljit_patch(c, to_else, c->len);
+    enum lval_type other = ljit_list(c, v->cell[3]);
+    ljit_patch(c, to_end, c->len);
+
+    return then == other ? then : LJIT_NONE;
+}
+
+/* Recursive call of the lambda being compiled, straight to its entry. */
+static enum lval_type ljit_self_call(struct ljit_ctx *c, lval *v)
+{
+    int n = v->count - 1;
+    if (n != c->formals->count)
+        return LJIT_NONE;
+
+    /* Push the arguments last first, so they end up as an array. */
+    for (int i = n; i >= 1; i--)
+    {
+        if (ljit_expr(c, v->cell[i]) != LVAL_NUM)
+            return LJIT_NONE;
+        LJIT_EMIT(c, 0x50); /* push rax */
+    }
+    LJIT_EMIT(c, 0x48, 0x89, 0xE7, 0xE8); /* mov rdi, rsp; call entry */
+    ljit_fixup(&c->calls, &c->ncalls, ljit_rel32(c));
+    LJIT_EMIT(c, 0x48, 0x81, 0xC4); /* add rsp, imm32 */
+    ljit_emit_u32(c, (uint32_t)(8 * n));
+    LJIT_EMIT(c, 0x85, 0xD2); /* test edx, edx */
+    ljit_bail_if(c, LJIT_JNE);
+
+    /* Recursive results are Numbers, checked once the body is known. */
+    return LVAL_NUM;
+}
+
+/* A list evaluated as an S-Expression. */
+static enum lval_type ljit_list(struct ljit_ctx *c, lval *v)
+{
+    if (v->count == 1)
+        return ljit_expr(c, v->cell[0]);
+    if (v->count < 2 || v->cell[0]->type != LVAL_SYM || ljit_param(c, v->cell[0]) >= 0)
+        return LJIT_NONE;
+
+    lval *f = ljit_resolve(c, v->cell[0]);
+    if (!f)
+        return LJIT_NONE;
+
+    enum lval_type t = LJIT_NONE;
+    lbuiltin b = f->builtin;
+    if (!b)
+        t = f->jit == c->self ? ljit_self_call(c, v) : LJIT_NONE;
+    else if (b == builtin_add)
+        t = ljit_arith(c, v, '+');
+    else if (b == builtin_sub)
+        t = ljit_arith(c, v, '-');
+    else if (b == builtin_mul)
+        t = ljit_arith(c, v, '*');
+    else if (b == builtin_div)
+        t = ljit_arith(c, v, '/');
+    else if (b == builtin_mod)
+        t = ljit_arith(c, v, '%');
+    else if (b == builtin_lt)
+        t = ljit_compare(c, v, 0x9C);
+    else if (b == builtin_gt)
+        t = ljit_compare(c, v, 0x9F);
+    else if (b == builtin_le)
+        t = ljit_compare(c, v, 0x9E);
+    else if (b == builtin_ge)
+        t = ljit_compare(c, v, 0x9D);
+    else if (b == builtin_eq)
+        t = ljit_compare(c, v, 0x94);
+    else if (b == builtin_ne)
+        t = ljit_compare(c, v, 0x95);
+    else if (b == builtin_if)
+        t = ljit_if(c, v);
+
+    lval_del(f);
+    return t;
+}
+
+/************* Compile ****************/
+/* Let perf attribute samples in JIT code, see tools/perf/Documentation/jit-interface.txt. */
+static void ljit_perf_map(lenv *e, struct ljit *j)
+{
+    static FILE *map = NULL;
+    if (!map)
+    {
+        char path[64];
+        snprintf(path, sizeof(path), "/tmp/perf-%d.map", (int)getpid());
+        if (!(map = fopen(path, "a")))
+            return;
+    }
+
+    /* Name the code after a global binding of the lambda when there is one. */
+    const char *name = "lambda";
+    for (; e; e = e->par)
+    {
+        if (!e->global)
+            continue;
+        for (int i = 0; i < e->count; i++)
+        {
+            lval *v = e->dicts[i].val;
+            if (v->type == LVAL_FUN && !v->builtin && v->jit == j)
+                name = e->dicts[i].sym;
+        }
+    }
+    fprintf(map, "%lx %lx lispy:%s\n", (unsigned long)(uintptr_t)j->code,
+            (unsigned long)j->code_len, name);
+    fflush(map);
+}
+
+static int ljit_compile(lenv *e, lval *f, struct ljit *j)
+{
+    int n = f->formals->count;
+    if (n > LJIT_MAX_PARAMS || f->bound)
+        return 0;
+    for (int i = 0; i < n; i++)
+    {
+        if (STR_EQ(f->formals->cell[i]->sym, "&"))
+            return 0;
+    }
+
+    struct ljit_ctx c;
+    memset(&c, 0, sizeof(c));
+    c.e = e;
+    c.formals = f->formals;
+    c.self = j;
+
+    /* `\` keeps the body Q-Expression, `fun` wraps it as ({...}). */
+    lval *body = f->body;
+    if (body->type == LVAL_SEXPR && body->count == 1)
+        body = body->cell[0];
+    if (body->type != LVAL_QEXPR)
+        return 0;
+
+    /* push rbp; mov rbp, rsp; push rbx; mov rbx, rdi */
+    LJIT_EMIT(&c, 0x55, 0x48, 0x89, 0xE5, 0x53, 0x48, 0x89, 0xFB);
+    enum lval_type t = ljit_list(&c, body);
+    int ok = t != LJIT_NONE && (c.ncalls == 0 || t == LVAL_NUM);
+
+    /* xor edx, edx; lea rsp, [rbp - 8]; pop rbx; pop rbp; ret */
+    LJIT_EMIT(&c, 0x31, 0xD2, 0x48, 0x8D, 0x65, 0xF8, 0x5B, 0x5D, 0xC3);
+    size_t bail = c.len;
+    /* mov edx, 1; lea rsp, [rbp - 8]; pop rbx; pop rbp; ret */
+    LJIT_EMIT(&c, 0xBA, 0x01, 0x00, 0x00, 0x00, 0x48, 0x8D, 0x65, 0xF8, 0x5B, 0x5D, 0xC3);
+    for (int i = 0; i < c.nbails; i++)
+        ljit_patch(&c, c.bails[i], bail);
+    for (int i = 0; i < c.ncalls; i++)
+        ljit_patch(&c, c.calls[i], 0);
+
+    if (ok)
+    {
+        long page = sysconf(_SC_PAGESIZE);
+        size_t map_len = (c.len + page - 1) / page * page;
+        void *code = mmap(NULL, map_len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (code == MAP_FAILED)
+        {
+            ok = 0;
+        }
+        else
+        {
+            /* Never writable and executable at the same time. */
+            memcpy(code, c.buf, c.len);
+            mprotect(code, map_len, PROT_READ | PROT_EXEC);
+            j->code = code;
+            j->code_len = c.len;
+            j->map_len = map_len;
+            j->nparams = n;
+            j->result = t;
+            j->version = lenv_version;
+            j->state = LJIT_READY;
+            ljit_perf_map(e, j);
+        }
+    }
+
+    lheap_free(c.buf);
+    lheap_free(c.bails);
+    lheap_free(c.calls);
+    return ok;
+}
+
+lval *ljit_call(lenv *e, lval *f, lval *a)
+{
+    struct ljit *j = f->jit;
+    if (!ljit_enabled || j->state == LJIT_FAILED)
+        return NULL;
+
+    /* Globals the code relied on may have changed. */
+    if (j->state == LJIT_READY && j->version != lenv_version)
+    {
+        ljit_drop_code(j);
+        j->state = LJIT_COLD;
+    }
+
+    if (j->state == LJIT_COLD)
+    {
+        if (++j->calls < LJIT_THRESHOLD)
+            return NULL;
+        if (++j->compiles > LJIT_MAX_COMPILES || !ljit_compile(e, f, j))
+        {
+            j->state = LJIT_FAILED;
+            return NULL;
+        }
+    }
+
+    /* Only complete calls with Number arguments run natively. */
+    if (f->bound || f->formals->count != j->nparams || a->count != j->nparams)
+        return NULL;
+    int64_t args[LJIT_MAX_PARAMS];
+    for (int i = 0; i < a->count; i++)
+    {
+        if (a->cell[i]->type != LVAL_NUM)
+            return NULL;
+        args[i] = a->cell[i]->num;
+    }
+
+    ljit_ret r = ((ljit_fn)j->code)(args);
+    if (r.bail)
+    {
+        if (++j->bails > LJIT_MAX_BAILS)
+        {
+            ljit_drop_code(j);
+            j->state = LJIT_FAILED;
+        }
+        return NULL;
+    }
+
+    lval_del(a);
+    return j->result == LVAL_BOOL ? lval_bool(r.val) : lval_num(r.val);
+}
+
+#else
+
+lval *ljit_call(lenv *e, lval *f, lval *a)
+{
+    return NULL;
+}
+
+#endif
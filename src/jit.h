@@ -0,0 +1,54 @@
+#ifndef _LISPY_JIT
+#define _LISPY_JIT
+
+#include <stddef.h>
+#include "eval.h"
+
+enum ljit_state
+{
+    LJIT_COLD,
+    LJIT_READY,
+    LJIT_FAILED,
+};
+
+/* Profile, folded body and native code of one lambda, shared by all
+    copies of it.
+*/
+struct ljit
+{
+    int refs;
+    enum ljit_state state;
+    long calls;
+    int compiles;
+    int bails;
+    /* Global environment version the code was compiled against. */
+    unsigned long version;
+    int nparams;
+    /* Whether the body yields a Number or a Bool. */
+    enum lval_type result;
+    void *code;
+    size_t code_len;
+    size_t map_len;
+
+    /* Body with constants folded, valid while `opt_version` is current. */
+    lval *opt;
+    unsigned long opt_version;
+    /* Global environment version of the last calls, and their number. */
+    unsigned long opt_seen;
+    int opt_calls;
+};
+
+/* Set to 0 to keep every call in the interpreter. */
+extern int ljit_enabled;
+
+struct ljit *ljit_new(void);
+struct ljit *ljit_ref(struct ljit *j);
+void ljit_unref(struct ljit *j);
+
+/* Count a call of the lambda `f` and run it natively once it is hot and
+    its body compiles. Returns NULL to leave the call to the interpreter,
+    otherwise the result, with `a` consumed.
+*/
+lval *ljit_call(lenv *e, lval *f, lval *a);
+
+#endif
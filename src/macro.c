@@ -0,0 +1,122 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "eval.h"
+#include "map.h"
+#include "macro.h"
+
+/* Guard against macros that keep expanding into themselves. */
+#define LMACRO_DEPTH 1000
+
+/* Macros are global, keyed by their symbol. */
+static lval *lmacros = NULL;
+
+static lval *lmacro_find(lval *v)
+{
+    if (v->count == 0 || v->cell[0]->type != LVAL_SYM)
+        return NULL;
+    return lmap_get(lmacros->map, v->cell[0]);
+}
+
+static lval *lmacro_expand(lenv *e, lval *v, int depth)
+{
+    if (v->type != LVAL_SEXPR && v->type != LVAL_QEXPR)
+        return v;
+
+    /* Leave macro declarations alone, so a macro can be redefined. */
+    if (v->count && v->cell[0]->type == LVAL_SYM && STR_EQ(v->cell[0]->sym, "defmacro"))
+        return v;
+
+    lval *m;
+    while ((m = lmacro_find(v)))
+    {
+        if (++depth > LMACRO_DEPTH)
+        {
+            lval_del(v);
+            return lval_err("Macro expansion nested deeper than %d levels.", LMACRO_DEPTH);
+        }
+
+        /* Call the macro on the raw argument forms. */
+        enum lval_type type = v->type;
+        int line = v->line;
+        int col = v->col;
+        lval_del(lval_pop(v, 0));
+        v->type = LVAL_SEXPR;
+
+        lval *f = lval_copy(m);
+        lval *x = lval_call(e, f, v);
+        lval_del(f);
+
+        /* A list result replaces the call site as code of the same kind. */
+        if (x->type != LVAL_QEXPR)
+            return x;
+        x->type = type;
+        if (x->line == 0)
+        {
+            x->line = line;
+            x->col = col;
+        }
+        v = x;
+    }
+
+    for (int i = 0; i < v->count; i++)
+    {
+        v->cell[i] = lmacro_expand(e, v->cell[i], depth);
+        if (LVAL_IS_RAISED(v->cell[i]))
+            return lval_take(v, i);
+    }
+    return v;
+}
+
+lval *lval_expand(lenv *e, lval *v)
+{
+    /* Nothing to do until the first macro is defined. */
+    if (!lmacros || lmacros->map->count == 0)
+        return v;
+    return lmacro_expand(e, v, 0);
+}
+
+/************* Builtins ****************/
+lval *builtin_defmacro(lenv *e, lval *a)
+{
+    LASSERT(a, a->count == 2, "Function 'defmacro' passed wrong number of arguments. "
+                              "Got %d, Expected %d.",
+            a->count, 2);
+    LASSERT(a, a->cell[0]->type == LVAL_QEXPR && a->cell[1]->type == LVAL_QEXPR,
+            "Function 'defmacro' expects a declaration and a body. Got %s and %s.",
+            ltype_name(a->cell[0]->type), ltype_name(a->cell[1]->type));
+    LASSERT(a, a->cell[0]->count >= 1, "Function 'defmacro' passed an empty declaration.");
+    for (int i = 0; i < a->cell[0]->count; i++)
+    {
+        LASSERT(a, a->cell[0]->cell[i]->type == LVAL_SYM,
+                "Cannot define non-symbol argument at pos %d. Got %s, Expected %s.",
+                i, ltype_name(a->cell[0]->cell[i]->type), ltype_name(LVAL_SYM));
+    }
+
+    lval *decl = lval_pop(a, 0);
+    lval *name = lval_pop(decl, 0);
+    lval *body = lval_take(a, 0);
+
+    if (!lmacros)
+        lmacros = lval_map();
+    lmap_put(lmacros->map, name, lval_lambda(decl, body));
+    return lval_sexpr();
+}
+
+lval *builtin_macroexpand(lenv *e, lval *a)
+{
+    LASSERT(a, a->count == 1, "Function 'macroexpand' passed wrong number of arguments. "
+                              "Got %d, Expected %d.",
+            a->count, 1);
+    LASSERT(a, a->cell[0]->type == LVAL_QEXPR, "Function 'macroexpand' passed invalid type. "
+                                               "Got %s, Expected %s.",
+            ltype_name(a->cell[0]->type), ltype_name(LVAL_QEXPR));
+
+    return lval_expand(e, lval_take(a, 0));
+}
+
+void lenv_add_macro_builtins(lenv *e)
+{
+    lenv_add_builtin(e, "defmacro", builtin_defmacro);
+    lenv_add_builtin(e, "macroexpand", builtin_macroexpand);
+}
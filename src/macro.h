@@ -0,0 +1,20 @@
+#ifndef _LISPY_MACRO
+#define _LISPY_MACRO
+
+#include "eval.h"
+
+/* Expand every macro call in `v` in place and return the expanded form,
+    or an error raised by a macro. A call site is a list whose head names
+    a macro, its arguments are handed over unevaluated. Forms are expanded
+    once, when they are loaded and when lambdas are created, so evaluating
+    them later costs nothing extra.
+*/
+lval *lval_expand(lenv *e, lval *v);
+
+/************* Builtins ****************/
+lval *builtin_defmacro(lenv *e, lval *a);
+lval *builtin_macroexpand(lenv *e, lval *a);
+
+void lenv_add_macro_builtins(lenv *e);
+
+#endif
@@ -1,93 +1,175 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include <readline.h>
 
 #include "mpc.h"
 #include "eval.h"
+#include "grammar.h"
+#include "heap.h"
+#include "writer.h"
+#include "macro.h"
+#include "jit.h"
+#include "compile.h"
+#include "opt.h"
+#include "module.h"
+#include "pool.h"
+#include "scan.h"
+
+static void run(lenv *e, char const *input, int *flag);
+
+/* A file from the command line, parsed on a worker thread. */
+struct lparse
+{
+    char *path;
+    /* Big files are left to `load`, which splits them. */
+    int big;
+    int ok;
+    mpc_result_t r;
+};
 
-/* Create parsers */
-mpc_parser_t *Number;
-mpc_parser_t *Symbol;
-mpc_parser_t *String;
-mpc_parser_t *Comment;
-// mpc_parser_t *Bool = mpc_new("bool");
-mpc_parser_t *Sexpr;
-mpc_parser_t *Qexpr;
-mpc_parser_t *Expr;
-mpc_parser_t *Lispy;
-
-static void run(lenv *e, char const *input, mpc_parser_t *parser, int *flag);
+static void parse_job(void *ctx, int i)
+{
+    struct lparse *p = (struct lparse *)ctx + i;
+    p->big = lscan_worth(p->path);
+    if (!p->big)
+        p->ok = lgrammar_parse_file(p->path, &p->r);
+}
 
 int main(int argc, char **argv)
 {
-    /* Create parsers */
-    Number = mpc_new("number");
-    Symbol = mpc_new("symbol");
-    String = mpc_new("string");
-    Comment = mpc_new("comment");
-    // Bool = mpc_new("bool");
-    Sexpr = mpc_new("sexpr");
-    Qexpr = mpc_new("qexpr");
-    Expr = mpc_new("expr");
-    Lispy = mpc_new("lispy");
-
-    /* Define parsers with the following DSL. */
-    mpca_lang(MPCA_LANG_DEFAULT,
-              "number: /-?[0-9]+/;"
-              //   "bool: \"true\" | \"false\";"
-              "symbol: /[a-zA-Z0-9_+\\-*\\/\\\\=<>!&\\|]+/;"
-              "string: /\"(\\\\.|[^\"])*\"/;"
-              "comment: /;[^\\r\\n]*/;"
-              "sexpr: '(' <expr>* ')';"
-              "qexpr: '{' <expr>* '}';"
-              "expr: <number> | <symbol> | <string> | <comment> | <sexpr> | <qexpr>;"
-              "lispy: /^/ <expr>* /$/;",
-              Number, Symbol, String, Comment, Sexpr, Qexpr, Expr, Lispy);
+    lgrammar_init();
 
     /* Print Version and Exit Information */
     char const welcome_info[] = ("Lispy Version 0.0.1 (C) Copyright 2022, Chenyu Lue\n"
                                  "Press Ctrl + C or type 'exit' to Exit\n");
 
+    /* Pull the options out of the argument list, keeping only the files. */
+    int nfiles = 0;
+    int compile_c = 0;
+    char *out = NULL;
+    for (int i = 1; i < argc; i++)
+    {
+        if (STR_EQ(argv[i], "--max-heap"))
+        {
+            size_t limit = i + 1 < argc ? lheap_parse_size(argv[++i]) : 0;
+            if (limit == 0)
+            {
+                fprintf(stderr, "Option '--max-heap' expects a size such as 64M.\n");
+                return EXIT_FAILURE;
+            }
+            lheap_set_limit(limit);
+            continue;
+        }
+        if (STR_EQ(argv[i], "--no-jit"))
+        {
+            ljit_enabled = 0;
+            continue;
+        }
+        if (STR_EQ(argv[i], "--compile-c"))
+        {
+            compile_c = 1;
+            continue;
+        }
+        if (STR_EQ(argv[i], "-o"))
+        {
+            if (i + 1 == argc)
+            {
+                fprintf(stderr, "Option '-o' expects a file name.\n");
+                return EXIT_FAILURE;
+            }
+            out = argv[++i];
+            continue;
+        }
+        argv[++nfiles] = argv[i];
+    }
+
+    /* Translate a script to C instead of running it. */
+    if (compile_c)
+    {
+        if (nfiles != 1)
+        {
+            fprintf(stderr, "Option '--compile-c' expects exactly one script.\n");
+            return EXIT_FAILURE;
+        }
+        int ok = lcomp_file(argv[1], out);
+        lgrammar_cleanup();
+        return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    /* Show output line by line on a terminal, in big blocks otherwise. */
+    lw_out.line_buffered = isatty(STDOUT_FILENO);
+
     lenv *e = lenv_new();
+    e->global = true;
     lenv_add_builtins(e);
     /* Supplied with list of files */
-    if (argc >= 2)
+    if (nfiles >= 1)
     {
-        /* Loop over each supplied filename (starting from 1). */
-        for (int i = 1; i < argc; i++)
+        /* All files are parsed at once, and evaluated in order as soon as
+            each one is ready.
+        */
+        struct lparse *files = lheap_alloc(LHEAP_ENV, sizeof(struct lparse) * nfiles);
+        for (int i = 0; i < nfiles; i++)
+            files[i].path = argv[i + 1];
+        struct lpool *pool = lpool_start(nfiles, parse_job, files);
+
+        int stop = 0;
+        for (int i = 0; i < nfiles; i++)
         {
-            /* Argument list with a single argument, the filename. */
-            lval *args = lval_add(lval_sexpr(), lval_str(argv[i]));
+            lpool_wait(pool, i);
+
+            /* Files after an exit are parsed for nothing. */
+            if (stop)
+            {
+                if (files[i].big)
+                    continue;
+                if (files[i].ok)
+                    mpc_view_delete(files[i].r.output);
+                else
+                    mpc_err_delete(files[i].r.error);
+                continue;
+            }
+
+            /* Evaluate the file as builtin load does. */
+            lval *x = files[i].big ? builtin_load(e, lval_add(lval_sexpr(), lval_str(files[i].path)))
+                                   : lval_load_result(e, files[i].ok, &files[i].r);
 
-            /* Pass to builtin load and get the result. */
-            lval *x = builtin_load(e, args);
+            /* Exit ends the whole run, without loading further files. */
+            if (LVAL_IS_RAISED(x) && x->code == LERR_EXIT)
+            {
+                stop = 1;
+            }
 
             /* If the result is an error, be sure to print it to stdout. */
-            if (x->type == LVAL_ERR)
+            else if (LVAL_IS_RAISED(x))
             {
                 lval_println(e, x);
             }
             lval_del(x);
         }
+        lpool_finish(pool);
+        lheap_free(files);
     }
     else
     {
-        puts(welcome_info);
+        lw_puts(&lw_out, welcome_info);
 
         /* In a forever looping */
         int flag = 1;
         while (flag)
         {
             /* Output the prompt and get input */
+            lw_flush(&lw_out);
             char *input = readline("lispy> ");
 
             /* Add input to history */
             add_history(input);
 
             /* Attemp to Parse and run the user input. */
-            run(e, input, Lispy, &flag);
+            run(e, input, &flag);
 
             /* Free retrieved input */
             free(input);
@@ -96,26 +178,30 @@ int main(int argc, char **argv)
 
     /* Delete the environment. */
     lenv_del(e);
+    lmod_cleanup();
+    lw_flush(&lw_out);
 
     /* Undefine and delete our parsers. */
-    mpc_cleanup(8, Number, Symbol, String, Comment, Sexpr, Qexpr, Expr, Lispy);
+    lgrammar_cleanup();
 
     return EXIT_SUCCESS;
 }
 
-static void run(lenv *e, char const *input, mpc_parser_t *parser, int *flag)
+static void run(lenv *e, char const *input, int *flag)
 {
     mpc_result_t r;
-    if (mpc_parse("<stdin>", input, parser, &r))
+    if (lgrammar_parse("<stdin>", input, &r))
     {
+        /* Each line starts over, whatever the previous one left behind. */
+        lheap_take_exceeded();
         /* On Success Print the AST. */
-        lval *result = lval_eval(e, lval_read(r.output));
+        lval *result = lval_eval(e, lval_optimize(e, lval_expand(e, lval_read(r.output))));
         // if (result->type == LVAL_FUN && result->builtin == builtin_print_env)
         //     builtin_print_env(e);
         // if (result->type == LVAL_FUN && result->builtin == lispy_exit)
         //     lispy_exit(flag);
         // else
-        if (result->type == LVAL_ERR && STR_EQ(result->err, "exit"))
+        if (LVAL_IS_RAISED(result) && result->code == LERR_EXIT)
         {
             *flag = 0;
         }
@@ -124,11 +210,12 @@ static void run(lenv *e, char const *input, mpc_parser_t *parser, int *flag)
             lval_println(e, result);
         }
         lval_del(result);
-        mpc_ast_delete(r.output);
+        mpc_view_delete(r.output);
     }
     else
     {
-        /* Otherwise print the error. */
+        /* Otherwise print the error, after the output buffered so far. */
+        lw_flush(&lw_out);
         mpc_err_print(r.error);
         mpc_err_delete(r.error);
     }
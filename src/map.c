@@ -0,0 +1,425 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "eval.h"
+#include "heap.h"
+#include "vec.h"
+#include "bignum.h"
+#include "map.h"
+#include "writer.h"
+
+/* Smallest table, always a power of two. */
+#define LMAP_MIN_CAP 8
+
+/************* Hashing ****************/
+/* Finalizer of splitmix64, spreads every input bit over the whole word. */
+static uint64_t lhash_mix(uint64_t x)
+{
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+static uint64_t lhash_combine(uint64_t h, uint64_t x)
+{
+    return lhash_mix(h ^ (x + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2)));
+}
+
+/* Hash a byte string eight bytes at a time. */
+static uint64_t lhash_bytes(uint64_t seed, const void *p, size_t n)
+{
+    const unsigned char *s = p;
+    uint64_t h = seed ^ (n * 0x9e3779b97f4a7c15ULL);
+    while (n >= 8)
+    {
+        uint64_t w;
+        memcpy(&w, s, 8);
+        h = (h ^ lhash_mix(w)) * 0x100000001b3ULL;
+        s += 8;
+        n -= 8;
+    }
+
+    uint64_t w = 0;
+    memcpy(&w, s, n);
+    return lhash_mix(h ^ w);
+}
+
+static uint64_t lhash_big(struct lbig *b)
+{
+    return lhash_bytes(LVAL_BIG ^ (uint64_t)b->sign, b->d, sizeof(uint32_t) * b->n);
+}
+
+/* Integral doubles equal the matching number or bignum, so they hash the same. */
+static uint64_t lhash_dbl(double x)
+{
+    if (x >= -9223372036854775808.0 && x < 9223372036854775808.0)
+    {
+        if (x == (double)(long)x)
+            return lhash_combine(LVAL_NUM, (uint64_t)(long)x);
+    }
+    else if (isfinite(x))
+    {
+        /* Every double this large is an integer. */
+        struct lbig *b = lbig_from_double(x);
+        uint64_t h = lhash_big(b);
+        lbig_unref(b);
+        return h;
+    }
+    return lhash_bytes(LVAL_DBL, &x, sizeof(double));
+}
+
+/* Structural hash consistent with `lval_eq`. */
+uint64_t lval_hash(lval *v)
+{
+    uint64_t h = (uint64_t)v->type;
+    switch (v->type)
+    {
+    case LVAL_DBL:
+        return lhash_dbl(v->dbl);
+    case LVAL_NUM:
+    case LVAL_BOOL:
+        return lhash_combine(v->type == LVAL_BOOL ? LVAL_BOOL : LVAL_NUM, (uint64_t)v->num);
+    case LVAL_BIG:
+        return lhash_big(v->big);
+    case LVAL_ERR:
+        return lerr_text(v) ? lhash_bytes(h ^ v->code, v->err, strlen(v->err)) : lhash_combine(h, v->code);
+    case LVAL_SYM:
+        return lhash_bytes(h, v->sym, strlen(v->sym));
+    case LVAL_STR:
+        return lhash_bytes(h, v->str, v->len);
+    case LVAL_FUN:
+        if (v->builtin)
+            return lhash_combine(h, (uint64_t)(uintptr_t)v->builtin);
+        return lhash_combine(lval_hash(v->formals), lval_hash(v->body));
+    case LVAL_F64VEC:
+        for (long i = 0; i < v->vec->len; i++)
+            h = lhash_combine(h, lhash_dbl(v->vec->f64[i]));
+        return h;
+    case LVAL_I64VEC:
+        return lhash_bytes(h, v->vec->i64, sizeof(int64_t) * v->vec->len);
+    case LVAL_MAP:
+        /* Maps and builders compare by identity. */
+        return lhash_combine(h, (uint64_t)(uintptr_t)v->map);
+    case LVAL_SB:
+        return lhash_combine(h, (uint64_t)(uintptr_t)v->sb);
+    case LVAL_SEXPR:
+    case LVAL_QEXPR:
+        for (int i = 0; i < v->count; i++)
+            h = lhash_combine(h, lval_hash(v->cell[i]));
+        return h;
+    }
+    return h;
+}
+
+/************* Construct and release maps ****************/
+lval *lval_map(void)
+{
+    struct lmap *m = lheap_alloc(LVAL_MAP, sizeof(struct lmap));
+    m->refs = 1;
+    m->count = 0;
+    m->cap = 0;
+    m->slots = NULL;
+
+    lval *v = lheap_alloc(LVAL_MAP, sizeof(lval));
+    v->type = LVAL_MAP;
+    v->map = m;
+    return v;
+}
+
+struct lmap *lmap_ref(struct lmap *m)
+{
+    m->refs++;
+    return m;
+}
+
+void lmap_unref(struct lmap *m)
+{
+    if (--m->refs)
+        return;
+
+    for (long i = 0; i < m->cap; i++)
+    {
+        if (m->slots[i].key)
+        {
+            lval_del(m->slots[i].key);
+            lval_del(m->slots[i].val);
+        }
+    }
+    lheap_free(m->slots);
+    lheap_free(m);
+}
+
+/************* Open addressing ****************/
+/* Slot holding `k`, or the empty slot where it would go. */
+static long lmap_find(struct lmap *m, lval *k, uint64_t hash)
+{
+    long mask = m->cap - 1;
+    long i = (long)(hash & mask);
+    while (m->slots[i].key)
+    {
+        if (m->slots[i].hash == hash && lval_eq(m->slots[i].key, k))
+            return i;
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+/* Double the table once it would pass a load factor of 3/4. */
+static void lmap_grow(struct lmap *m)
+{
+    if ((m->count + 1) * 4 <= m->cap * 3)
+        return;
+
+    long old_cap = m->cap;
+    struct lmap_entry *old = m->slots;
+    m->cap = old_cap ? old_cap * 2 : LMAP_MIN_CAP;
+    m->slots = lheap_alloc(LVAL_MAP, sizeof(struct lmap_entry) * m->cap);
+    memset(m->slots, 0, sizeof(struct lmap_entry) * m->cap);
+
+    /* Keys are distinct, so reinsertion only needs the first empty slot. */
+    long mask = m->cap - 1;
+    for (long i = 0; i < old_cap; i++)
+    {
+        if (!old[i].key)
+            continue;
+        long j = (long)(old[i].hash & mask);
+        while (m->slots[j].key)
+            j = (j + 1) & mask;
+        m->slots[j] = old[i];
+    }
+    lheap_free(old);
+}
+
+lval *lmap_get(struct lmap *m, lval *k)
+{
+    if (m->count == 0)
+        return NULL;
+    long i = lmap_find(m, k, lval_hash(k));
+    return m->slots[i].key ? m->slots[i].val : NULL;
+}
+
+void lmap_put(struct lmap *m, lval *k, lval *v)
+{
+    lmap_grow(m);
+
+    uint64_t hash = lval_hash(k);
+    long i = lmap_find(m, k, hash);
+    if (m->slots[i].key)
+    {
+        lval_del(k);
+        lval_del(m->slots[i].val);
+        m->slots[i].val = v;
+        return;
+    }
+
+    m->slots[i].hash = hash;
+    m->slots[i].key = k;
+    m->slots[i].val = v;
+    m->count++;
+}
+
+int lmap_del(struct lmap *m, lval *k)
+{
+    if (m->count == 0)
+        return 0;
+
+    long mask = m->cap - 1;
+    long i = lmap_find(m, k, lval_hash(k));
+    if (!m->slots[i].key)
+        return 0;
+
+    lval_del(m->slots[i].key);
+    lval_del(m->slots[i].val);
+    m->count--;
+
+    /* Backward shift deletion: pull later members of the probe run into the
+        hole, so lookups never need tombstones.
+    */
+    long j = i;
+    for (;;)
+    {
+        m->slots[i].key = NULL;
+        do
+        {
+            j = (j + 1) & mask;
+            if (!m->slots[j].key)
+                return 1;
+        } while (((j - (long)(m->slots[j].hash & mask)) & mask) < ((j - i) & mask));
+
+        m->slots[i] = m->slots[j];
+        i = j;
+    }
+}
+
+/* Whether `v` leads back to the table `m`, through nested lists and maps or
+    the arguments bound by partial application. Maps never hold themselves,
+    so the walk always ends.
+*/
+static int lmap_reaches(lval *v, struct lmap *m)
+{
+    switch (v->type)
+    {
+    case LVAL_MAP:
+        if (v->map == m)
+            return 1;
+        for (long i = 0; i < v->map->cap; i++)
+        {
+            struct lmap_entry *s = &v->map->slots[i];
+            if (s->key && (lmap_reaches(s->key, m) || lmap_reaches(s->val, m)))
+                return 1;
+        }
+        return 0;
+    case LVAL_SEXPR:
+    case LVAL_QEXPR:
+        for (int i = 0; i < v->count; i++)
+        {
+            if (lmap_reaches(v->cell[i], m))
+                return 1;
+        }
+        return 0;
+    case LVAL_FUN:
+        if (v->builtin)
+            return 0;
+        for (struct lpart *p = v->part; p; p = p->prev)
+        {
+            for (int i = 0; i < p->count; i++)
+            {
+                if (lmap_reaches(p->vals[i], m))
+                    return 1;
+            }
+        }
+        return lmap_reaches(v->body, m);
+    default:
+        return 0;
+    }
+}
+
+void lval_print_map(lwriter *w, lenv *e, lval *v)
+{
+    lw_puts(w, "#map{");
+    long printed = 0;
+    for (long i = 0; i < v->map->cap; i++)
+    {
+        if (!v->map->slots[i].key)
+            continue;
+        if (printed++)
+            lw_putc(w, ' ');
+        lval_write(w, e, v->map->slots[i].key);
+        lw_putc(w, ' ');
+        lval_write(w, e, v->map->slots[i].val);
+    }
+    lw_putc(w, '}');
+}
+
+/************* Builtins ****************/
+#define LASSERT_MAP(a, func)                                                          \
+    LASSERT(a, a->count >= 1 && a->cell[0]->type == LVAL_MAP,                         \
+            "Function '%s' expects a %s as first argument.", func, ltype_name(LVAL_MAP))
+
+lval *builtin_map_new(lenv *e, lval *a)
+{
+    LASSERT(a, a->count % 2 == 0, "Function '%s' expects key value pairs. "
+                                  "Got %d arguments.",
+            "map-new", a->count);
+
+    lval *m = lval_map();
+    while (a->count)
+    {
+        lval *k = lval_pop(a, 0);
+        lmap_put(m->map, k, lval_pop(a, 0));
+    }
+    lval_del(a);
+    return m;
+}
+
+lval *builtin_map_get(lenv *e, lval *a)
+{
+    LASSERT_MAP(a, "map-get");
+    LASSERT(a, a->count == 2 || a->count == 3, "Function '%s' passed wrong number of arguments. "
+                                               "Got %d, Expected %d or %d.",
+            "map-get", a->count, 2, 3);
+
+    lval *x = lmap_get(a->cell[0]->map, a->cell[1]);
+    if (x)
+        x = lval_copy(x);
+    else if (a->count == 3)
+        x = lval_pop(a, 2);
+    else
+        x = lval_err_code(LERR_KEY);
+    lval_del(a);
+    return x;
+}
+
+lval *builtin_map_put(lenv *e, lval *a)
+{
+    LASSERT_MAP(a, "map-put");
+    LASSERT(a, a->count == 3, "Function '%s' passed wrong number of arguments. "
+                              "Got %d, Expected %d.",
+            "map-put", a->count, 3);
+    /* A map holding itself would print and compare forever and never be freed. */
+    LASSERT(a, !lmap_reaches(a->cell[1], a->cell[0]->map) && !lmap_reaches(a->cell[2], a->cell[0]->map),
+            "Function '%s' cannot make a map contain itself.", "map-put");
+
+    lval *m = lval_pop(a, 0);
+    lval *k = lval_pop(a, 0);
+    lmap_put(m->map, k, lval_pop(a, 0));
+    lval_del(a);
+    return m;
+}
+
+lval *builtin_map_del(lenv *e, lval *a)
+{
+    LASSERT_MAP(a, "map-del");
+    LASSERT(a, a->count == 2, "Function '%s' passed wrong number of arguments. "
+                              "Got %d, Expected %d.",
+            "map-del", a->count, 2);
+
+    lmap_del(a->cell[0]->map, a->cell[1]);
+    return lval_take(a, 0);
+}
+
+lval *builtin_map_keys(lenv *e, lval *a)
+{
+    LASSERT_MAP(a, "map-keys");
+    LASSERT(a, a->count == 1, "Function '%s' passed wrong number of arguments. "
+                              "Got %d, Expected %d.",
+            "map-keys", a->count, 1);
+
+    struct lmap *m = a->cell[0]->map;
+    lval *x = lval_qexpr();
+    x->cell = lheap_alloc(LVAL_QEXPR, sizeof(lval *) * m->count);
+    for (long i = 0; i < m->cap; i++)
+    {
+        if (m->slots[i].key)
+            x->cell[x->count++] = lval_copy(m->slots[i].key);
+    }
+    lval_del(a);
+    return x;
+}
+
+lval *builtin_map_count(lenv *e, lval *a)
+{
+    LASSERT_MAP(a, "map-count");
+    LASSERT(a, a->count == 1, "Function '%s' passed wrong number of arguments. "
+                              "Got %d, Expected %d.",
+            "map-count", a->count, 1);
+
+    long n = a->cell[0]->map->count;
+    lval_del(a);
+    return lval_num(n);
+}
+
+void lenv_add_map_builtins(lenv *e)
+{
+    lenv_add_builtin(e, "map-new", builtin_map_new);
+    lenv_add_builtin(e, "map-get", builtin_map_get);
+    lenv_add_builtin(e, "map-put", builtin_map_put);
+    lenv_add_builtin(e, "map-del", builtin_map_del);
+    lenv_add_builtin(e, "map-keys", builtin_map_keys);
+    lenv_add_builtin(e, "map-count", builtin_map_count);
+}
@@ -0,0 +1,54 @@
+#ifndef _LISPY_MAP
+#define _LISPY_MAP
+
+#include <stdint.h>
+#include "eval.h"
+
+/* One slot of the open addressing table, an empty slot has no key. */
+struct lmap_entry
+{
+    uint64_t hash;
+    lval *key;
+    lval *val;
+};
+
+/* Hash map with linear probing. Maps are reference values: every copy of
+    the lval shares the same table, so `map-put` and `map-del` update it in
+    place and stay O(1).
+*/
+struct lmap
+{
+    int refs;
+    long count;
+    long cap;
+    struct lmap_entry *slots;
+};
+
+/************* Construct and release maps ****************/
+lval *lval_map(void);
+struct lmap *lmap_ref(struct lmap *m);
+void lmap_unref(struct lmap *m);
+
+/* Structural hash consistent with `lval_eq`. */
+uint64_t lval_hash(lval *v);
+
+/* Look up a key, returning the stored value or NULL. */
+lval *lmap_get(struct lmap *m, lval *k);
+/* Insert or replace a binding, taking ownership of `k` and `v`. */
+void lmap_put(struct lmap *m, lval *k, lval *v);
+/* Remove a binding, returns 0 when the key was absent. */
+int lmap_del(struct lmap *m, lval *k);
+
+void lval_print_map(lwriter *w, lenv *e, lval *v);
+
+/************* Builtins ****************/
+lval *builtin_map_new(lenv *e, lval *a);
+lval *builtin_map_get(lenv *e, lval *a);
+lval *builtin_map_put(lenv *e, lval *a);
+lval *builtin_map_del(lenv *e, lval *a);
+lval *builtin_map_keys(lenv *e, lval *a);
+lval *builtin_map_count(lenv *e, lval *a);
+
+void lenv_add_map_builtins(lenv *e);
+
+#endif
@@ -0,0 +1,127 @@
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "eval.h"
+#include "heap.h"
+#include "symbol.h"
+#include "module.h"
+
+/* Modules imported so far, keyed on the canonical path of their file. */
+struct lmod
+{
+    char *path;
+    lenv *env;
+    struct lmod *next;
+};
+static struct lmod *lmods;
+
+static struct lmod *lmod_find(const char *path)
+{
+    for (struct lmod *m = lmods; m; m = m->next)
+    {
+        if (STR_EQ(m->path, path))
+            return m;
+    }
+    return NULL;
+}
+
+static void lmod_remove(struct lmod *m)
+{
+    struct lmod **p = &lmods;
+    while (*p != m)
+        p = &(*p)->next;
+    *p = m->next;
+    lenv_del(m->env);
+    lheap_free(m->path);
+    lheap_free(m);
+}
+
+/* Bind the namespace `name:` to the module, stale qualified lookups of
+    a module imported under the same name before must not be reused.
+*/
+static void lmod_bind(const char *name, lenv *env)
+{
+    lsym_intern(name)->module = env;
+    lenv_version++;
+}
+
+lval *builtin_import(lenv *e, lval *a)
+{
+    LASSERT(a, a->count == 1, "Function '%s' passed wrong number of arguments. "
+                              "Got %d, Expected %d.",
+            "import", a->count, 1);
+    LASSERT(a, a->cell[0]->type == LVAL_STR, "Function '%s' passed invalid type. "
+                                             "Got %s, Expected %s.",
+            "import", ltype_name(a->cell[0]->type), ltype_name(LVAL_STR));
+
+    char *path = realpath(a->cell[0]->str, NULL);
+    if (!path)
+    {
+        lval *err = lval_err("Could not import %s: %s", a->cell[0]->str, strerror(errno));
+        lval_del(a);
+        return err;
+    }
+
+    /* The namespace is the file name without directory and extension. */
+    char *base = strrchr(path, '/');
+    char *name = lheap_strdup(LHEAP_ENV, base ? base + 1 : path);
+    name[strcspn(name, ".")] = '\0';
+    if (name[0] == '\0')
+    {
+        lval *err = lval_err("Could not import %s: no module name", a->cell[0]->str);
+        lheap_free(name);
+        free(path);
+        lval_del(a);
+        return err;
+    }
+    lval_del(a);
+
+    struct lmod *m = lmod_find(path);
+    lval *x = lval_sexpr();
+    if (!m)
+    {
+        /* Register before running, so imports back into it find it. */
+        m = lheap_alloc(LHEAP_ENV, sizeof(struct lmod));
+        m->path = lheap_strdup(LHEAP_ENV, path);
+        m->env = lenv_new();
+        while (e->par)
+            e = e->par;
+        m->env->par = e;
+        m->env->mod = m->env;
+        m->next = lmods;
+        lmods = m;
+        lmod_bind(name, m->env);
+
+        lval_del(x);
+        x = builtin_load(m->env, lval_add(lval_sexpr(), lval_str(path)));
+
+        /* A file that did not parse ran nothing, it may be fixed and imported again. */
+        if (LVAL_IS_RAISED(x) && x->code != LERR_EXIT)
+        {
+            lmod_remove(m);
+            lmod_bind(name, NULL);
+        }
+    }
+    else
+    {
+        lmod_bind(name, m->env);
+    }
+
+    lheap_free(name);
+    free(path);
+    return x;
+}
+
+void lenv_add_module_builtins(lenv *e)
+{
+    lenv_add_builtin(e, "import", builtin_import);
+}
+
+void lmod_cleanup(void)
+{
+    while (lmods)
+        lmod_remove(lmods);
+}
@@ -0,0 +1,20 @@
+#ifndef _LISPY_MODULE
+#define _LISPY_MODULE
+
+#include "eval.h"
+
+/* `(import "lib/util.lspy")` runs a file once in an environment of its own
+    and makes its definitions available as `util:name`. Later imports of
+    the same file, by whatever path, only bind the namespace again.
+
+    Functions defined in a module look names up in their module and then
+    in the global environment, not in the environment of their caller.
+*/
+lval *builtin_import(lenv *e, lval *a);
+
+void lenv_add_module_builtins(lenv *e);
+
+/* Release the environments of all imported modules. */
+void lmod_cleanup(void);
+
+#endif
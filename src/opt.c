@@ -0,0 +1,422 @@
+#include <stdlib.h>
+
+#include "eval.h"
+#include "heap.h"
+#include "symbol.h"
+#include "strbuf.h"
+#include "jit.h"
+#include "opt.h"
+
+/* Calls with an unchanged global environment before a lambda body is
+    folded again, so code that keeps redefining globals never pays for it.
+*/
+#define LOPT_STABLE_CALLS 4
+/* Largest lambda body inlined, counted in values and lists. */
+#define LOPT_INLINE_MAX 24
+
+/* Builtins without side effects, applied early when every argument is constant. */
+static lbuiltin const lopt_pure[] = {
+    builtin_add, builtin_sub, builtin_mul, builtin_div, builtin_mod,
+    builtin_lt, builtin_gt, builtin_le, builtin_ge, builtin_eq, builtin_ne,
+    builtin_not, builtin_and, builtin_or,
+    builtin_head, builtin_tail, builtin_list, builtin_join, builtin_str_cat,
+};
+
+/* Other builtins that never rebind a name, folding may go on after them. */
+static lbuiltin const lopt_clean[] = {
+    builtin_lambda,
+    builtin_print,
+};
+
+struct lopt_ctx
+{
+    lenv *e;
+    /* Set once a call might have changed what names are bound to. */
+    int dirty;
+    /* Arguments of the lambda being folded, bound whenever its body runs. */
+    lenv *params;
+};
+
+static int lopt_in(lbuiltin const *table, size_t n, lbuiltin b)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        if (table[i] == b)
+            return 1;
+    }
+    return 0;
+}
+
+/* Types that evaluate to themselves and may stand in the tree as results. */
+static int lopt_is_const(lval *x)
+{
+    switch (x->type)
+    {
+    case LVAL_NUM:
+    case LVAL_DBL:
+    case LVAL_BIG:
+    case LVAL_STR:
+    case LVAL_BOOL:
+    case LVAL_QEXPR:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+/* Global binding of a symbol no local binding can shadow, or NULL. */
+static lval *lopt_global(struct lopt_ctx *c, lval *x)
+{
+    if (x->type != LVAL_SYM || x->ic->rec->local)
+        return NULL;
+    lval *v = lenv_get(c->e, x);
+    if (v->type == LVAL_ERR)
+    {
+        lval_del(v);
+        return NULL;
+    }
+    return v;
+}
+
+/* Builtin that the cell names, or NULL. */
+static lbuiltin lopt_builtin(struct lopt_ctx *c, lval *x)
+{
+    lval *f = lopt_global(c, x);
+    lbuiltin b = f && f->type == LVAL_FUN ? f->builtin : NULL;
+    if (f)
+        lval_del(f);
+    return b;
+}
+
+/* Value of a cell known before it is evaluated, or NULL. */
+static lval *lopt_const(struct lopt_ctx *c, lval *x)
+{
+    if (lopt_is_const(x))
+        return lval_copy(x);
+    lval *v = lopt_global(c, x);
+    if (v && !lopt_is_const(v))
+    {
+        lval_del(v);
+        return NULL;
+    }
+    return v;
+}
+
+/* Make `v` evaluate the cells of the list `src` instead of its own. */
+static void lopt_become(lval *v, lval *src)
+{
+    for (int i = 0; i < v->count; i++)
+        lval_del(v->cell[i]);
+    lheap_free(v->cell);
+    v->count = src->count;
+    v->cell = src->cell;
+    v->line = src->line;
+    v->col = src->col;
+    lheap_free(src);
+}
+
+/* Replace the cells of `v` with the single value `k`. */
+static void lopt_fold(lval *v, lval *k)
+{
+    lval *src = lval_add(lval_sexpr(), k);
+    src->line = v->line;
+    src->col = v->col;
+    lopt_become(v, src);
+}
+
+static void lopt_code(struct lopt_ctx *c, lval *v);
+
+/* Evaluating the cell `i` of `v`, a nested S-Expression reduced to a
+    constant is replaced by that constant.
+*/
+static void lopt_cell(struct lopt_ctx *c, lval *v, int i)
+{
+    lval *x = v->cell[i];
+    if (x->type != LVAL_SEXPR)
+        return;
+    lopt_code(c, x);
+    if (x->count == 1 && lopt_is_const(x->cell[0]))
+        v->cell[i] = lval_take(x, 0);
+}
+
+/* `if` with literal branches, taken at once when the condition is known. */
+static void lopt_if(struct lopt_ctx *c, lval *v)
+{
+    lopt_cell(c, v, 1);
+    lval *k = c->dirty ? NULL : lopt_const(c, v->cell[1]);
+    if (k && k->type == LVAL_BOOL)
+    {
+        lval *branch = lval_pop(v, k->num ? 2 : 3);
+        lval_del(k);
+        lopt_become(v, branch);
+        lopt_code(c, v);
+        return;
+    }
+    if (k)
+        lval_del(k);
+
+    /* Either branch may run, what one could rebind spoils the rest. */
+    int dirty = c->dirty;
+    lopt_code(c, v->cell[2]);
+    int then = c->dirty;
+    c->dirty = dirty;
+    lopt_code(c, v->cell[3]);
+    c->dirty |= then;
+}
+
+/************* Inlining ****************/
+static int lopt_is_param(struct lopt_ctx *c, lval *x)
+{
+    if (x->type != LVAL_SYM || !c->params)
+        return 0;
+    for (int i = 0; i < c->params->count; i++)
+    {
+        if (c->params->dicts[i].sym == x->sym)
+            return 1;
+    }
+    return 0;
+}
+
+/* `\` keeps the body Q-Expression, `fun` wraps it as ({...}). */
+static lval *lopt_code_of(lval *body)
+{
+    if (body->type == LVAL_SEXPR && body->count == 1)
+        body = body->cell[0];
+    return body->type == LVAL_QEXPR ? body : NULL;
+}
+
+static int lopt_is_if(struct lopt_ctx *c, lval *v)
+{
+    return v->count == 4 && v->cell[2]->type == LVAL_QEXPR && v->cell[3]->type == LVAL_QEXPR &&
+           lopt_builtin(c, v->cell[0]) == builtin_if;
+}
+
+/* Size of code that only calls pure builtins, `print` and `if`, or -1.
+    Such code can neither recurse nor see the names it binds through
+    dynamic scoping, so its arguments may be substituted.
+*/
+static int lopt_inline_size(struct lopt_ctx *c, lval *v, lval *formals)
+{
+    int n = 1;
+    for (int i = 0; v->count > 1 && i < formals->count; i++)
+    {
+        /* A parameter called as a function is not known in advance. */
+        if (v->cell[0]->type == LVAL_SYM && v->cell[0]->sym == formals->cell[i]->sym)
+            return -1;
+    }
+    int is_if = lopt_is_if(c, v);
+    if (v->count > 1 && !is_if)
+    {
+        lbuiltin b = lopt_builtin(c, v->cell[0]);
+        if (!lopt_in(lopt_pure, sizeof(lopt_pure) / sizeof(lopt_pure[0]), b) && b != builtin_print)
+            return -1;
+    }
+    for (int i = 0; i < v->count && n <= LOPT_INLINE_MAX; i++)
+    {
+        lval *x = v->cell[i];
+        int m = x->type == LVAL_SEXPR || (is_if && i >= 2) ? lopt_inline_size(c, x, formals) : 1;
+        if (m < 0)
+            return -1;
+        n += m;
+    }
+    return n;
+}
+
+/* Copy of `v` with the symbols in `formals` replaced by `args`. Only
+    code is rewritten, Q-Expressions other than `if` branches are data.
+*/
+static lval *lopt_subst(struct lopt_ctx *c, lval *v, lval *formals, lval *args, int code)
+{
+    if (v->type == LVAL_SYM)
+    {
+        for (int i = 0; i < formals->count; i++)
+        {
+            if (formals->cell[i]->sym == v->sym)
+                return lval_copy(args->cell[i]);
+        }
+    }
+    if (v->type != LVAL_SEXPR && !(v->type == LVAL_QEXPR && code))
+        return lval_copy(v);
+
+    lval *x = v->type == LVAL_SEXPR ? lval_sexpr() : lval_qexpr();
+    x->line = v->line;
+    x->col = v->col;
+    int is_if = lopt_is_if(c, v);
+    for (int i = 0; i < v->count; i++)
+        lval_add(x, lopt_subst(c, v->cell[i], formals, args, is_if && i >= 2));
+    return x;
+}
+
+/* Replace a call of a small lambda by its body. Arguments must be
+    constants or parameters of the code being folded, which are bound
+    and keep their value until the body has run. Lambdas of a module
+    stay calls, their bodies see the module's names.
+*/
+static int lopt_inline(struct lopt_ctx *c, lval *v)
+{
+    lval *f = lopt_global(c, v->cell[0]);
+    if (!f)
+        return 0;
+    lval *code = f->type == LVAL_FUN && !f->builtin && f->bound == 0 && !f->mod &&
+                         f->formals->count == v->count - 1
+                     ? lopt_code_of(f->body)
+                     : NULL;
+    for (int i = 0; code && i < f->formals->count; i++)
+    {
+        if (STR_EQ(f->formals->cell[i]->sym, "&"))
+            code = NULL;
+    }
+    if (code)
+    {
+        int n = lopt_inline_size(c, code, f->formals);
+        code = n >= 0 && n <= LOPT_INLINE_MAX ? code : NULL;
+    }
+
+    lval *args = code ? lval_sexpr() : NULL;
+    for (int i = 1; args && i < v->count; i++)
+    {
+        lval *k = lopt_is_param(c, v->cell[i]) ? lval_copy(v->cell[i]) : lopt_const(c, v->cell[i]);
+        if (k)
+        {
+            lval_add(args, k);
+        }
+        else
+        {
+            lval_del(args);
+            args = NULL;
+        }
+    }
+
+    if (args)
+    {
+        lopt_become(v, lopt_subst(c, code, f->formals, args, 1));
+        lval_del(args);
+        lopt_code(c, v);
+    }
+    lval_del(f);
+    return args != NULL;
+}
+
+/* `eval` of code written out as a literal. */
+static int lopt_eval(struct lopt_ctx *c, lval *v)
+{
+    lval *x = v->cell[1];
+    if (x->type == LVAL_SEXPR && x->count >= 1 && lopt_builtin(c, x->cell[0]) == builtin_list)
+    {
+        /* The values `list` collects are evaluated once more by `eval`,
+            which only leaves literals and builtins unchanged.
+        */
+        for (int i = 1; i < x->count; i++)
+        {
+            lval *y = x->cell[i];
+            if (y->type == LVAL_SYM ? lopt_builtin(c, y) == NULL : !lopt_is_const(y))
+                return 0;
+        }
+        lval_del(lval_pop(x, 0));
+    }
+    else if (x->type != LVAL_QEXPR)
+    {
+        return 0;
+    }
+
+    lopt_become(v, lval_pop(v, 1));
+    lopt_code(c, v);
+    return 1;
+}
+
+/* Fold the list `v`, whose cells are evaluated as an S-Expression. */
+static void lopt_code(struct lopt_ctx *c, lval *v)
+{
+    if (v->count == 0)
+        return;
+
+    lbuiltin b = lopt_builtin(c, v->cell[0]);
+    if (b == builtin_if && v->count == 4 && v->cell[2]->type == LVAL_QEXPR &&
+        v->cell[3]->type == LVAL_QEXPR)
+    {
+        lopt_if(c, v);
+        return;
+    }
+
+    for (int i = 0; i < v->count; i++)
+        lopt_cell(c, v, i);
+    /* A single cell is its value, or a builtin that takes no arguments. */
+    if (v->count == 1)
+        return;
+
+    if (!c->dirty && b == builtin_eval && v->count == 2 && lopt_eval(c, v))
+        return;
+    if (!c->dirty && !b && lopt_inline(c, v))
+        return;
+
+    size_t npure = sizeof(lopt_pure) / sizeof(lopt_pure[0]);
+    if (!c->dirty && lopt_in(lopt_pure, npure, b))
+    {
+        lval *a = lval_sexpr();
+        for (int i = 1; i < v->count && a; i++)
+        {
+            lval *k = lopt_const(c, v->cell[i]);
+            if (k)
+            {
+                lval_add(a, k);
+            }
+            else
+            {
+                lval_del(a);
+                a = NULL;
+            }
+        }
+        if (a)
+        {
+            /* Errors stay in place, to be raised where they belong. */
+            lval *r = b(c->e, a);
+            if (lopt_is_const(r))
+                lopt_fold(v, r);
+            else
+                lval_del(r);
+        }
+        return;
+    }
+
+    if (!lopt_in(lopt_pure, npure, b) && !lopt_in(lopt_clean, sizeof(lopt_clean) / sizeof(lopt_clean[0]), b))
+        c->dirty = 1;
+}
+
+lval *lval_optimize(lenv *e, lval *v)
+{
+    if (v->type != LVAL_SEXPR)
+        return v;
+
+    struct lopt_ctx c = {e, 0, NULL};
+    lopt_code(&c, v);
+    return v;
+}
+
+lval *lopt_body(lenv *frame, lval *f)
+{
+    struct ljit *j = f->jit;
+    if (j->opt && j->opt_version == lenv_version)
+        return j->opt;
+
+    if (j->opt_seen != lenv_version)
+    {
+        j->opt_seen = lenv_version;
+        j->opt_calls = 0;
+    }
+    if (++j->opt_calls < LOPT_STABLE_CALLS)
+        return f->body;
+
+    lval *body = lval_copy(f->body);
+    lval *code = lopt_code_of(body);
+    if (code)
+    {
+        struct lopt_ctx c = {frame, 0, frame};
+        lopt_code(&c, code);
+    }
+
+    if (j->opt)
+        lval_del(j->opt);
+    j->opt = body;
+    j->opt_version = lenv_version;
+    return body;
+}
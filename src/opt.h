@@ -0,0 +1,25 @@
+#ifndef _LISPY_OPT
+#define _LISPY_OPT
+
+#include "eval.h"
+
+/* Fold the constant parts of a form about to be evaluated, in place.
+
+    Pure builtins applied to constants are replaced by their result, `if`
+    with a constant condition by the branch taken, and `eval` of a literal
+    Q-Expression or of `list` over constants by the expression itself.
+    Global values count as constants too. A name only counts when it was
+    never bound locally, and only up to the first call that could rebind
+    something, so the result depends on nothing but the current global
+    environment.
+*/
+lval *lval_optimize(lenv *e, lval *v);
+
+/* Body to evaluate for a call of the lambda `f`, whose arguments are
+    bound in `frame`. The folded copy is kept with the lambda and rebuilt
+    once the global environment has stayed the same for a few calls, in
+    between the plain body is used.
+*/
+lval *lopt_body(lenv *frame, lval *f);
+
+#endif
@@ -0,0 +1,110 @@
+#define _DEFAULT_SOURCE
+#include <stdlib.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "pool.h"
+
+/* Threads are plain malloc'd system objects, outside of the Lispy heap. */
+struct lpool
+{
+    pthread_mutex_t lock;
+    pthread_cond_t done_cond;
+    lpool_job job;
+    void *ctx;
+    int n;
+    /* Next job to take, and which jobs have finished. */
+    int next;
+    char *done;
+    int nthreads;
+    pthread_t *threads;
+};
+
+/* Take the next job and run it, with the lock held on entry and exit.
+    Returns 0 when every job was taken already.
+*/
+static int lpool_step(struct lpool *p)
+{
+    if (p->next == p->n)
+        return 0;
+    int i = p->next++;
+    pthread_mutex_unlock(&p->lock);
+
+    p->job(p->ctx, i);
+
+    pthread_mutex_lock(&p->lock);
+    p->done[i] = 1;
+    pthread_cond_broadcast(&p->done_cond);
+    return 1;
+}
+
+static void *lpool_worker(void *arg)
+{
+    struct lpool *p = arg;
+    pthread_mutex_lock(&p->lock);
+    while (lpool_step(p))
+        ;
+    pthread_mutex_unlock(&p->lock);
+    return NULL;
+}
+
+int lpool_cores(void)
+{
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    return cores < 1 ? 1 : cores > 256 ? 256 : (int)cores;
+}
+
+struct lpool *lpool_start(int n, lpool_job job, void *ctx)
+{
+    struct lpool *p = malloc(sizeof(struct lpool));
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->done_cond, NULL);
+    p->job = job;
+    p->ctx = ctx;
+    p->n = n;
+    p->next = 0;
+    p->done = calloc(n > 0 ? n : 1, 1);
+
+    /* The caller takes jobs too while it waits, so one thread less than
+        cores. On a single core the jobs simply run as they are waited for.
+    */
+    int cores = lpool_cores();
+    int want = cores < n ? cores : n;
+    p->nthreads = want > 1 ? want - 1 : 0;
+    p->threads = malloc(sizeof(pthread_t) * (p->nthreads > 0 ? p->nthreads : 1));
+    for (int t = 0; t < p->nthreads; t++)
+    {
+        if (pthread_create(&p->threads[t], NULL, lpool_worker, p) != 0)
+        {
+            p->nthreads = t;
+            break;
+        }
+    }
+    return p;
+}
+
+void lpool_wait(struct lpool *p, int i)
+{
+    pthread_mutex_lock(&p->lock);
+    while (!p->done[i])
+    {
+        /* Jobs up to `i` not taken yet are done here rather than waited for. */
+        if (p->next > i || !lpool_step(p))
+            pthread_cond_wait(&p->done_cond, &p->lock);
+    }
+    pthread_mutex_unlock(&p->lock);
+}
+
+void lpool_finish(struct lpool *p)
+{
+    for (int i = 0; i < p->n; i++)
+        lpool_wait(p, i);
+    for (int t = 0; t < p->nthreads; t++)
+        pthread_join(p->threads[t], NULL);
+
+    pthread_mutex_destroy(&p->lock);
+    pthread_cond_destroy(&p->done_cond);
+    free(p->threads);
+    free(p->done);
+    free(p);
+}
@@ -0,0 +1,21 @@
+#ifndef _LISPY_POOL
+#define _LISPY_POOL
+
+/* Jobs `0` to `n - 1` run on a few worker threads, taken in order, while
+    the caller waits for the results one by one. Jobs must not touch the
+    interpreter: its heap accounting and symbol table are not shared.
+*/
+typedef void (*lpool_job)(void *ctx, int i);
+
+struct lpool;
+
+/* Number of cores to spread jobs over. */
+int lpool_cores(void);
+
+struct lpool *lpool_start(int n, lpool_job job, void *ctx);
+/* Block until job `i` has finished. */
+void lpool_wait(struct lpool *p, int i);
+/* Wait for all jobs and release the threads. */
+void lpool_finish(struct lpool *p);
+
+#endif
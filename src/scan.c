@@ -0,0 +1,270 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mpc.h"
+#include "eval.h"
+#include "heap.h"
+#include "grammar.h"
+#include "pool.h"
+#include "scan.h"
+
+/* SSE2 is part of the x86-64 baseline, no extra build flags are needed. */
+#if defined(__GNUC__) && defined(__SSE2__)
+#define LSCAN_X86 1
+#include <immintrin.h>
+#endif
+
+/* Files from this size on are split, into pieces of about this size. */
+#define LSCAN_MIN_FILE (4L << 20)
+#define LSCAN_PIECE (1L << 20)
+
+/************* Structural scan ****************/
+struct lscan
+{
+    const char *text;
+    long size;
+    int depth;
+    int in_str;
+    int in_comment;
+    /* Position after a backslash escape in a string. */
+    long esc_end;
+    long line;
+    long start;
+    long start_line;
+    struct lchunk *out;
+    int count;
+    int cap;
+};
+
+static void lscan_cut(struct lscan *s, long end)
+{
+    if (s->count == s->cap)
+    {
+        s->cap = s->cap ? s->cap * 2 : 16;
+        s->out = lheap_realloc(LHEAP_ENV, s->out, sizeof(struct lchunk) * s->cap);
+    }
+    s->out[s->count].start = s->start;
+    s->out[s->count].end = end;
+    s->out[s->count].line = s->start_line;
+    s->count++;
+}
+
+/* Account for one of the characters that can change the state. */
+static void lscan_char(struct lscan *s, long i)
+{
+    char c = s->text[i];
+    /* An escaped character is skipped, but an escaped line end still counts. */
+    if (i < s->esc_end)
+    {
+        if (c == '\n')
+            s->line++;
+        return;
+    }
+
+    if (c == '\n')
+    {
+        s->line++;
+        s->in_comment = 0;
+        /* A line end outside of everything may end the piece. */
+        if (!s->in_str && s->depth == 0 && i - s->start >= s->size)
+        {
+            lscan_cut(s, i);
+            s->start = i + 1;
+            s->start_line = s->line;
+        }
+        return;
+    }
+    if (s->in_comment)
+        return;
+    if (s->in_str)
+    {
+        if (c == '\\')
+            s->esc_end = i + 2;
+        else if (c == '"')
+            s->in_str = 0;
+        return;
+    }
+
+    switch (c)
+    {
+    case '(':
+    case '{':
+        s->depth++;
+        break;
+    case ')':
+    case '}':
+        s->depth--;
+        break;
+    case '"':
+        s->in_str = 1;
+        break;
+    case ';':
+        s->in_comment = 1;
+        break;
+    }
+}
+
+int lscan_split(const char *text, long len, long size, struct lchunk **out)
+{
+    struct lscan s = {text, size, 0, 0, 0, 0, 0, 0, 0, NULL, 0, 0};
+    long i = 0;
+
+#ifdef LSCAN_X86
+    /* Look at 16 bytes at once and only stop on the characters that matter. */
+    const __m128i open = _mm_set1_epi8('('), close = _mm_set1_epi8(')');
+    const __m128i lbrace = _mm_set1_epi8('{'), rbrace = _mm_set1_epi8('}');
+    const __m128i quote = _mm_set1_epi8('"'), semi = _mm_set1_epi8(';');
+    const __m128i nl = _mm_set1_epi8('\n'), bslash = _mm_set1_epi8('\\');
+    for (; i + 16 <= len; i += 16)
+    {
+        __m128i x = _mm_loadu_si128((const __m128i *)(text + i));
+        __m128i hit = _mm_or_si128(
+            _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(x, open), _mm_cmpeq_epi8(x, close)),
+                         _mm_or_si128(_mm_cmpeq_epi8(x, lbrace), _mm_cmpeq_epi8(x, rbrace))),
+            _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(x, quote), _mm_cmpeq_epi8(x, semi)),
+                         _mm_or_si128(_mm_cmpeq_epi8(x, nl), _mm_cmpeq_epi8(x, bslash))));
+        unsigned mask = (unsigned)_mm_movemask_epi8(hit);
+        while (mask)
+        {
+            lscan_char(&s, i + __builtin_ctz(mask));
+            mask &= mask - 1;
+        }
+        if (s.depth < 0)
+            break;
+    }
+#endif
+
+    for (; i < len && s.depth >= 0; i++)
+    {
+        if (text[i] && strchr("(){}\";\n\\", text[i]))
+            lscan_char(&s, i);
+    }
+
+    if (s.depth != 0 || s.in_str)
+    {
+        lheap_free(s.out);
+        return 0;
+    }
+    lscan_cut(&s, len);
+    *out = s.out;
+    return s.count;
+}
+
+/************* Parallel load ****************/
+struct lscan_load
+{
+    const char *path;
+    char *text;
+    struct lchunk *chunks;
+    int *ok;
+    mpc_result_t *r;
+};
+
+/* Positions in a piece count from the start of the file. */
+static void lscan_shift(mpc_state_t *state, struct lchunk *c)
+{
+    state->pos += c->start;
+    state->row += c->line;
+}
+
+static void lscan_shift_view(mpc_view_t *t, struct lchunk *c)
+{
+    lscan_shift(&t->state, c);
+    for (int i = 0; i < t->children_num; i++)
+        lscan_shift_view(t->children[i], c);
+}
+
+static void lscan_job(void *ctx, int i)
+{
+    struct lscan_load *l = ctx;
+    struct lchunk *c = &l->chunks[i];
+    l->ok[i] = lgrammar_parse(l->path, l->text + c->start, &l->r[i]);
+    if (l->ok[i])
+        lscan_shift_view(l->r[i].output, c);
+    else
+        lscan_shift(&l->r[i].error->state, c);
+}
+
+static void lscan_drop(int ok, mpc_result_t *r)
+{
+    if (ok)
+        mpc_view_delete(r->output);
+    else
+        mpc_err_delete(r->error);
+}
+
+int lscan_worth(const char *path)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f)
+        return 0;
+    fseek(f, 0, SEEK_END);
+    long len = ftell(f);
+    fclose(f);
+    return len >= LSCAN_MIN_FILE;
+}
+
+lval *lscan_load(lenv *e, const char *path)
+{
+    if (!lscan_worth(path))
+        return NULL;
+
+    FILE *f = fopen(path, "rb");
+    if (!f)
+        return NULL;
+    fseek(f, 0, SEEK_END);
+    long len = ftell(f);
+    char *text = malloc(len + 1);
+    rewind(f);
+    len = (long)fread(text, 1, len, f);
+    fclose(f);
+    text[len] = '\0';
+
+    struct lscan_load l = {path, text, NULL, NULL, NULL};
+    int n = lscan_split(text, len, LSCAN_PIECE, &l.chunks);
+    if (n < 2)
+    {
+        lheap_free(l.chunks);
+        free(text);
+        return NULL;
+    }
+
+    /* Every piece ends on a line end of its own, which terminates it. */
+    for (int i = 0; i < n; i++)
+        text[l.chunks[i].end] = '\0';
+    l.ok = lheap_alloc(LHEAP_ENV, sizeof(int) * n);
+    l.r = lheap_alloc(LHEAP_ENV, sizeof(mpc_result_t) * n);
+    struct lpool *pool = lpool_start(n, lscan_job, &l);
+    lpool_finish(pool);
+
+    /* Like a parse of the whole file, the first error means nothing runs. */
+    int bad = -1;
+    for (int i = 0; i < n && bad < 0; i++)
+    {
+        if (!l.ok[i])
+            bad = i;
+    }
+
+    lval *x = NULL;
+    for (int i = 0; i < n; i++)
+    {
+        if (x || (bad >= 0 && i != bad))
+        {
+            lscan_drop(l.ok[i], &l.r[i]);
+            continue;
+        }
+        lval *y = lval_load_result(e, l.ok[i], &l.r[i]);
+        if (LVAL_IS_RAISED(y))
+            x = y;
+        else
+            lval_del(y);
+    }
+
+    /* The parsed pieces are views of the text, read until here. */
+    free(text);
+    lheap_free(l.chunks);
+    lheap_free(l.ok);
+    lheap_free(l.r);
+    return x ? x : lval_sexpr();
+}
@@ -0,0 +1,33 @@
+#ifndef _LISPY_SCAN
+#define _LISPY_SCAN
+
+#include "eval.h"
+
+/* Piece of a source text that holds whole top-level forms. It starts at
+    the beginning of line `line`, counted from 0.
+*/
+struct lchunk
+{
+    long start;
+    long end;
+    long line;
+};
+
+/* Split `text` into pieces of about `size` bytes, cutting only at line
+    ends outside of any form, string or comment. Returns the number of
+    pieces stored in `*out`, or 0 when the brackets or strings do not
+    balance and the text had better be parsed whole.
+*/
+int lscan_split(const char *text, long len, long size, struct lchunk **out);
+
+/* Whether a file is big enough to split. */
+int lscan_worth(const char *path);
+
+/* `load` of a big file: the pieces are parsed on all cores, then read and
+    evaluated in order, as if the file was parsed at once. Returns NULL when
+    the file is too small to be worth it. Even on a single core the pieces
+    parse faster than the whole file, being held in memory.
+*/
+lval *lscan_load(lenv *e, const char *path);
+
+#endif
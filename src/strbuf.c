@@ -0,0 +1,260 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "eval.h"
+#include "heap.h"
+#include "strbuf.h"
+#include "writer.h"
+
+/* Chunks start at 4 KB and grow with the builder up to 1 MB, strings of
+    at least 1 KB are adopted instead of copied.
+*/
+#define LSB_CHUNK_MIN 4096
+#define LSB_CHUNK_MAX (1L << 20)
+#define LSB_ADOPT 1024
+
+/************* Construct and release builders ****************/
+lval *lval_sb(void)
+{
+    struct lsb *b = lheap_alloc(LVAL_SB, sizeof(struct lsb));
+    b->refs = 1;
+    b->len = 0;
+    b->head = NULL;
+    b->tail = NULL;
+
+    lval *v = lheap_alloc(LVAL_SB, sizeof(lval));
+    v->type = LVAL_SB;
+    v->sb = b;
+    return v;
+}
+
+struct lsb *lsb_ref(struct lsb *b)
+{
+    b->refs++;
+    return b;
+}
+
+void lsb_unref(struct lsb *b)
+{
+    if (--b->refs)
+        return;
+
+    struct lsb_chunk *c = b->head;
+    while (c)
+    {
+        struct lsb_chunk *next = c->next;
+        /* Adopted buffers live apart from their chunk header. */
+        if (c->data != (char *)(c + 1))
+            lheap_free(c->data);
+        lheap_free(c);
+        c = next;
+    }
+    lheap_free(b);
+}
+
+static void lsb_link(struct lsb *b, struct lsb_chunk *c)
+{
+    c->next = NULL;
+    if (b->tail)
+        b->tail->next = c;
+    else
+        b->head = c;
+    b->tail = c;
+}
+
+/************* Appending ****************/
+void lsb_append(struct lsb *b, const char *s, long len)
+{
+    b->len += len;
+
+    /* Fill the room left in the last chunk first. */
+    struct lsb_chunk *t = b->tail;
+    if (t && t->cap > t->len)
+    {
+        long n = t->cap - t->len < len ? t->cap - t->len : len;
+        memcpy(t->data + t->len, s, n);
+        t->len += n;
+        s += n;
+        len -= n;
+    }
+    if (len == 0)
+        return;
+
+    /* Grow chunks with the builder, so the chunk count stays logarithmic
+        at first and linear with a small constant afterwards.
+    */
+    long cap = b->len / 4;
+    cap = cap < LSB_CHUNK_MIN ? LSB_CHUNK_MIN : cap > LSB_CHUNK_MAX ? LSB_CHUNK_MAX : cap;
+    cap = cap < len ? len : cap;
+
+    struct lsb_chunk *c = lheap_alloc(LVAL_SB, sizeof(struct lsb_chunk) + cap);
+    c->len = len;
+    c->cap = cap;
+    c->data = (char *)(c + 1);
+    memcpy(c->data, s, len);
+    lsb_link(b, c);
+}
+
+void lsb_append_str(struct lsb *b, lval *s)
+{
+    if (s->len < LSB_ADOPT)
+    {
+        lsb_append(b, s->str, s->len);
+        lval_del(s);
+        return;
+    }
+
+    /* Take over the string buffer, it is only copied again by `lsb_build`. */
+    struct lsb_chunk *c = lheap_alloc(LVAL_SB, sizeof(struct lsb_chunk));
+    c->len = s->len;
+    c->cap = s->len;
+    c->data = s->str;
+    lsb_link(b, c);
+    b->len += s->len;
+    lheap_free(s);
+}
+
+lval *lsb_build(struct lsb *b)
+{
+    char *s = lheap_try_alloc(LVAL_STR, b->len + 1);
+    if (s == NULL)
+        return lval_err_code(LERR_HEAP);
+    char *p = s;
+    for (struct lsb_chunk *c = b->head; c; c = c->next)
+    {
+        memcpy(p, c->data, c->len);
+        p += c->len;
+    }
+    return lval_str_take(s, b->len);
+}
+
+void lval_print_sb(lwriter *w, lval *v)
+{
+    lw_printf(w, "#sb[%ld bytes]", v->sb->len);
+}
+
+/************* Builtins ****************/
+/* Check that the arguments from `from` on are all strings. */
+#define LASSERT_STRS(a, from, func)                                                     \
+    for (int i = from; i < a->count; i++)                                               \
+    {                                                                                   \
+        LASSERT(a, a->cell[i]->type == LVAL_STR,                                        \
+                "Function '%s' passed invalid type at pos %d. Got %s, Expected %s.",    \
+                func, i, ltype_name(a->cell[i]->type), ltype_name(LVAL_STR));           \
+    }
+
+lval *builtin_str_cat(lenv *e, lval *a)
+{
+    LASSERT_STRS(a, 0, "str-cat");
+
+    long len = 0;
+    for (int i = 0; i < a->count; i++)
+        len += a->cell[i]->len;
+
+    char *s = lheap_try_alloc(LVAL_STR, len + 1);
+    if (s == NULL)
+    {
+        lval_del(a);
+        return lval_err_code(LERR_HEAP);
+    }
+    char *p = s;
+    for (int i = 0; i < a->count; i++)
+    {
+        memcpy(p, a->cell[i]->str, a->cell[i]->len);
+        p += a->cell[i]->len;
+    }
+    lval_del(a);
+    return lval_str_take(s, len);
+}
+
+lval *builtin_str_join(lenv *e, lval *a)
+{
+    LASSERT(a, a->count == 2, "Function '%s' passed wrong number of arguments. "
+                              "Got %d, Expected %d.",
+            "str-join", a->count, 2);
+    LASSERT(a, a->cell[0]->type == LVAL_STR, "Function '%s' passed invalid type at pos %d. "
+                                             "Got %s, Expected %s.",
+            "str-join", 0, ltype_name(a->cell[0]->type), ltype_name(LVAL_STR));
+    LASSERT(a, a->cell[1]->type == LVAL_QEXPR, "Function '%s' passed invalid type at pos %d. "
+                                               "Got %s, Expected %s.",
+            "str-join", 1, ltype_name(a->cell[1]->type), ltype_name(LVAL_QEXPR));
+
+    lval *sep = a->cell[0];
+    lval *xs = a->cell[1];
+    long len = 0;
+    for (int i = 0; i < xs->count; i++)
+    {
+        LASSERT(a, xs->cell[i]->type == LVAL_STR, "Function '%s' expects a list of %s. "
+                                                  "Got %s at pos %d.",
+                "str-join", ltype_name(LVAL_STR), ltype_name(xs->cell[i]->type), i);
+        len += xs->cell[i]->len + (i ? sep->len : 0);
+    }
+
+    char *s = lheap_try_alloc(LVAL_STR, len + 1);
+    if (s == NULL)
+    {
+        lval_del(a);
+        return lval_err_code(LERR_HEAP);
+    }
+    char *p = s;
+    for (int i = 0; i < xs->count; i++)
+    {
+        if (i)
+        {
+            memcpy(p, sep->str, sep->len);
+            p += sep->len;
+        }
+        memcpy(p, xs->cell[i]->str, xs->cell[i]->len);
+        p += xs->cell[i]->len;
+    }
+    lval_del(a);
+    return lval_str_take(s, len);
+}
+
+lval *builtin_sb_new(lenv *e, lval *a)
+{
+    LASSERT_STRS(a, 0, "sb-new");
+
+    lval *b = lval_sb();
+    while (a->count)
+        lsb_append_str(b->sb, lval_pop(a, 0));
+    lval_del(a);
+    return b;
+}
+
+lval *builtin_sb_append(lenv *e, lval *a)
+{
+    LASSERT(a, a->count >= 1 && a->cell[0]->type == LVAL_SB,
+            "Function '%s' expects a %s as first argument.", "sb-append", ltype_name(LVAL_SB));
+    LASSERT_STRS(a, 1, "sb-append");
+
+    lval *b = lval_pop(a, 0);
+    while (a->count)
+        lsb_append_str(b->sb, lval_pop(a, 0));
+    lval_del(a);
+    return b;
+}
+
+lval *builtin_sb_build(lenv *e, lval *a)
+{
+    LASSERT(a, a->count == 1, "Function '%s' passed wrong number of arguments. "
+                              "Got %d, Expected %d.",
+            "sb-build", a->count, 1);
+    LASSERT(a, a->cell[0]->type == LVAL_SB, "Function '%s' passed invalid type at pos %d. "
+                                            "Got %s, Expected %s.",
+            "sb-build", 0, ltype_name(a->cell[0]->type), ltype_name(LVAL_SB));
+
+    lval *s = lsb_build(a->cell[0]->sb);
+    lval_del(a);
+    return s;
+}
+
+void lenv_add_sb_builtins(lenv *e)
+{
+    lenv_add_builtin(e, "str-cat", builtin_str_cat);
+    lenv_add_builtin(e, "str-join", builtin_str_join);
+    lenv_add_builtin(e, "sb-new", builtin_sb_new);
+    lenv_add_builtin(e, "sb-append", builtin_sb_append);
+    lenv_add_builtin(e, "sb-build", builtin_sb_build);
+}
@@ -0,0 +1,52 @@
+#ifndef _LISPY_STRBUF
+#define _LISPY_STRBUF
+
+#include "eval.h"
+
+/* One piece of a string builder. Small appends are packed into chunks
+    with spare room, large strings are adopted as whole chunks without
+    copying them.
+*/
+struct lsb_chunk
+{
+    struct lsb_chunk *next;
+    long len;
+    long cap;
+    char *data;
+};
+
+/* Mutable string builder, a list of chunks with the total length kept
+    up to date. Like maps, every copy of the lval shares the builder.
+*/
+struct lsb
+{
+    int refs;
+    long len;
+    struct lsb_chunk *head;
+    struct lsb_chunk *tail;
+};
+
+/************* Construct and release builders ****************/
+lval *lval_sb(void);
+struct lsb *lsb_ref(struct lsb *b);
+void lsb_unref(struct lsb *b);
+
+/* Append `len` bytes from `s`. */
+void lsb_append(struct lsb *b, const char *s, long len);
+/* Append a string lval, consuming it. Long strings hand over their buffer. */
+void lsb_append_str(struct lsb *b, lval *s);
+/* Copy the contents into a new string lval, or give a heap limit error. */
+lval *lsb_build(struct lsb *b);
+
+void lval_print_sb(lwriter *w, lval *v);
+
+/************* Builtins ****************/
+lval *builtin_str_cat(lenv *e, lval *a);
+lval *builtin_str_join(lenv *e, lval *a);
+lval *builtin_sb_new(lenv *e, lval *a);
+lval *builtin_sb_append(lenv *e, lval *a);
+lval *builtin_sb_build(lenv *e, lval *a);
+
+void lenv_add_sb_builtins(lenv *e);
+
+#endif
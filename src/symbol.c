@@ -0,0 +1,109 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "eval.h"
+#include "heap.h"
+#include "symbol.h"
+
+/* Caches start out stale, the version only ever counts up from here. */
+unsigned long lenv_version = 1;
+
+/* Names live as long as the interpreter, in an open addressing table. */
+static struct
+{
+    long count;
+    long cap;
+    struct lsym **slots;
+} lsymtab;
+
+static uint64_t lsym_hash(const char *s)
+{
+    /* FNV-1a */
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (; *s; s++)
+        h = (h ^ (unsigned char)*s) * 0x100000001b3ULL;
+    return h;
+}
+
+static void lsym_grow(void)
+{
+    long old_cap = lsymtab.cap;
+    struct lsym **old = lsymtab.slots;
+    lsymtab.cap = old_cap ? old_cap * 2 : 256;
+    lsymtab.slots = lheap_alloc(LVAL_SYM, sizeof(struct lsym *) * lsymtab.cap);
+    memset(lsymtab.slots, 0, sizeof(struct lsym *) * lsymtab.cap);
+
+    long mask = lsymtab.cap - 1;
+    for (long i = 0; i < old_cap; i++)
+    {
+        if (!old[i])
+            continue;
+        long j = (long)(lsym_hash(old[i]->name) & mask);
+        while (lsymtab.slots[j])
+            j = (j + 1) & mask;
+        lsymtab.slots[j] = old[i];
+    }
+    lheap_free(old);
+}
+
+struct lsym *lsym_intern(const char *name)
+{
+    if ((lsymtab.count + 1) * 2 > lsymtab.cap)
+        lsym_grow();
+
+    long mask = lsymtab.cap - 1;
+    long i = (long)(lsym_hash(name) & mask);
+    while (lsymtab.slots[i])
+    {
+        if (STR_EQ(lsymtab.slots[i]->name, name))
+            return lsymtab.slots[i];
+        i = (i + 1) & mask;
+    }
+
+    struct lsym *s = lheap_alloc(LVAL_SYM, sizeof(struct lsym));
+    s->name = lheap_strdup(LVAL_SYM, name);
+    s->local = false;
+    s->ns = NULL;
+    s->member = NULL;
+    s->module = NULL;
+    lsymtab.slots[i] = s;
+    lsymtab.count++;
+
+    /* Split qualified names once, after `s` is in the table that may grow. */
+    char *colon = strchr(s->name, ':');
+    if (colon && colon != s->name && colon[1])
+    {
+        char *ns = lheap_strdup(LVAL_SYM, s->name);
+        ns[colon - s->name] = '\0';
+        s->ns = lsym_intern(ns);
+        s->member = lsym_intern(colon + 1);
+        lheap_free(ns);
+    }
+    return s;
+}
+
+/************* Inline caches ****************/
+struct lic *lic_new(const char *name)
+{
+    struct lic *c = lheap_alloc(LVAL_SYM, sizeof(struct lic));
+    c->refs = 1;
+    c->rec = lsym_intern(name);
+    c->version = 0;
+    c->env = NULL;
+    c->index = 0;
+    return c;
+}
+
+struct lic *lic_ref(struct lic *c)
+{
+    c->refs++;
+    return c;
+}
+
+void lic_unref(struct lic *c)
+{
+    if (--c->refs == 0)
+        lheap_free(c);
+}
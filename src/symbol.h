@@ -0,0 +1,47 @@
+#ifndef _LISPY_SYMBOL
+#define _LISPY_SYMBOL
+
+#include <stdbool.h>
+#include "eval.h"
+
+/* Interned symbol name. Every symbol lval and environment entry points at
+    the single copy of its name, so names compare by pointer.
+*/
+struct lsym
+{
+    char *name;
+    /* Set once the name is bound outside the global environment. Such a
+        binding may shadow the global one, so lookups of the name are no
+        longer cached.
+    */
+    bool local;
+    /* For a qualified name `ns:member`, its two parts. */
+    struct lsym *ns;
+    struct lsym *member;
+    /* Module imported under this name, whose environment `name:` refers to. */
+    lenv *module;
+};
+
+/* Inline cache of one symbol reference in the source, shared by every copy
+    of that symbol lval. It is valid while `version` matches `lenv_version`.
+*/
+struct lic
+{
+    int refs;
+    struct lsym *rec;
+    unsigned long version;
+    lenv *env;
+    int index;
+};
+
+/* Bumped whenever a binding of the global environment changes. */
+extern unsigned long lenv_version;
+
+struct lsym *lsym_intern(const char *name);
+
+/************* Inline caches ****************/
+struct lic *lic_new(const char *name);
+struct lic *lic_ref(struct lic *c);
+void lic_unref(struct lic *c);
+
+#endif
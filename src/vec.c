@@ -0,0 +1,1091 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <inttypes.h>
+
+#include "eval.h"
+#include "heap.h"
+#include "vec.h"
+#include "bignum.h"
+#include "writer.h"
+
+/* SSE2 is part of the x86-64 baseline, AVX2 kernels are compiled with a
+    target attribute and picked at runtime, so no extra build flags are needed.
+*/
+#if defined(__GNUC__) && defined(__SSE2__)
+#define LVEC_X86 1
+#include <immintrin.h>
+#endif
+
+/************* Construct and release vectors ****************/
+lval *lval_vec(enum lval_type type, long len)
+{
+    /* Header and elements live in one block, whose size comes from the
+        program, so the heap limit may refuse it.
+    */
+    if (len > (long)((LONG_MAX - sizeof(struct lvec)) / sizeof(double)))
+        return lval_err_code(LERR_HEAP);
+    struct lvec *p = lheap_try_alloc(type, sizeof(struct lvec) + sizeof(double) * len);
+    if (p == NULL)
+        return lval_err_code(LERR_HEAP);
+    p->refs = 1;
+    p->len = len;
+    p->f64 = (double *)(p + 1);
+
+    lval *v = lheap_alloc(type, sizeof(lval));
+    v->type = type;
+    v->vec = p;
+    return v;
+}
+
+struct lvec *lvec_ref(struct lvec *v)
+{
+    v->refs++;
+    return v;
+}
+
+void lvec_unref(struct lvec *v)
+{
+    if (--v->refs == 0)
+        lheap_free(v);
+}
+
+int lvec_eq(lval *x, lval *y)
+{
+    if (x->vec->len != y->vec->len)
+        return 0;
+    for (long i = 0; i < x->vec->len; i++)
+    {
+        if (x->type == LVAL_F64VEC ? x->vec->f64[i] != y->vec->f64[i]
+                                   : x->vec->i64[i] != y->vec->i64[i])
+            return 0;
+    }
+    return 1;
+}
+
+void lval_print_vec(lwriter *w, lval *v)
+{
+    lw_puts(w, v->type == LVAL_F64VEC ? "#f64[" : "#i64[");
+    for (long i = 0; i < v->vec->len; i++)
+    {
+        if (v->type == LVAL_F64VEC)
+        {
+            lval d = {.type = LVAL_DBL, .dbl = v->vec->f64[i]};
+            lval_print_dbl(w, &d);
+        }
+        else
+        {
+            lw_printf(w, "%" PRId64, v->vec->i64[i]);
+        }
+        if (i != v->vec->len - 1)
+            lw_putc(w, ' ');
+    }
+    lw_putc(w, ']');
+}
+
+/************* Runtime CPU dispatch ****************/
+#ifdef LVEC_X86
+static int lvec_avx2(void)
+{
+    static int has = -1;
+    if (has < 0)
+    {
+        __builtin_cpu_init();
+        has = __builtin_cpu_supports("avx2") ? 1 : 0;
+    }
+    return has;
+}
+#endif
+
+/************* f64 kernels ****************/
+/* Each SIMD kernel returns how many leading elements it handled, the scalar
+    loop finishes the tail. A stride of 0 broadcasts the first element.
+*/
+#ifdef LVEC_X86
+__attribute__((target("avx2"))) static long lvec_f64_binop_avx2(char op, double *out,
+                                                                 const double *x, int xs,
+                                                                 const double *y, int ys, long n)
+{
+    __m256d bx = _mm256_set1_pd(x[0]);
+    __m256d by = _mm256_set1_pd(y[0]);
+    long i = 0;
+#define LVEC_LOOP(VOP)                                         \
+    for (; i + 4 <= n; i += 4)                                 \
+    {                                                          \
+        __m256d vx = xs ? _mm256_loadu_pd(x + i) : bx;         \
+        __m256d vy = ys ? _mm256_loadu_pd(y + i) : by;         \
+        _mm256_storeu_pd(out + i, VOP(vx, vy));                \
+    }
+    switch (op)
+    {
+    case '+':
+        LVEC_LOOP(_mm256_add_pd);
+        break;
+    case '-':
+        LVEC_LOOP(_mm256_sub_pd);
+        break;
+    case '*':
+        LVEC_LOOP(_mm256_mul_pd);
+        break;
+    case '/':
+        LVEC_LOOP(_mm256_div_pd);
+        break;
+    }
+#undef LVEC_LOOP
+    return i;
+}
+
+static long lvec_f64_binop_sse2(char op, double *out, const double *x, int xs,
+                                const double *y, int ys, long n)
+{
+    __m128d bx = _mm_set1_pd(x[0]);
+    __m128d by = _mm_set1_pd(y[0]);
+    long i = 0;
+#define LVEC_LOOP(VOP)                                   \
+    for (; i + 2 <= n; i += 2)                           \
+    {                                                    \
+        __m128d vx = xs ? _mm_loadu_pd(x + i) : bx;      \
+        __m128d vy = ys ? _mm_loadu_pd(y + i) : by;      \
+        _mm_storeu_pd(out + i, VOP(vx, vy));             \
+    }
+    switch (op)
+    {
+    case '+':
+        LVEC_LOOP(_mm_add_pd);
+        break;
+    case '-':
+        LVEC_LOOP(_mm_sub_pd);
+        break;
+    case '*':
+        LVEC_LOOP(_mm_mul_pd);
+        break;
+    case '/':
+        LVEC_LOOP(_mm_div_pd);
+        break;
+    }
+#undef LVEC_LOOP
+    return i;
+}
+#endif
+
+static void lvec_f64_binop(char op, double *out, const double *x, int xs,
+                           const double *y, int ys, long n)
+{
+    long i = 0;
+#ifdef LVEC_X86
+    i = lvec_avx2() ? lvec_f64_binop_avx2(op, out, x, xs, y, ys, n)
+                    : lvec_f64_binop_sse2(op, out, x, xs, y, ys, n);
+#endif
+    for (; i < n; i++)
+    {
+        double a = x[xs * i];
+        double b = y[ys * i];
+        switch (op)
+        {
+        case '+':
+            out[i] = a + b;
+            break;
+        case '-':
+            out[i] = a - b;
+            break;
+        case '*':
+            out[i] = a * b;
+            break;
+        case '/':
+            out[i] = a / b;
+            break;
+        }
+    }
+}
+
+/* Comparison codes: '>' '<', 'G' for >= and 'L' for <=. Results are 0 or 1. */
+#ifdef LVEC_X86
+__attribute__((target("avx2"))) static long lvec_f64_cmp_avx2(char op, int64_t *out,
+                                                              const double *x, int xs,
+                                                              const double *y, int ys, long n)
+{
+    __m256d bx = _mm256_set1_pd(x[0]);
+    __m256d by = _mm256_set1_pd(y[0]);
+    __m256i one = _mm256_set1_epi64x(1);
+    long i = 0;
+#define LVEC_LOOP(PRED)                                                          \
+    for (; i + 4 <= n; i += 4)                                                   \
+    {                                                                            \
+        __m256d vx = xs ? _mm256_loadu_pd(x + i) : bx;                           \
+        __m256d vy = ys ? _mm256_loadu_pd(y + i) : by;                           \
+        __m256i m = _mm256_castpd_si256(_mm256_cmp_pd(vx, vy, PRED));            \
+        _mm256_storeu_si256((__m256i *)(out + i), _mm256_and_si256(m, one));     \
+    }
+    switch (op)
+    {
+    case '>':
+        LVEC_LOOP(_CMP_GT_OQ);
+        break;
+    case '<':
+        LVEC_LOOP(_CMP_LT_OQ);
+        break;
+    case 'G':
+        LVEC_LOOP(_CMP_GE_OQ);
+        break;
+    case 'L':
+        LVEC_LOOP(_CMP_LE_OQ);
+        break;
+    }
+#undef LVEC_LOOP
+    return i;
+}
+
+static long lvec_f64_cmp_sse2(char op, int64_t *out, const double *x, int xs,
+                              const double *y, int ys, long n)
+{
+    __m128d bx = _mm_set1_pd(x[0]);
+    __m128d by = _mm_set1_pd(y[0]);
+    __m128i one = _mm_set1_epi64x(1);
+    long i = 0;
+#define LVEC_LOOP(VCMP)                                                   \
+    for (; i + 2 <= n; i += 2)                                            \
+    {                                                                     \
+        __m128d vx = xs ? _mm_loadu_pd(x + i) : bx;                       \
+        __m128d vy = ys ? _mm_loadu_pd(y + i) : by;                       \
+        __m128i m = _mm_castpd_si128(VCMP(vx, vy));                       \
+        _mm_storeu_si128((__m128i *)(out + i), _mm_and_si128(m, one));    \
+    }
+    switch (op)
+    {
+    case '>':
+        LVEC_LOOP(_mm_cmpgt_pd);
+        break;
+    case '<':
+        LVEC_LOOP(_mm_cmplt_pd);
+        break;
+    case 'G':
+        LVEC_LOOP(_mm_cmpge_pd);
+        break;
+    case 'L':
+        LVEC_LOOP(_mm_cmple_pd);
+        break;
+    }
+#undef LVEC_LOOP
+    return i;
+}
+#endif
+
+static void lvec_f64_cmp(char op, int64_t *out, const double *x, int xs,
+                         const double *y, int ys, long n)
+{
+    long i = 0;
+#ifdef LVEC_X86
+    i = lvec_avx2() ? lvec_f64_cmp_avx2(op, out, x, xs, y, ys, n)
+                    : lvec_f64_cmp_sse2(op, out, x, xs, y, ys, n);
+#endif
+    for (; i < n; i++)
+    {
+        double a = x[xs * i];
+        double b = y[ys * i];
+        switch (op)
+        {
+        case '>':
+            out[i] = a > b;
+            break;
+        case '<':
+            out[i] = a < b;
+            break;
+        case 'G':
+            out[i] = a >= b;
+            break;
+        case 'L':
+            out[i] = a <= b;
+            break;
+        }
+    }
+}
+
+/* Reduction codes: 's' sum, 'm' min, 'M' max, 'd' dot product with `y`. */
+#ifdef LVEC_X86
+__attribute__((target("avx2"))) static double lvec_f64_reduce_avx2(char op, const double *x,
+                                                                   const double *y, long n,
+                                                                   long *done)
+{
+    /* Two accumulators hide the latency of the dependent adds. */
+    __m256d a0 = op == 's' || op == 'd' ? _mm256_setzero_pd() : _mm256_set1_pd(x[0]);
+    __m256d a1 = a0;
+    long i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256d x0 = _mm256_loadu_pd(x + i);
+        __m256d x1 = _mm256_loadu_pd(x + i + 4);
+        switch (op)
+        {
+        case 's':
+            a0 = _mm256_add_pd(a0, x0);
+            a1 = _mm256_add_pd(a1, x1);
+            break;
+        case 'd':
+            a0 = _mm256_add_pd(a0, _mm256_mul_pd(x0, _mm256_loadu_pd(y + i)));
+            a1 = _mm256_add_pd(a1, _mm256_mul_pd(x1, _mm256_loadu_pd(y + i + 4)));
+            break;
+        case 'm':
+            a0 = _mm256_min_pd(a0, x0);
+            a1 = _mm256_min_pd(a1, x1);
+            break;
+        case 'M':
+            a0 = _mm256_max_pd(a0, x0);
+            a1 = _mm256_max_pd(a1, x1);
+            break;
+        }
+    }
+
+    double lanes[8];
+    _mm256_storeu_pd(lanes, a0);
+    _mm256_storeu_pd(lanes + 4, a1);
+    double r = lanes[0];
+    for (int k = 1; k < 8; k++)
+    {
+        if (op == 's' || op == 'd')
+            r += lanes[k];
+        else if (op == 'm')
+            r = lanes[k] < r ? lanes[k] : r;
+        else
+            r = lanes[k] > r ? lanes[k] : r;
+    }
+    *done = i;
+    return r;
+}
+
+static double lvec_f64_reduce_sse2(char op, const double *x, const double *y, long n, long *done)
+{
+    __m128d a0 = op == 's' || op == 'd' ? _mm_setzero_pd() : _mm_set1_pd(x[0]);
+    __m128d a1 = a0;
+    long i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128d x0 = _mm_loadu_pd(x + i);
+        __m128d x1 = _mm_loadu_pd(x + i + 2);
+        switch (op)
+        {
+        case 's':
+            a0 = _mm_add_pd(a0, x0);
+            a1 = _mm_add_pd(a1, x1);
+            break;
+        case 'd':
+            a0 = _mm_add_pd(a0, _mm_mul_pd(x0, _mm_loadu_pd(y + i)));
+            a1 = _mm_add_pd(a1, _mm_mul_pd(x1, _mm_loadu_pd(y + i + 2)));
+            break;
+        case 'm':
+            a0 = _mm_min_pd(a0, x0);
+            a1 = _mm_min_pd(a1, x1);
+            break;
+        case 'M':
+            a0 = _mm_max_pd(a0, x0);
+            a1 = _mm_max_pd(a1, x1);
+            break;
+        }
+    }
+
+    double lanes[4];
+    _mm_storeu_pd(lanes, a0);
+    _mm_storeu_pd(lanes + 2, a1);
+    double r = lanes[0];
+    for (int k = 1; k < 4; k++)
+    {
+        if (op == 's' || op == 'd')
+            r += lanes[k];
+        else if (op == 'm')
+            r = lanes[k] < r ? lanes[k] : r;
+        else
+            r = lanes[k] > r ? lanes[k] : r;
+    }
+    *done = i;
+    return r;
+}
+#endif
+
+/* Reduce a non-empty vector. */
+static double lvec_f64_reduce(char op, const double *x, const double *y, long n)
+{
+    long i = 0;
+    double r = op == 's' || op == 'd' ? 0.0 : x[0];
+#ifdef LVEC_X86
+    r = lvec_avx2() ? lvec_f64_reduce_avx2(op, x, y, n, &i)
+                    : lvec_f64_reduce_sse2(op, x, y, n, &i);
+    if (i == 0)
+        r = op == 's' || op == 'd' ? 0.0 : x[0];
+#endif
+    for (; i < n; i++)
+    {
+        switch (op)
+        {
+        case 's':
+            r += x[i];
+            break;
+        case 'd':
+            r += x[i] * y[i];
+            break;
+        case 'm':
+            r = x[i] < r ? x[i] : r;
+            break;
+        case 'M':
+            r = x[i] > r ? x[i] : r;
+            break;
+        }
+    }
+    return r;
+}
+
+/************* i64 kernels ****************/
+/* Only addition and subtraction have 64-bit lanes before AVX-512, the other
+    integer operations run as scalar loops.
+*/
+#ifdef LVEC_X86
+__attribute__((target("avx2"))) static long lvec_i64_binop_avx2(char op, int64_t *out,
+                                                                const int64_t *x, int xs,
+                                                                const int64_t *y, int ys, long n)
+{
+    __m256i bx = _mm256_set1_epi64x(x[0]);
+    __m256i by = _mm256_set1_epi64x(y[0]);
+    long i = 0;
+#define LVEC_LOOP(VOP)                                                          \
+    for (; i + 4 <= n; i += 4)                                                  \
+    {                                                                           \
+        __m256i vx = xs ? _mm256_loadu_si256((const __m256i *)(x + i)) : bx;    \
+        __m256i vy = ys ? _mm256_loadu_si256((const __m256i *)(y + i)) : by;    \
+        _mm256_storeu_si256((__m256i *)(out + i), VOP(vx, vy));                 \
+    }
+    switch (op)
+    {
+    case '+':
+        LVEC_LOOP(_mm256_add_epi64);
+        break;
+    case '-':
+        LVEC_LOOP(_mm256_sub_epi64);
+        break;
+    }
+#undef LVEC_LOOP
+    return i;
+}
+
+static long lvec_i64_binop_sse2(char op, int64_t *out, const int64_t *x, int xs,
+                                const int64_t *y, int ys, long n)
+{
+    __m128i bx = _mm_set1_epi64x(x[0]);
+    __m128i by = _mm_set1_epi64x(y[0]);
+    long i = 0;
+#define LVEC_LOOP(VOP)                                                       \
+    for (; i + 2 <= n; i += 2)                                               \
+    {                                                                        \
+        __m128i vx = xs ? _mm_loadu_si128((const __m128i *)(x + i)) : bx;    \
+        __m128i vy = ys ? _mm_loadu_si128((const __m128i *)(y + i)) : by;    \
+        _mm_storeu_si128((__m128i *)(out + i), VOP(vx, vy));                 \
+    }
+    switch (op)
+    {
+    case '+':
+        LVEC_LOOP(_mm_add_epi64);
+        break;
+    case '-':
+        LVEC_LOOP(_mm_sub_epi64);
+        break;
+    }
+#undef LVEC_LOOP
+    return i;
+}
+
+__attribute__((target("avx2"))) static long lvec_i64_cmp_avx2(char op, int64_t *out,
+                                                              const int64_t *x, int xs,
+                                                              const int64_t *y, int ys, long n)
+{
+    __m256i bx = _mm256_set1_epi64x(x[0]);
+    __m256i by = _mm256_set1_epi64x(y[0]);
+    __m256i one = _mm256_set1_epi64x(1);
+    long i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        __m256i vx = xs ? _mm256_loadu_si256((const __m256i *)(x + i)) : bx;
+        __m256i vy = ys ? _mm256_loadu_si256((const __m256i *)(y + i)) : by;
+        __m256i m;
+        switch (op)
+        {
+        case '>':
+            m = _mm256_cmpgt_epi64(vx, vy);
+            break;
+        case '<':
+            m = _mm256_cmpgt_epi64(vy, vx);
+            break;
+        case 'G':
+            m = _mm256_andnot_si256(_mm256_cmpgt_epi64(vy, vx), _mm256_set1_epi64x(-1));
+            break;
+        default:
+            m = _mm256_andnot_si256(_mm256_cmpgt_epi64(vx, vy), _mm256_set1_epi64x(-1));
+            break;
+        }
+        _mm256_storeu_si256((__m256i *)(out + i), _mm256_and_si256(m, one));
+    }
+    return i;
+}
+
+__attribute__((target("avx2"))) static int64_t lvec_i64_sum_avx2(const int64_t *x, long n, long *done)
+{
+    __m256i acc = _mm256_setzero_si256();
+    long i = 0;
+    for (; i + 4 <= n; i += 4)
+        acc = _mm256_add_epi64(acc, _mm256_loadu_si256((const __m256i *)(x + i)));
+
+    int64_t lanes[4];
+    _mm256_storeu_si256((__m256i *)lanes, acc);
+    *done = i;
+    return (int64_t)((uint64_t)lanes[0] + (uint64_t)lanes[1] + (uint64_t)lanes[2] + (uint64_t)lanes[3]);
+}
+
+static int64_t lvec_i64_sum_sse2(const int64_t *x, long n, long *done)
+{
+    __m128i acc = _mm_setzero_si128();
+    long i = 0;
+    for (; i + 2 <= n; i += 2)
+        acc = _mm_add_epi64(acc, _mm_loadu_si128((const __m128i *)(x + i)));
+
+    int64_t lanes[2];
+    _mm_storeu_si128((__m128i *)lanes, acc);
+    *done = i;
+    return (int64_t)((uint64_t)lanes[0] + (uint64_t)lanes[1]);
+}
+#endif
+
+static void lvec_i64_binop(char op, int64_t *out, const int64_t *x, int xs,
+                           const int64_t *y, int ys, long n)
+{
+    long i = 0;
+#ifdef LVEC_X86
+    i = lvec_avx2() ? lvec_i64_binop_avx2(op, out, x, xs, y, ys, n)
+                    : lvec_i64_binop_sse2(op, out, x, xs, y, ys, n);
+#endif
+    for (; i < n; i++)
+    {
+        int64_t a = x[xs * i];
+        int64_t b = y[ys * i];
+        switch (op)
+        {
+        /* Wrap around like the vector lanes, signed overflow is undefined. */
+        case '+':
+            out[i] = (int64_t)((uint64_t)a + (uint64_t)b);
+            break;
+        case '-':
+            out[i] = (int64_t)((uint64_t)a - (uint64_t)b);
+            break;
+        case '*':
+            out[i] = (int64_t)((uint64_t)a * (uint64_t)b);
+            break;
+        case '/':
+            out[i] = a / b;
+            break;
+        }
+    }
+}
+
+static void lvec_i64_cmp(char op, int64_t *out, const int64_t *x, int xs,
+                         const int64_t *y, int ys, long n)
+{
+    long i = 0;
+#ifdef LVEC_X86
+    if (lvec_avx2())
+        i = lvec_i64_cmp_avx2(op, out, x, xs, y, ys, n);
+#endif
+    for (; i < n; i++)
+    {
+        int64_t a = x[xs * i];
+        int64_t b = y[ys * i];
+        switch (op)
+        {
+        case '>':
+            out[i] = a > b;
+            break;
+        case '<':
+            out[i] = a < b;
+            break;
+        case 'G':
+            out[i] = a >= b;
+            break;
+        case 'L':
+            out[i] = a <= b;
+            break;
+        }
+    }
+}
+
+/* Reduce a non-empty vector. */
+static int64_t lvec_i64_reduce(char op, const int64_t *x, const int64_t *y, long n)
+{
+    long i = 0;
+    int64_t r = op == 's' || op == 'd' ? 0 : x[0];
+#ifdef LVEC_X86
+    if (op == 's')
+        r = lvec_avx2() ? lvec_i64_sum_avx2(x, n, &i) : lvec_i64_sum_sse2(x, n, &i);
+#endif
+    for (; i < n; i++)
+    {
+        switch (op)
+        {
+        case 's':
+            r = (int64_t)((uint64_t)r + (uint64_t)x[i]);
+            break;
+        case 'd':
+            r = (int64_t)((uint64_t)r + (uint64_t)x[i] * (uint64_t)y[i]);
+            break;
+        case 'm':
+            r = x[i] < r ? x[i] : r;
+            break;
+        case 'M':
+            r = x[i] > r ? x[i] : r;
+            break;
+        }
+    }
+    return r;
+}
+
+/************* Operand helpers ****************/
+#define LVAL_IS_VEC(v) ((v)->type == LVAL_F64VEC || (v)->type == LVAL_I64VEC)
+
+/* An operand seen as a run of elements: a vector has stride 1, a scalar is
+    broadcast with stride 0.
+*/
+struct lvec_operand
+{
+    int stride;
+    long len;
+    double f;
+    int64_t i;
+    double *f64;
+    int64_t *i64;
+    /* Converted copy of an i64 vector used in f64 arithmetic. */
+    double *tmp;
+};
+
+static void lvec_operand_init(struct lvec_operand *o, lval *v, int as_f64)
+{
+    memset(o, 0, sizeof(*o));
+    if (!LVAL_IS_VEC(v))
+    {
+        o->f = v->type == LVAL_DBL ? v->dbl : (double)v->num;
+        o->i = v->type == LVAL_DBL ? (int64_t)v->dbl : (int64_t)v->num;
+        o->f64 = &o->f;
+        o->i64 = &o->i;
+        return;
+    }
+
+    o->stride = 1;
+    o->len = v->vec->len;
+    if (v->type == LVAL_F64VEC)
+    {
+        o->f64 = v->vec->f64;
+        return;
+    }
+
+    o->i64 = v->vec->i64;
+    if (as_f64 && o->len)
+    {
+        o->tmp = lheap_alloc(LVAL_F64VEC, sizeof(double) * o->len);
+        for (long k = 0; k < o->len; k++)
+            o->tmp[k] = (double)o->i64[k];
+        o->f64 = o->tmp;
+    }
+}
+
+static void lvec_operand_free(struct lvec_operand *o)
+{
+    lheap_free(o->tmp);
+}
+
+/* Element count of a binary operation, or -1 when vector lengths differ. */
+static long lvec_result_len(struct lvec_operand *x, struct lvec_operand *y)
+{
+    if (x->stride && y->stride && x->len != y->len)
+        return -1;
+    return x->stride ? x->len : y->len;
+}
+
+static int lvec_is_f64(lval *v)
+{
+    return v->type == LVAL_F64VEC || v->type == LVAL_DBL;
+}
+
+/* Apply `op` to a pair of operands, at least one of which is a vector.
+    Consumes both. The left vector is updated in place when nobody shares it.
+*/
+static lval *lvec_binop(char op, lval *x, lval *y)
+{
+    enum lval_type type = lvec_is_f64(x) || lvec_is_f64(y) ? LVAL_F64VEC : LVAL_I64VEC;
+    struct lvec_operand ox, oy;
+    lvec_operand_init(&ox, x, type == LVAL_F64VEC);
+    lvec_operand_init(&oy, y, type == LVAL_F64VEC);
+
+    lval *err = NULL;
+    long n = lvec_result_len(&ox, &oy);
+    if (n < 0)
+    {
+        err = lval_err("Vector lengths do not match. Got %ld and %ld.", ox.len, oy.len);
+    }
+    else if (type == LVAL_I64VEC && op == '/')
+    {
+        for (long k = 0; k < n; k++)
+        {
+            int64_t a = ox.i64[ox.stride * k];
+            int64_t b = oy.i64[oy.stride * k];
+            if (b == 0)
+            {
+                err = lval_err_code(LERR_DIV_ZERO);
+                break;
+            }
+            if (a == INT64_MIN && b == -1)
+            {
+                err = lval_err("Integer overflow: %" PRId64 " / -1 does not fit in an i64.", a);
+                break;
+            }
+        }
+    }
+    if (err)
+    {
+        lvec_operand_free(&ox);
+        lvec_operand_free(&oy);
+        lval_del(x);
+        lval_del(y);
+        return err;
+    }
+
+    lval *r;
+    if (x->type == type && x->vec->refs == 1)
+        r = lval_copy(x);
+    else
+        r = lval_vec(type, n);
+
+    if (n > 0 && r->type != LVAL_ERR)
+    {
+        if (type == LVAL_F64VEC)
+            lvec_f64_binop(op, r->vec->f64, ox.f64, ox.stride, oy.f64, oy.stride, n);
+        else
+            lvec_i64_binop(op, r->vec->i64, ox.i64, ox.stride, oy.i64, oy.stride, n);
+    }
+
+    lvec_operand_free(&ox);
+    lvec_operand_free(&oy);
+    lval_del(x);
+    lval_del(y);
+    return r;
+}
+
+/* Fold `op` over arguments where at least one is a vector. Consumes `a`. */
+lval *lvec_op(lval *a, char *op)
+{
+    char o = op[0];
+    lval *x = lval_pop(a, 0);
+
+    /* If no arguments and sub then perform unary negation. */
+    if (o == '-' && a->count == 0)
+    {
+        lval_del(a);
+        return lvec_binop('-', lval_num(0), x);
+    }
+
+    while (a->count)
+    {
+        lval *y = lval_pop(a, 0);
+        if (LVAL_IS_VEC(x) || LVAL_IS_VEC(y))
+        {
+            /* The scalar prefix may have overflowed into a bignum, which only
+                f64 lanes can take, rounded.
+            */
+            if (x->type == LVAL_BIG && y->type != LVAL_F64VEC)
+            {
+                lval_del(x);
+                lval_del(y);
+                x = lval_err("Operator '%s' cannot mix vectors and %s.", op, ltype_name(LVAL_BIG));
+                break;
+            }
+            if (x->type == LVAL_BIG)
+            {
+                lval *d = lval_dbl(lbig_to_double(x->big));
+                lval_del(x);
+                x = d;
+            }
+            x = lvec_binop(o, x, y);
+        }
+        else
+        {
+            /* Plain numbers before the first vector use the scalar operator. */
+            x = builtin_op(NULL, lval_add(lval_add(lval_sexpr(), x), y), op);
+        }
+        if (x->type == LVAL_ERR)
+            break;
+    }
+    lval_del(a);
+    return x;
+}
+
+/* Compare two arguments where at least one is a vector. Consumes `a`. */
+lval *lvec_ord(lval *a, char *op)
+{
+    char o = op[1] == '=' ? (op[0] == '>' ? 'G' : 'L') : op[0];
+    lval *x = a->cell[0];
+    lval *y = a->cell[1];
+    int as_f64 = lvec_is_f64(x) || lvec_is_f64(y);
+
+    struct lvec_operand ox, oy;
+    lvec_operand_init(&ox, x, as_f64);
+    lvec_operand_init(&oy, y, as_f64);
+
+    lval *r;
+    long n = lvec_result_len(&ox, &oy);
+    if (n < 0)
+    {
+        r = lval_err("Vector lengths do not match. Got %ld and %ld.", ox.len, oy.len);
+    }
+    else
+    {
+        r = lval_vec(LVAL_I64VEC, n);
+        if (n > 0 && r->type != LVAL_ERR && as_f64)
+            lvec_f64_cmp(o, r->vec->i64, ox.f64, ox.stride, oy.f64, oy.stride, n);
+        else if (n > 0 && r->type != LVAL_ERR)
+            lvec_i64_cmp(o, r->vec->i64, ox.i64, ox.stride, oy.i64, oy.stride, n);
+    }
+
+    lvec_operand_free(&ox);
+    lvec_operand_free(&oy);
+    lval_del(a);
+    return r;
+}
+
+/************* Builtins ****************/
+static lval *lvec_build(lval *a, enum lval_type type, char *func)
+{
+    /* A single Q-Expression argument supplies the elements. */
+    lval *src = a;
+    if (a->count == 1 && a->cell[0]->type == LVAL_QEXPR)
+        src = a->cell[0];
+
+    for (int i = 0; i < src->count; i++)
+    {
+        LASSERT(a, type == LVAL_F64VEC ? LVAL_IS_NUMERIC(src->cell[i])
+                                       : src->cell[i]->type == LVAL_NUM,
+                "Function '%s' passed invalid element at pos %d. "
+                "Got %s, Expected %s.",
+                func, i, ltype_name(src->cell[i]->type),
+                ltype_name(type == LVAL_F64VEC ? LVAL_DBL : LVAL_NUM));
+    }
+
+    lval *v = lval_vec(type, src->count);
+    for (int i = 0; i < src->count && v->type != LVAL_ERR; i++)
+    {
+        lval *x = src->cell[i];
+        if (type == LVAL_F64VEC)
+            v->vec->f64[i] = x->type == LVAL_DBL ? x->dbl : (double)x->num;
+        else
+            v->vec->i64[i] = x->num;
+    }
+    lval_del(a);
+    return v;
+}
+
+lval *builtin_f64vec(lenv *e, lval *a)
+{
+    return lvec_build(a, LVAL_F64VEC, "f64vec");
+}
+
+lval *builtin_i64vec(lenv *e, lval *a)
+{
+    return lvec_build(a, LVAL_I64VEC, "i64vec");
+}
+
+lval *builtin_vec_fill(lenv *e, lval *a)
+{
+    LASSERT(a, a->count == 2, "Function '%s' passed wrong number of arguments. "
+                              "Got %d, Expected %d.",
+            "vec-fill", a->count, 2);
+    LASSERT(a, a->cell[0]->type == LVAL_NUM && a->cell[0]->num >= 0,
+            "Function '%s' expects a non-negative %s as length.",
+            "vec-fill", ltype_name(LVAL_NUM));
+    LASSERT(a, LVAL_IS_NUMERIC(a->cell[1]), "Function '%s' passed invalid type at pos %d. "
+                                            "Got %s, Expected %s.",
+            "vec-fill", 1, ltype_name(a->cell[1]->type), ltype_name(LVAL_NUM));
+
+    long n = a->cell[0]->num;
+    lval *x = a->cell[1];
+    lval *v = lval_vec(x->type == LVAL_DBL ? LVAL_F64VEC : LVAL_I64VEC, n);
+    for (long i = 0; i < n && v->type != LVAL_ERR; i++)
+    {
+        if (x->type == LVAL_DBL)
+            v->vec->f64[i] = x->dbl;
+        else
+            v->vec->i64[i] = x->num;
+    }
+    lval_del(a);
+    return v;
+}
+
+lval *builtin_vec_range(lenv *e, lval *a)
+{
+    LASSERT(a, a->count == 1, "Function '%s' passed wrong number of arguments. "
+                              "Got %d, Expected %d.",
+            "vec-range", a->count, 1);
+    LASSERT(a, a->cell[0]->type == LVAL_NUM && a->cell[0]->num >= 0,
+            "Function '%s' expects a non-negative %s as length.",
+            "vec-range", ltype_name(LVAL_NUM));
+
+    long n = a->cell[0]->num;
+    lval *v = lval_vec(LVAL_I64VEC, n);
+    for (long i = 0; i < n && v->type != LVAL_ERR; i++)
+        v->vec->i64[i] = i;
+    lval_del(a);
+    return v;
+}
+
+#define LASSERT_VEC(a, i, func)                                                   \
+    LASSERT(a, LVAL_IS_VEC(a->cell[i]), "Function '%s' passed invalid type at pos %d. " \
+                                        "Got %s, Expected a vector.",             \
+            func, i, ltype_name(a->cell[i]->type))
+
+lval *builtin_vec_len(lenv *e, lval *a)
+{
+    LASSERT(a, a->count == 1, "Function '%s' passed wrong number of arguments. "
+                              "Got %d, Expected %d.",
+            "vec-len", a->count, 1);
+    LASSERT_VEC(a, 0, "vec-len");
+
+    long n = a->cell[0]->vec->len;
+    lval_del(a);
+    return lval_num(n);
+}
+
+lval *builtin_vec_ref(lenv *e, lval *a)
+{
+    LASSERT(a, a->count == 2, "Function '%s' passed wrong number of arguments. "
+                              "Got %d, Expected %d.",
+            "vec-ref", a->count, 2);
+    LASSERT_VEC(a, 0, "vec-ref");
+    LASSERT(a, a->cell[1]->type == LVAL_NUM, "Function '%s' passed invalid type at pos %d. "
+                                             "Got %s, Expected %s.",
+            "vec-ref", 1, ltype_name(a->cell[1]->type), ltype_name(LVAL_NUM));
+
+    lval *v = a->cell[0];
+    long i = a->cell[1]->num;
+    LASSERT(a, i >= 0 && i < v->vec->len, "Index %ld out of range for vector of length %ld.",
+            i, v->vec->len);
+
+    lval *x = v->type == LVAL_F64VEC ? lval_dbl(v->vec->f64[i]) : lval_num((long)v->vec->i64[i]);
+    lval_del(a);
+    return x;
+}
+
+lval *builtin_vec_slice(lenv *e, lval *a)
+{
+    LASSERT(a, a->count == 3, "Function '%s' passed wrong number of arguments. "
+                              "Got %d, Expected %d.",
+            "vec-slice", a->count, 3);
+    LASSERT_VEC(a, 0, "vec-slice");
+    LASSERT(a, a->cell[1]->type == LVAL_NUM && a->cell[2]->type == LVAL_NUM,
+            "Function '%s' expects %s bounds.", "vec-slice", ltype_name(LVAL_NUM));
+
+    lval *v = a->cell[0];
+    long start = a->cell[1]->num;
+    long end = a->cell[2]->num;
+    LASSERT(a, 0 <= start && start <= end && end <= v->vec->len,
+            "Slice [%ld, %ld) out of range for vector of length %ld.",
+            start, end, v->vec->len);
+
+    lval *x = lval_vec(v->type, end - start);
+    if (x->type != LVAL_ERR)
+        memcpy(x->vec->f64, v->vec->f64 + start, sizeof(double) * (end - start));
+    lval_del(a);
+    return x;
+}
+
+lval *builtin_vec_list(lenv *e, lval *a)
+{
+    LASSERT(a, a->count == 1, "Function '%s' passed wrong number of arguments. "
+                              "Got %d, Expected %d.",
+            "vec-list", a->count, 1);
+    LASSERT_VEC(a, 0, "vec-list");
+
+    lval *v = a->cell[0];
+    lval *x = lval_qexpr();
+    /* The list is many times the size of the vector, stop once over the limit. */
+    for (long i = 0; i < v->vec->len && !lheap_exceeded(); i++)
+    {
+        x = lval_add(x, v->type == LVAL_F64VEC ? lval_dbl(v->vec->f64[i])
+                                               : lval_num((long)v->vec->i64[i]));
+    }
+    lval_del(a);
+    return x;
+}
+
+static lval *lvec_reduce(lval *a, char op, char *func)
+{
+    int nargs = op == 'd' ? 2 : 1;
+    LASSERT(a, a->count == nargs, "Function '%s' passed wrong number of arguments. "
+                                  "Got %d, Expected %d.",
+            func, a->count, nargs);
+    LASSERT_VEC(a, 0, func);
+
+    lval *x = a->cell[0];
+    lval *y = x;
+    if (op == 'd')
+    {
+        LASSERT_VEC(a, 1, func);
+        y = a->cell[1];
+        LASSERT(a, x->vec->len == y->vec->len, "Vector lengths do not match. Got %ld and %ld.",
+                x->vec->len, y->vec->len);
+    }
+    LASSERT(a, op == 's' || op == 'd' || x->vec->len > 0,
+            "Function '%s' passed an empty vector.", func);
+
+    lval *r;
+    if (x->type == LVAL_I64VEC && y->type == LVAL_I64VEC)
+    {
+        r = lval_num((long)lvec_i64_reduce(op, x->vec->i64, y->vec->i64, x->vec->len));
+    }
+    else
+    {
+        struct lvec_operand ox, oy;
+        lvec_operand_init(&ox, x, 1);
+        lvec_operand_init(&oy, y, 1);
+        r = lval_dbl(x->vec->len ? lvec_f64_reduce(op, ox.f64, oy.f64, x->vec->len) : 0.0);
+        lvec_operand_free(&ox);
+        lvec_operand_free(&oy);
+    }
+    lval_del(a);
+    return r;
+}
+
+lval *builtin_vec_sum(lenv *e, lval *a)
+{
+    return lvec_reduce(a, 's', "vec-sum");
+}
+
+lval *builtin_vec_min(lenv *e, lval *a)
+{
+    return lvec_reduce(a, 'm', "vec-min");
+}
+
+lval *builtin_vec_max(lenv *e, lval *a)
+{
+    return lvec_reduce(a, 'M', "vec-max");
+}
+
+lval *builtin_vec_dot(lenv *e, lval *a)
+{
+    return lvec_reduce(a, 'd', "vec-dot");
+}
+
+void lenv_add_vec_builtins(lenv *e)
+{
+    lenv_add_builtin(e, "f64vec", builtin_f64vec);
+    lenv_add_builtin(e, "i64vec", builtin_i64vec);
+    lenv_add_builtin(e, "vec-fill", builtin_vec_fill);
+    lenv_add_builtin(e, "vec-range", builtin_vec_range);
+    lenv_add_builtin(e, "vec-len", builtin_vec_len);
+    lenv_add_builtin(e, "vec-ref", builtin_vec_ref);
+    lenv_add_builtin(e, "vec-slice", builtin_vec_slice);
+    lenv_add_builtin(e, "vec-list", builtin_vec_list);
+    lenv_add_builtin(e, "vec-sum", builtin_vec_sum);
+    lenv_add_builtin(e, "vec-min", builtin_vec_min);
+    lenv_add_builtin(e, "vec-max", builtin_vec_max);
+    lenv_add_builtin(e, "vec-dot", builtin_vec_dot);
+}
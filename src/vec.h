@@ -0,0 +1,56 @@
+#ifndef _LISPY_VEC
+#define _LISPY_VEC
+
+#include <stdint.h>
+#include "eval.h"
+
+/* Contiguous numeric array shared between copies of an lval. Vectors are
+    immutable once built, so `lval_copy` only bumps the reference count.
+*/
+struct lvec
+{
+    int refs;
+    long len;
+    union
+    {
+        double *f64;
+        int64_t *i64;
+    };
+};
+
+/************* Construct and release vectors ****************/
+/* Create a vector lval of type LVAL_F64VEC or LVAL_I64VEC with `len` elements.
+    Returns a heap limit error when the elements do not fit.
+*/
+lval *lval_vec(enum lval_type type, long len);
+/* Share the payload of a vector lval. */
+struct lvec *lvec_ref(struct lvec *v);
+/* Drop one reference of a vector payload. */
+void lvec_unref(struct lvec *v);
+
+int lvec_eq(lval *x, lval *y);
+void lval_print_vec(lwriter *w, lval *v);
+
+/************* Elementwise arithmetic and comparisons ****************/
+/* Fold `op` over arguments where at least one is a vector. Consumes `a`. */
+lval *lvec_op(lval *a, char *op);
+/* Compare two arguments where at least one is a vector. Consumes `a`. */
+lval *lvec_ord(lval *a, char *op);
+
+/************* Builtins ****************/
+lval *builtin_f64vec(lenv *e, lval *a);
+lval *builtin_i64vec(lenv *e, lval *a);
+lval *builtin_vec_fill(lenv *e, lval *a);
+lval *builtin_vec_range(lenv *e, lval *a);
+lval *builtin_vec_len(lenv *e, lval *a);
+lval *builtin_vec_ref(lenv *e, lval *a);
+lval *builtin_vec_slice(lenv *e, lval *a);
+lval *builtin_vec_list(lenv *e, lval *a);
+lval *builtin_vec_sum(lenv *e, lval *a);
+lval *builtin_vec_min(lenv *e, lval *a);
+lval *builtin_vec_max(lenv *e, lval *a);
+lval *builtin_vec_dot(lenv *e, lval *a);
+
+void lenv_add_vec_builtins(lenv *e);
+
+#endif
@@ -0,0 +1,149 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+
+#include "eval.h"
+#include "heap.h"
+#include "writer.h"
+
+#define LW_FILE_BUF (1 << 16)
+#define LW_MEM_MIN 256
+
+static char lw_out_buf[LW_FILE_BUF];
+lwriter lw_out = {NULL, lw_out_buf, 0, sizeof(lw_out_buf), 0};
+
+/************* Memory writers ****************/
+void lw_open_mem(lwriter *w)
+{
+    w->file = NULL;
+    w->buf = NULL;
+    w->len = 0;
+    w->cap = 0;
+    w->line_buffered = 0;
+}
+
+lval *lw_take_str(lwriter *w)
+{
+    /* Give back the slack, keeping room for the terminator. */
+    char *s = lheap_realloc(LVAL_STR, w->buf, w->len + 1);
+    lval *v = lval_str_take(s, w->len);
+    lw_open_mem(w);
+    return v;
+}
+
+/************* Output ****************/
+/* Standard output is not a constant expression, bind it on first use. */
+static FILE *lw_file(lwriter *w)
+{
+    return w == &lw_out ? stdout : w->file;
+}
+
+void lw_flush(lwriter *w)
+{
+    FILE *f = lw_file(w);
+    if (!f)
+        return;
+    fwrite(w->buf, 1, w->len, f);
+    fflush(f);
+    w->len = 0;
+}
+
+void lw_write(lwriter *w, const char *s, size_t n)
+{
+    if (w->len + n <= w->cap)
+    {
+        memcpy(w->buf + w->len, s, n);
+        w->len += n;
+        return;
+    }
+
+    FILE *f = lw_file(w);
+    if (f)
+    {
+        /* Large blocks skip the buffer. */
+        fwrite(w->buf, 1, w->len, f);
+        w->len = 0;
+        if (n >= w->cap)
+        {
+            fwrite(s, 1, n, f);
+            return;
+        }
+    }
+    else
+    {
+        /* Keep one byte for the terminator added by `lw_take_str`. */
+        size_t cap = w->cap ? w->cap : LW_MEM_MIN;
+        while (cap < w->len + n + 1)
+            cap *= 2;
+        w->buf = lheap_realloc(LVAL_STR, w->buf, cap);
+        w->cap = cap - 1;
+    }
+    memcpy(w->buf + w->len, s, n);
+    w->len += n;
+}
+
+void lw_puts(lwriter *w, const char *s)
+{
+    lw_write(w, s, strlen(s));
+}
+
+void lw_printf(lwriter *w, const char *fmt, ...)
+{
+    char buf[256];
+    va_list va;
+    va_start(va, fmt);
+    int n = vsnprintf(buf, sizeof(buf), fmt, va);
+    va_end(va);
+
+    if (n < (int)sizeof(buf))
+    {
+        lw_write(w, buf, n);
+        return;
+    }
+
+    char *big = malloc(n + 1);
+    va_start(va, fmt);
+    vsnprintf(big, n + 1, fmt, va);
+    va_end(va);
+    lw_write(w, big, n);
+    free(big);
+}
+
+/* Same escapes as mpcf_escape, so printed strings read back unchanged. */
+void lw_write_escaped(lwriter *w, const char *s, size_t n)
+{
+    size_t run = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        const char *esc;
+        switch (s[i])
+        {
+        case '\a': esc = "\\a"; break;
+        case '\b': esc = "\\b"; break;
+        case '\f': esc = "\\f"; break;
+        case '\n': esc = "\\n"; break;
+        case '\r': esc = "\\r"; break;
+        case '\t': esc = "\\t"; break;
+        case '\v': esc = "\\v"; break;
+        case '\\': esc = "\\\\"; break;
+        case '\'': esc = "\\'"; break;
+        case '\"': esc = "\\\""; break;
+        case '\0': esc = "\\0"; break;
+        default: continue;
+        }
+
+        /* Write the plain run before the escape in one go. */
+        lw_write(w, s + run, i - run);
+        lw_write(w, esc, 2);
+        run = i + 1;
+    }
+    lw_write(w, s + run, n - run);
+}
+
+void lw_endline(lwriter *w)
+{
+    lw_putc(w, '\n');
+    if (w->line_buffered)
+        lw_flush(w);
+}
@@ -0,0 +1,48 @@
+#ifndef _LISPY_WRITER
+#define _LISPY_WRITER
+
+#include <stdio.h>
+#include <stddef.h>
+#include "eval.h"
+
+/* Buffered output used by the whole printer family. A writer either sends
+    its bytes to a FILE through a fixed buffer, flushed when full or on
+    request, or collects them in a growing memory buffer.
+*/
+struct lwriter
+{
+    FILE *file;
+    char *buf;
+    size_t len;
+    size_t cap;
+    /* Flush at the end of every line, used for terminals. */
+    int line_buffered;
+};
+
+/* Writer for standard output. */
+extern lwriter lw_out;
+
+/************* Memory writers ****************/
+void lw_open_mem(lwriter *w);
+/* Turn the collected bytes into a string lval and reset the writer. */
+lval *lw_take_str(lwriter *w);
+
+/************* Output ****************/
+void lw_flush(lwriter *w);
+void lw_write(lwriter *w, const char *s, size_t n);
+void lw_puts(lwriter *w, const char *s);
+void lw_printf(lwriter *w, const char *fmt, ...);
+/* Write `n` bytes with the escapes the reader understands, without copying. */
+void lw_write_escaped(lwriter *w, const char *s, size_t n);
+/* Finish a line, flushing line buffered writers. */
+void lw_endline(lwriter *w);
+
+static inline void lw_putc(lwriter *w, char c)
+{
+    if (w->len == w->cap)
+        lw_write(w, &c, 1);
+    else
+        w->buf[w->len++] = c;
+}
+
+#endif
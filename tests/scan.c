@@ -0,0 +1,28 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "heap.h"
+#include "scan.h"
+
+/* A big file is parsed in pieces, each one shifted by the line it starts on,
+    so every error row after a cut depends on the line count of the scan.
+*/
+static int check_line(struct lchunk *c, int n, int i, long line)
+{
+    if (i < n && c[i].line == line)
+        return 0;
+    fprintf(stderr, "piece %d: expected line %ld, got %ld\n", i, line, i < n ? c[i].line : -1L);
+    return 1;
+}
+
+int main(void)
+{
+    /* An escaped line end inside a string still ends a line. */
+    const char *text = "(print \"a\\\nb\")\n(head 1)\n(head {} {})\n";
+    struct lchunk *c;
+    int n = lscan_split(text, (long)strlen(text), 1, &c);
+
+    int bad = check_line(c, n, 0, 0) + check_line(c, n, 1, 2) + check_line(c, n, 2, 3);
+    lheap_free(c);
+    return bad ? 1 : 0;
+}
@@ -7,11 +7,32 @@ target("mpcer")
     set_kind("static")
     add_files("lib/mpc/*.c")
 
+-- Everything but the REPL, also linked by programs from `lispy --compile-c`
+target("lispyrt")
+    set_kind("static")
+    add_files("src/*.c|main.c")
+    add_deps("mpcer")
+    add_syslinks("m", "pthread", {public = true})
+
 target("lispy")
     set_kind("binary")
-    add_files("src/*.c")
-    add_deps("mpcer")
+    add_files("src/main.c")
+    add_deps("lispyrt")
     add_packages("editline")
+    -- Scripts under tests/ and the output they must give, run with `xmake test`
+    add_tests("vec_big_prefix", {runargs = "tests/vec_big_prefix.lspy", rundir = os.projectdir(),
+              plain = true, trim_output = true,
+              pass_outputs = "Error: Operator '+' cannot mix vectors and Bignum. (line 1, column 1)\n" ..
+                             "#f64[1.8446744073709552e+19 3.6893488147419103e+19]"})
+
+-- Unit tests of runtime internals, run with `xmake test`
+target("test_scan")
+    set_kind("binary")
+    set_default(false)
+    add_files("tests/scan.c")
+    add_includedirs("src")
+    add_deps("lispyrt")
+    add_tests("default")
 
 --
 -- If you want to known more usage about xmake, please see https://xmake.io